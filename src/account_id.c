@@ -0,0 +1,188 @@
+#include <R.h>
+#include <Rinternals.h>
+#include <string.h>
+#include "flureeCrypto.h"
+
+
+static const unsigned char account_id_version[2] = {0x0f, 0x02};
+
+
+// Derive the 26 account ID bytes of a public key, entirely in stack buffers
+void account_id_bytes(const unsigned char *pubkey, size_t pubkey_len, unsigned char out[ACCOUNT_ID_BYTES]) {
+  unsigned char digest[32];
+  sha256(pubkey, pubkey_len, digest);
+  memcpy(out, account_id_version, 2);
+  ripemd160(digest, 32, out + 2);
+  sha256(out, 22, digest);
+  sha256(digest, 32, digest);
+  memcpy(out + 22, digest, 4);
+}
+
+// Store the account ID of a public key as raw bytes or as Base58 into the
+// slot of item i
+static void store_account_id(const unsigned char *pubkey, size_t pubkey_len, int base58,
+                             unsigned char *bytes_out, char *chars_out, int *chars_len, R_xlen_t i) {
+  unsigned char id[ACCOUNT_ID_BYTES];
+  account_id_bytes(pubkey, pubkey_len, id);
+  if (base58) {
+    chars_len[i] = (int) base58_encode(id, ACCOUNT_ID_BYTES, chars_out + i * ACCOUNT_ID_MAX_CHARS);
+  } else {
+    memcpy(bytes_out + i * ACCOUNT_ID_BYTES, id, ACCOUNT_ID_BYTES);
+  }
+}
+
+// Build the result: a character vector with NA for failed items, or a
+// 26 x n raw matrix
+static SEXP account_id_result(R_xlen_t n, int base58, unsigned char *bytes, char *chars, int *chars_len,
+                              const int *status) {
+  if (base58) {
+    SEXP result = PROTECT(allocVector(STRSXP, n));
+    for (R_xlen_t i = 0; i < n; i++) {
+      SET_STRING_ELT(result, i, status[i] ? NA_STRING : mkCharLen(chars + i * ACCOUNT_ID_MAX_CHARS, chars_len[i]));
+    }
+    UNPROTECT(1);
+    return result;
+  }
+  for (R_xlen_t i = 0; i < n; i++) {
+    if (status[i]) {
+      error("Could not derive the account ID of element %lld.", (long long) i + 1);
+    }
+  }
+  if (n > INT_MAX) {
+    error("Too many account IDs for a raw matrix.");
+  }
+  SEXP result = PROTECT(allocMatrix(RAWSXP, ACCOUNT_ID_BYTES, (int) n));
+  memcpy(RAW(result), bytes, (size_t) n * ACCOUNT_ID_BYTES);
+  UNPROTECT(1);
+  return result;
+}
+
+
+typedef struct {
+  const unsigned char **pubkeys;
+  const size_t *pubkey_lens;
+  int base58;
+  unsigned char *bytes;
+  char *chars;
+  int *chars_len;
+  const int *status;
+} pubkey_id_batch;
+
+static void pubkey_id_worker(void *data, const secp256k1_context *ctx, R_xlen_t begin, R_xlen_t end) {
+  pubkey_id_batch *batch = (pubkey_id_batch *) data;
+  for (R_xlen_t i = begin; i < end; i++) {
+    if (batch->status[i] == 0) {
+      store_account_id(batch->pubkeys[i], batch->pubkey_lens[i], batch->base58,
+                       batch->bytes, batch->chars, batch->chars_len, i);
+    }
+  }
+}
+
+// Account IDs of many public keys: hex strings, a raw vector of concatenated
+// 33-byte compressed keys (the columns of a raw matrix) or a list of raw
+// vectors. Keys that are NA, NULL, not hex or not 33 or 65 bytes long give
+// NA. Returns Base58 strings, or a 26 x n raw matrix when base58 is FALSE.
+SEXP account_ids_R(SEXP pubkeys_R, SEXP base58_R, SEXP n_threads_R) {
+  int base58 = asLogical(base58_R) == TRUE;
+  int n_threads = asInteger(n_threads_R);
+  R_xlen_t n = public_key_count(pubkeys_R);
+
+  const unsigned char **pubkeys = (const unsigned char **) R_alloc(n + 1, sizeof(unsigned char *));
+  size_t *pubkey_lens = (size_t *) R_alloc(n + 1, sizeof(size_t));
+  int *status = (int *) R_alloc(n + 1, sizeof(int));
+  decode_public_keys(pubkeys_R, n, pubkeys, pubkey_lens, status);
+
+  pubkey_id_batch batch;
+  batch.pubkeys = pubkeys;
+  batch.pubkey_lens = pubkey_lens;
+  batch.base58 = base58;
+  batch.bytes = base58 ? NULL : (unsigned char *) R_alloc(n * ACCOUNT_ID_BYTES + 1, 1);
+  batch.chars = base58 ? R_alloc(n * ACCOUNT_ID_MAX_CHARS + 1, 1) : NULL;
+  batch.chars_len = (int *) R_alloc(n + 1, sizeof(int));
+  batch.status = status;
+  parallel_for(n, n_threads, pubkey_id_worker, &batch, 0);
+
+  return account_id_result(n, base58, batch.bytes, batch.chars, batch.chars_len, status);
+}
+
+
+typedef struct {
+  const unsigned char **signatures; // n signatures of signature_lens bytes
+  const size_t *signature_lens;
+  const unsigned char *hashes;      // n concatenated 32-byte hashes
+  int base58;
+  unsigned char *bytes;
+  char *chars;
+  int *chars_len;
+  int *status;
+} signature_id_batch;
+
+static void signature_id_worker(void *data, const secp256k1_context *ctx, R_xlen_t begin, R_xlen_t end) {
+  signature_id_batch *batch = (signature_id_batch *) data;
+  unsigned char pubkey[33];
+  for (R_xlen_t i = begin; i < end; i++) {
+    if (batch->status[i] != 0) {
+      continue;
+    }
+    batch->status[i] = recover_public_key_cached(ctx, batch->signatures[i], batch->signature_lens[i],
+                                                 batch->hashes + i * 32, pubkey);
+    if (batch->status[i] == 0) {
+      store_account_id(pubkey, 33, batch->base58, batch->bytes, batch->chars, batch->chars_len, i);
+    }
+  }
+}
+
+// Recover the signer of each (signature, hash) pair and derive its account
+// ID in the same pass, without handing the public keys back to R. Pairs that
+// cannot be recovered give NA.
+SEXP account_ids_from_signatures_R(SEXP signatures_R, SEXP hashes_R, SEXP base58_R, SEXP n_threads_R) {
+  R_xlen_t n = signature_count(signatures_R);
+  if (TYPEOF(hashes_R) != RAWSXP || XLENGTH(hashes_R) != n * 32) {
+    error("Hashes must be a raw vector of one 32-byte hash per signature.");
+  }
+  int base58 = asLogical(base58_R) == TRUE;
+  int n_threads = asInteger(n_threads_R);
+
+  signature_id_batch batch;
+  size_t *signature_lens = (size_t *) R_alloc(n + 1, sizeof(size_t));
+  int *status = (int *) R_alloc(n + 1, sizeof(int));
+  const unsigned char **signatures = decode_signatures(signatures_R, n, signature_lens, status);
+
+  batch.signatures = signatures;
+  batch.signature_lens = signature_lens;
+  batch.hashes = RAW(hashes_R);
+  batch.base58 = base58;
+  batch.bytes = base58 ? NULL : (unsigned char *) R_alloc(n * ACCOUNT_ID_BYTES + 1, 1);
+  batch.chars = base58 ? R_alloc(n * ACCOUNT_ID_MAX_CHARS + 1, 1) : NULL;
+  batch.chars_len = (int *) R_alloc(n + 1, sizeof(int));
+  batch.status = status;
+  parallel_for(n, n_threads, signature_id_worker, &batch, 1);
+
+  return account_id_result(n, base58, batch.bytes, batch.chars, batch.chars_len, status);
+}
+
+
+// Check that each string is a well-formed account ID: Base58Check with a
+// valid checksum around the version bytes and a 20-byte RIPEMD-160 digest.
+// NA strings give NA.
+SEXP account_ids_valid_R(SEXP ids_R) {
+  if (TYPEOF(ids_R) != STRSXP) {
+    error("Account IDs must be a character vector.");
+  }
+  R_xlen_t n = XLENGTH(ids_R);
+  SEXP result = PROTECT(allocVector(LGLSXP, n));
+  unsigned char payload[ACCOUNT_ID_MAX_CHARS];
+  for (R_xlen_t i = 0; i < n; i++) {
+    SEXP id_r = STRING_ELT(ids_R, i);
+    if (id_r == NA_STRING) {
+      LOGICAL(result)[i] = NA_LOGICAL;
+      continue;
+    }
+    size_t len = (size_t) LENGTH(id_r);
+    LOGICAL(result)[i] = len <= ACCOUNT_ID_MAX_CHARS &&
+      base58check_decode(CHAR(id_r), len, payload) == ACCOUNT_ID_BYTES - 4 &&
+      memcmp(payload, account_id_version, 2) == 0;
+  }
+  UNPROTECT(1);
+  return result;
+}
@@ -0,0 +1,815 @@
+#include <R.h>
+#include <Rinternals.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "flureeCrypto.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#include <cpuid.h>
+#define AES_X86 1
+#elif defined(__aarch64__) && (defined(__ARM_FEATURE_AES) || defined(__ARM_FEATURE_CRYPTO))
+#include <arm_neon.h>
+#define AES_ARM 1
+#endif
+
+
+// AES-128/192/256 (FIPS-197) in CBC mode with PKCS#7 padding, and the CTR
+// keystream that aes_gcm.c builds on. Keys are expanded once into a handle
+// that R keeps. The portable cipher uses T-tables built on first use;
+// AES-NI and ARMv8 AES take the same round keys. CBC decryption and CTR do
+// not chain, so the hardware paths keep eight blocks in flight and long
+// inputs are split across threads.
+
+// Blocks a thread decrypts at least before a message is split
+#define AES_PARALLEL_BLOCKS 4096
+
+static inline uint32_t load32_be(const unsigned char *p) {
+  return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | (uint32_t) p[3];
+}
+
+static inline void store32_be(unsigned char *p, uint32_t v) {
+  p[0] = (unsigned char) (v >> 24);
+  p[1] = (unsigned char) (v >> 16);
+  p[2] = (unsigned char) (v >> 8);
+  p[3] = (unsigned char) v;
+}
+
+#define ROTR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static unsigned char sbox[256];
+static unsigned char inv_sbox[256];
+static uint32_t te[256];   // (2s, s, s, 3s) of S-box entry s
+static uint32_t td[256];   // (14s, 9s, 13s, 11s) of inverse S-box entry s
+
+static unsigned char gf_mul(unsigned char a, unsigned char b) {
+  unsigned char p = 0;
+  while (b) {
+    if (b & 1) p ^= a;
+    a = (unsigned char) ((a << 1) ^ ((a & 0x80) ? 0x1b : 0));
+    b >>= 1;
+  }
+  return p;
+}
+
+static void build_tables() {
+  // Walk the multiplicative group with generator 3 and its inverse together
+  unsigned char p = 1, q = 1;
+  do {
+    p = (unsigned char) (p ^ (p << 1) ^ ((p & 0x80) ? 0x1b : 0));
+    q ^= (unsigned char) (q << 1);
+    q ^= (unsigned char) (q << 2);
+    q ^= (unsigned char) (q << 4);
+    if (q & 0x80) q ^= 0x09;
+    unsigned char x = q ^ (unsigned char) ((q << 1) | (q >> 7)) ^ (unsigned char) ((q << 2) | (q >> 6)) ^
+                      (unsigned char) ((q << 3) | (q >> 5)) ^ (unsigned char) ((q << 4) | (q >> 4));
+    sbox[p] = x ^ 0x63;
+  } while (p != 1);
+  sbox[0] = 0x63;
+
+  for (int i = 0; i < 256; i++) {
+    inv_sbox[sbox[i]] = (unsigned char) i;
+  }
+  for (int i = 0; i < 256; i++) {
+    unsigned char s = sbox[i], v = inv_sbox[i];
+    te[i] = ((uint32_t) gf_mul(s, 2) << 24) | ((uint32_t) s << 16) | ((uint32_t) s << 8) | gf_mul(s, 3);
+    td[i] = ((uint32_t) gf_mul(v, 14) << 24) | ((uint32_t) gf_mul(v, 9) << 16) | ((uint32_t) gf_mul(v, 13) << 8) |
+            gf_mul(v, 11);
+  }
+}
+
+
+static void encrypt_block_generic(const aes_key *key, const unsigned char *in, unsigned char *out) {
+  const unsigned char *rk = key->enc;
+  uint32_t s0 = load32_be(in) ^ load32_be(rk), s1 = load32_be(in + 4) ^ load32_be(rk + 4);
+  uint32_t s2 = load32_be(in + 8) ^ load32_be(rk + 8), s3 = load32_be(in + 12) ^ load32_be(rk + 12);
+  uint32_t t0, t1, t2, t3;
+  for (int r = 1; r < key->rounds; r++) {
+    rk += 16;
+    t0 = te[s0 >> 24] ^ ROTR32(te[(s1 >> 16) & 0xff], 8) ^ ROTR32(te[(s2 >> 8) & 0xff], 16) ^
+         ROTR32(te[s3 & 0xff], 24) ^ load32_be(rk);
+    t1 = te[s1 >> 24] ^ ROTR32(te[(s2 >> 16) & 0xff], 8) ^ ROTR32(te[(s3 >> 8) & 0xff], 16) ^
+         ROTR32(te[s0 & 0xff], 24) ^ load32_be(rk + 4);
+    t2 = te[s2 >> 24] ^ ROTR32(te[(s3 >> 16) & 0xff], 8) ^ ROTR32(te[(s0 >> 8) & 0xff], 16) ^
+         ROTR32(te[s1 & 0xff], 24) ^ load32_be(rk + 8);
+    t3 = te[s3 >> 24] ^ ROTR32(te[(s0 >> 16) & 0xff], 8) ^ ROTR32(te[(s1 >> 8) & 0xff], 16) ^
+         ROTR32(te[s2 & 0xff], 24) ^ load32_be(rk + 12);
+    s0 = t0; s1 = t1; s2 = t2; s3 = t3;
+  }
+  rk += 16;
+#define SUB_ROW(a, b, c, d) \
+  (((uint32_t) sbox[(a) >> 24] << 24) | ((uint32_t) sbox[((b) >> 16) & 0xff] << 16) | \
+   ((uint32_t) sbox[((c) >> 8) & 0xff] << 8) | (uint32_t) sbox[(d) & 0xff])
+  store32_be(out, SUB_ROW(s0, s1, s2, s3) ^ load32_be(rk));
+  store32_be(out + 4, SUB_ROW(s1, s2, s3, s0) ^ load32_be(rk + 4));
+  store32_be(out + 8, SUB_ROW(s2, s3, s0, s1) ^ load32_be(rk + 8));
+  store32_be(out + 12, SUB_ROW(s3, s0, s1, s2) ^ load32_be(rk + 12));
+#undef SUB_ROW
+}
+
+static void decrypt_block_generic(const aes_key *key, const unsigned char *in, unsigned char *out) {
+  const unsigned char *rk = key->dec;
+  uint32_t s0 = load32_be(in) ^ load32_be(rk), s1 = load32_be(in + 4) ^ load32_be(rk + 4);
+  uint32_t s2 = load32_be(in + 8) ^ load32_be(rk + 8), s3 = load32_be(in + 12) ^ load32_be(rk + 12);
+  uint32_t t0, t1, t2, t3;
+  for (int r = 1; r < key->rounds; r++) {
+    rk += 16;
+    t0 = td[s0 >> 24] ^ ROTR32(td[(s3 >> 16) & 0xff], 8) ^ ROTR32(td[(s2 >> 8) & 0xff], 16) ^
+         ROTR32(td[s1 & 0xff], 24) ^ load32_be(rk);
+    t1 = td[s1 >> 24] ^ ROTR32(td[(s0 >> 16) & 0xff], 8) ^ ROTR32(td[(s3 >> 8) & 0xff], 16) ^
+         ROTR32(td[s2 & 0xff], 24) ^ load32_be(rk + 4);
+    t2 = td[s2 >> 24] ^ ROTR32(td[(s1 >> 16) & 0xff], 8) ^ ROTR32(td[(s0 >> 8) & 0xff], 16) ^
+         ROTR32(td[s3 & 0xff], 24) ^ load32_be(rk + 8);
+    t3 = td[s3 >> 24] ^ ROTR32(td[(s2 >> 16) & 0xff], 8) ^ ROTR32(td[(s1 >> 8) & 0xff], 16) ^
+         ROTR32(td[s0 & 0xff], 24) ^ load32_be(rk + 12);
+    s0 = t0; s1 = t1; s2 = t2; s3 = t3;
+  }
+  rk += 16;
+#define INV_SUB_ROW(a, b, c, d) \
+  (((uint32_t) inv_sbox[(a) >> 24] << 24) | ((uint32_t) inv_sbox[((b) >> 16) & 0xff] << 16) | \
+   ((uint32_t) inv_sbox[((c) >> 8) & 0xff] << 8) | (uint32_t) inv_sbox[(d) & 0xff])
+  store32_be(out, INV_SUB_ROW(s0, s3, s2, s1) ^ load32_be(rk));
+  store32_be(out + 4, INV_SUB_ROW(s1, s0, s3, s2) ^ load32_be(rk + 4));
+  store32_be(out + 8, INV_SUB_ROW(s2, s1, s0, s3) ^ load32_be(rk + 8));
+  store32_be(out + 12, INV_SUB_ROW(s3, s2, s1, s0) ^ load32_be(rk + 12));
+#undef INV_SUB_ROW
+}
+
+static void cbc_encrypt_generic(const aes_key *key, unsigned char iv[16], const unsigned char *in, unsigned char *out,
+                                size_t blocks) {
+  unsigned char x[16];
+  for (size_t b = 0; b < blocks; b++) {
+    for (int i = 0; i < 16; i++) {
+      x[i] = in[16 * b + i] ^ iv[i];
+    }
+    encrypt_block_generic(key, x, iv);
+    memcpy(out + 16 * b, iv, 16);
+  }
+}
+
+static void cbc_decrypt_generic(const aes_key *key, unsigned char iv[16], const unsigned char *in, unsigned char *out,
+                                size_t blocks) {
+  unsigned char x[16], c[16];
+  for (size_t b = 0; b < blocks; b++) {
+    memcpy(c, in + 16 * b, 16);
+    decrypt_block_generic(key, c, x);
+    for (int i = 0; i < 16; i++) {
+      out[16 * b + i] = x[i] ^ iv[i];
+    }
+    memcpy(iv, c, 16);
+  }
+}
+
+// Step a counter block: the last 32 bits (GCM) or all 128 bits (CTR)
+static inline void counter_increment(unsigned char counter[16], int inc32) {
+  for (int i = 15; i >= (inc32 ? 12 : 0); i--) {
+    if (++counter[i] != 0) {
+      break;
+    }
+  }
+}
+
+static void ctr_generic(const aes_key *key, unsigned char counter[16], int inc32, const unsigned char *in,
+                        unsigned char *out, size_t blocks) {
+  unsigned char stream[16];
+  for (size_t b = 0; b < blocks; b++) {
+    encrypt_block_generic(key, counter, stream);
+    counter_increment(counter, inc32);
+    for (int i = 0; i < 16; i++) {
+      out[16 * b + i] = in[16 * b + i] ^ stream[i];
+    }
+  }
+  secure_wipe(stream, sizeof(stream));
+}
+
+
+#if defined(AES_X86)
+static int cpu_has_aesni() {
+  unsigned int eax, ebx, ecx, edx;
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+    return 0;
+  }
+  return (ecx & bit_AES) != 0;
+}
+
+__attribute__((target("aes,sse2")))
+static void cbc_encrypt_aesni(const aes_key *key, unsigned char iv[16], const unsigned char *in, unsigned char *out,
+                              size_t blocks) {
+  __m128i rk[15];
+  for (int r = 0; r <= key->rounds; r++) {
+    rk[r] = _mm_loadu_si128((const __m128i *) (key->enc + 16 * r));
+  }
+  __m128i c = _mm_loadu_si128((const __m128i *) iv);
+  for (size_t b = 0; b < blocks; b++) {
+    c = _mm_xor_si128(c, _mm_loadu_si128((const __m128i *) (in + 16 * b)));
+    c = _mm_xor_si128(c, rk[0]);
+    for (int r = 1; r < key->rounds; r++) {
+      c = _mm_aesenc_si128(c, rk[r]);
+    }
+    c = _mm_aesenclast_si128(c, rk[key->rounds]);
+    _mm_storeu_si128((__m128i *) (out + 16 * b), c);
+  }
+  _mm_storeu_si128((__m128i *) iv, c);
+}
+
+__attribute__((target("aes,sse2")))
+static void cbc_decrypt_aesni(const aes_key *key, unsigned char iv[16], const unsigned char *in, unsigned char *out,
+                              size_t blocks) {
+  __m128i rk[15];
+  for (int r = 0; r <= key->rounds; r++) {
+    rk[r] = _mm_loadu_si128((const __m128i *) (key->dec + 16 * r));
+  }
+  __m128i prev = _mm_loadu_si128((const __m128i *) iv);
+  size_t b = 0;
+  for (; b + 8 <= blocks; b += 8) {
+    __m128i c[8], s[8];
+    for (int k = 0; k < 8; k++) {
+      c[k] = _mm_loadu_si128((const __m128i *) (in + 16 * (b + k)));
+      s[k] = _mm_xor_si128(c[k], rk[0]);
+    }
+    for (int r = 1; r < key->rounds; r++) {
+      for (int k = 0; k < 8; k++) {
+        s[k] = _mm_aesdec_si128(s[k], rk[r]);
+      }
+    }
+    for (int k = 0; k < 8; k++) {
+      s[k] = _mm_aesdeclast_si128(s[k], rk[key->rounds]);
+    }
+    _mm_storeu_si128((__m128i *) (out + 16 * b), _mm_xor_si128(s[0], prev));
+    for (int k = 1; k < 8; k++) {
+      _mm_storeu_si128((__m128i *) (out + 16 * (b + k)), _mm_xor_si128(s[k], c[k - 1]));
+    }
+    prev = c[7];
+  }
+  for (; b < blocks; b++) {
+    __m128i c = _mm_loadu_si128((const __m128i *) (in + 16 * b));
+    __m128i s = _mm_xor_si128(c, rk[0]);
+    for (int r = 1; r < key->rounds; r++) {
+      s = _mm_aesdec_si128(s, rk[r]);
+    }
+    s = _mm_aesdeclast_si128(s, rk[key->rounds]);
+    _mm_storeu_si128((__m128i *) (out + 16 * b), _mm_xor_si128(s, prev));
+    prev = c;
+  }
+  _mm_storeu_si128((__m128i *) iv, prev);
+}
+
+__attribute__((target("aes,sse2")))
+static void ctr_aesni(const aes_key *key, unsigned char counter[16], int inc32, const unsigned char *in,
+                      unsigned char *out, size_t blocks) {
+  __m128i rk[15];
+  for (int r = 0; r <= key->rounds; r++) {
+    rk[r] = _mm_loadu_si128((const __m128i *) (key->enc + 16 * r));
+  }
+  unsigned char counters[8 * 16];
+  size_t b = 0;
+  while (b < blocks) {
+    int n = (blocks - b < 8) ? (int) (blocks - b) : 8;
+    __m128i s[8];
+    for (int k = 0; k < n; k++) {
+      memcpy(counters + 16 * k, counter, 16);
+      counter_increment(counter, inc32);
+      s[k] = _mm_xor_si128(_mm_loadu_si128((const __m128i *) (counters + 16 * k)), rk[0]);
+    }
+    for (int r = 1; r < key->rounds; r++) {
+      for (int k = 0; k < n; k++) {
+        s[k] = _mm_aesenc_si128(s[k], rk[r]);
+      }
+    }
+    for (int k = 0; k < n; k++) {
+      s[k] = _mm_aesenclast_si128(s[k], rk[key->rounds]);
+      __m128i x = _mm_loadu_si128((const __m128i *) (in + 16 * (b + k)));
+      _mm_storeu_si128((__m128i *) (out + 16 * (b + k)), _mm_xor_si128(x, s[k]));
+    }
+    b += (size_t) n;
+  }
+}
+#endif
+
+#if defined(AES_ARM)
+static void cbc_encrypt_arm(const aes_key *key, unsigned char iv[16], const unsigned char *in, unsigned char *out,
+                            size_t blocks) {
+  uint8x16_t rk[15];
+  for (int r = 0; r <= key->rounds; r++) {
+    rk[r] = vld1q_u8(key->enc + 16 * r);
+  }
+  uint8x16_t c = vld1q_u8(iv);
+  for (size_t b = 0; b < blocks; b++) {
+    c = veorq_u8(c, vld1q_u8(in + 16 * b));
+    for (int r = 0; r < key->rounds - 1; r++) {
+      c = vaesmcq_u8(vaeseq_u8(c, rk[r]));
+    }
+    c = veorq_u8(vaeseq_u8(c, rk[key->rounds - 1]), rk[key->rounds]);
+    vst1q_u8(out + 16 * b, c);
+  }
+  vst1q_u8(iv, c);
+}
+
+static void cbc_decrypt_arm(const aes_key *key, unsigned char iv[16], const unsigned char *in, unsigned char *out,
+                            size_t blocks) {
+  uint8x16_t rk[15];
+  for (int r = 0; r <= key->rounds; r++) {
+    rk[r] = vld1q_u8(key->dec + 16 * r);
+  }
+  uint8x16_t prev = vld1q_u8(iv);
+  size_t b = 0;
+  for (; b + 8 <= blocks; b += 8) {
+    uint8x16_t c[8], s[8];
+    for (int k = 0; k < 8; k++) {
+      c[k] = s[k] = vld1q_u8(in + 16 * (b + k));
+    }
+    for (int r = 0; r < key->rounds - 1; r++) {
+      for (int k = 0; k < 8; k++) {
+        s[k] = vaesimcq_u8(vaesdq_u8(s[k], rk[r]));
+      }
+    }
+    for (int k = 0; k < 8; k++) {
+      s[k] = veorq_u8(vaesdq_u8(s[k], rk[key->rounds - 1]), rk[key->rounds]);
+    }
+    vst1q_u8(out + 16 * b, veorq_u8(s[0], prev));
+    for (int k = 1; k < 8; k++) {
+      vst1q_u8(out + 16 * (b + k), veorq_u8(s[k], c[k - 1]));
+    }
+    prev = c[7];
+  }
+  for (; b < blocks; b++) {
+    uint8x16_t c = vld1q_u8(in + 16 * b), s = c;
+    for (int r = 0; r < key->rounds - 1; r++) {
+      s = vaesimcq_u8(vaesdq_u8(s, rk[r]));
+    }
+    s = veorq_u8(vaesdq_u8(s, rk[key->rounds - 1]), rk[key->rounds]);
+    vst1q_u8(out + 16 * b, veorq_u8(s, prev));
+    prev = c;
+  }
+  vst1q_u8(iv, prev);
+}
+
+static void ctr_arm(const aes_key *key, unsigned char counter[16], int inc32, const unsigned char *in,
+                    unsigned char *out, size_t blocks) {
+  uint8x16_t rk[15];
+  for (int r = 0; r <= key->rounds; r++) {
+    rk[r] = vld1q_u8(key->enc + 16 * r);
+  }
+  size_t b = 0;
+  while (b < blocks) {
+    int n = (blocks - b < 8) ? (int) (blocks - b) : 8;
+    uint8x16_t s[8];
+    for (int k = 0; k < n; k++) {
+      s[k] = vld1q_u8(counter);
+      counter_increment(counter, inc32);
+    }
+    for (int r = 0; r < key->rounds - 1; r++) {
+      for (int k = 0; k < n; k++) {
+        s[k] = vaesmcq_u8(vaeseq_u8(s[k], rk[r]));
+      }
+    }
+    for (int k = 0; k < n; k++) {
+      s[k] = veorq_u8(vaeseq_u8(s[k], rk[key->rounds - 1]), rk[key->rounds]);
+      vst1q_u8(out + 16 * (b + k), veorq_u8(vld1q_u8(in + 16 * (b + k)), s[k]));
+    }
+    b += (size_t) n;
+  }
+}
+#endif
+
+
+// Build the tables and pick the block functions once, on first use
+typedef void (*aes_cbc_fn)(const aes_key *key, unsigned char iv[16], const unsigned char *in, unsigned char *out,
+                           size_t blocks);
+static aes_cbc_fn cbc_encrypt = cbc_encrypt_generic;
+static aes_cbc_fn cbc_decrypt = cbc_decrypt_generic;
+typedef void (*aes_ctr_fn)(const aes_key *key, unsigned char counter[16], int inc32, const unsigned char *in,
+                           unsigned char *out, size_t blocks);
+static aes_ctr_fn ctr_blocks = ctr_generic;
+static const char *aes_backend = "generic";
+static pthread_once_t aes_once = PTHREAD_ONCE_INIT;
+
+static void aes_select() {
+  build_tables();
+#if defined(AES_X86)
+  if (cpu_has_aesni()) {
+    cbc_encrypt = cbc_encrypt_aesni;
+    cbc_decrypt = cbc_decrypt_aesni;
+    ctr_blocks = ctr_aesni;
+    aes_backend = "aes-ni";
+  }
+#elif defined(AES_ARM)
+  cbc_encrypt = cbc_encrypt_arm;
+  cbc_decrypt = cbc_decrypt_arm;
+  ctr_blocks = ctr_arm;
+  aes_backend = "armv8";
+#endif
+}
+
+static inline void aes_dispatch() {
+  pthread_once(&aes_once, aes_select);
+}
+
+const char* aes_implementation() {
+  aes_dispatch();
+  return aes_backend;
+}
+
+
+// Expand a 16-, 24- or 32-byte key. The decryption schedule is the
+// encryption one reversed, with InvMixColumns applied to the inner rounds.
+void aes_expand_key(aes_key *key, const unsigned char *bytes, size_t len) {
+  aes_dispatch();
+  int nk = (int) (len / 4);
+  int rounds = nk + 6;
+  int words = 4 * (rounds + 1);
+  uint32_t w[60];
+  uint32_t rcon = 0x01000000;
+  for (int i = 0; i < nk; i++) {
+    w[i] = load32_be(bytes + 4 * i);
+  }
+  for (int i = nk; i < words; i++) {
+    uint32_t t = w[i - 1];
+    if (i % nk == 0) {
+      t = (t << 8) | (t >> 24);
+      t = ((uint32_t) sbox[t >> 24] << 24) | ((uint32_t) sbox[(t >> 16) & 0xff] << 16) |
+          ((uint32_t) sbox[(t >> 8) & 0xff] << 8) | sbox[t & 0xff];
+      t ^= rcon;
+      rcon = (uint32_t) gf_mul((unsigned char) (rcon >> 24), 2) << 24;
+    } else if (nk > 6 && i % nk == 4) {
+      t = ((uint32_t) sbox[t >> 24] << 24) | ((uint32_t) sbox[(t >> 16) & 0xff] << 16) |
+          ((uint32_t) sbox[(t >> 8) & 0xff] << 8) | sbox[t & 0xff];
+    }
+    w[i] = w[i - nk] ^ t;
+  }
+
+  key->rounds = rounds;
+  for (int i = 0; i < words; i++) {
+    store32_be(key->enc + 4 * i, w[i]);
+  }
+  for (int r = 0; r <= rounds; r++) {
+    for (int c = 0; c < 4; c++) {
+      uint32_t v = w[4 * (rounds - r) + c];
+      if (r > 0 && r < rounds) {
+        v = td[sbox[v >> 24]] ^ ROTR32(td[sbox[(v >> 16) & 0xff]], 8) ^ ROTR32(td[sbox[(v >> 8) & 0xff]], 16) ^
+            ROTR32(td[sbox[v & 0xff]], 24);
+      }
+      store32_be(key->dec + 16 * r + 4 * c, v);
+    }
+  }
+  secure_wipe(w, sizeof(w));
+}
+
+void aes_cbc_encrypt(const aes_key *key, unsigned char iv[16], const unsigned char *in, unsigned char *out,
+                     size_t blocks) {
+  aes_dispatch();
+  cbc_encrypt(key, iv, in, out, blocks);
+}
+
+void aes_cbc_decrypt(const aes_key *key, unsigned char iv[16], const unsigned char *in, unsigned char *out,
+                     size_t blocks) {
+  aes_dispatch();
+  cbc_decrypt(key, iv, in, out, blocks);
+}
+
+void aes_encrypt_block(const aes_key *key, const unsigned char in[16], unsigned char out[16]) {
+  // CBC with a zero IV is the bare block cipher
+  unsigned char iv[16] = {0};
+  aes_cbc_encrypt(key, iv, in, out, 1);
+}
+
+void aes_ctr_xor(const aes_key *key, unsigned char counter[16], int inc32, const unsigned char *in,
+                 unsigned char *out, size_t len) {
+  aes_dispatch();
+  size_t blocks = len / 16, rest = len % 16;
+  ctr_blocks(key, counter, inc32, in, out, blocks);
+  if (rest > 0) {
+    unsigned char stream[16];
+    aes_encrypt_block(key, counter, stream);
+    counter_increment(counter, inc32);
+    for (size_t i = 0; i < rest; i++) {
+      out[16 * blocks + i] = in[16 * blocks + i] ^ stream[i];
+    }
+    secure_wipe(stream, sizeof(stream));
+  }
+}
+
+void aes_counter_add(unsigned char counter[16], int inc32, uint64_t n) {
+  int stop = inc32 ? 12 : 0;
+  for (int i = 15; i >= stop && n > 0; i--) {
+    uint64_t sum = (uint64_t) counter[i] + (n & 0xff);
+    counter[i] = (unsigned char) sum;
+    n = (n >> 8) + (sum >> 8);
+  }
+}
+
+
+// Key handles
+
+static SEXP aes_key_tag() {
+  return install("flureeCrypto_aes_key");
+}
+
+static void aes_key_finalizer(SEXP ptr) {
+  aes_key *key = (aes_key *) R_ExternalPtrAddr(ptr);
+  if (key != NULL) {
+    secure_wipe(key, sizeof(aes_key));
+    free(key);
+    R_ClearExternalPtr(ptr);
+  }
+}
+
+// The key behind an AES key handle, or NULL if x is not one
+const aes_key* aes_key_from_R(SEXP x) {
+  if (TYPEOF(x) != EXTPTRSXP || R_ExternalPtrTag(x) != aes_key_tag()) {
+    return NULL;
+  }
+  const aes_key *key = (const aes_key *) R_ExternalPtrAddr(x);
+  if (key == NULL) {
+    error("The AES key is no longer valid; create it again.");
+  }
+  return key;
+}
+
+void aes_key_expand_R(SEXP key_r, aes_key *key) {
+  const aes_key *handle = aes_key_from_R(key_r);
+  if (handle != NULL) {
+    memcpy(key, handle, sizeof(aes_key));
+  } else if (TYPEOF(key_r) == RAWSXP) {
+    R_xlen_t len = XLENGTH(key_r);
+    if (len != 16 && len != 24 && len != 32) {
+      error("Key must be 16, 24, or 32 bytes long.");
+    }
+    aes_expand_key(key, RAW(key_r), (size_t) len);
+  } else if (TYPEOF(key_r) == STRSXP && XLENGTH(key_r) == 1 && STRING_ELT(key_r, 0) != NA_STRING) {
+    SEXP s = STRING_ELT(key_r, 0);
+    unsigned char digest[64];
+    sha3((const unsigned char *) CHAR(s), (size_t) LENGTH(s), 64, digest);
+    aes_expand_key(key, digest, 32);
+    secure_wipe(digest, sizeof(digest));
+  } else {
+    error("Key should be a character string, raw byte array or AES key.");
+  }
+}
+
+// A protected external pointer to a zeroed key that its finalizer wipes and
+// frees, registered before the key is written so an error cannot leak it
+static SEXP new_aes_key_ptr(aes_key **key) {
+  SEXP ptr = PROTECT(R_MakeExternalPtr(NULL, aes_key_tag(), R_NilValue));
+  R_RegisterCFinalizerEx(ptr, aes_key_finalizer, TRUE);
+  *key = (aes_key *) calloc(1, sizeof(aes_key));
+  if (*key == NULL) {
+    error("Failed to allocate an AES key");
+  }
+  R_SetExternalPtrAddr(ptr, *key);
+  return ptr;
+}
+
+SEXP aes_key_R(SEXP key_r) {
+  aes_key *key;
+  SEXP ptr = new_aes_key_ptr(&key);
+  aes_key_expand_R(key_r, key);
+  UNPROTECT(1);
+  return ptr;
+}
+
+// An AES key handle, with its R class, for key bytes derived in C (such as
+// ECDH secrets) that should not pass through R
+SEXP aes_key_handle(const unsigned char *bytes, size_t len) {
+  aes_key *key;
+  SEXP ptr = new_aes_key_ptr(&key);
+  aes_expand_key(key, bytes, len);
+  setAttrib(ptr, R_ClassSymbol, mkString("flureeCrypto_aes_key"));
+  UNPROTECT(1);
+  return ptr;
+}
+
+// The key size of a handle in bits
+SEXP aes_key_bits_R(SEXP ptr) {
+  const aes_key *key = aes_key_from_R(ptr);
+  if (key == NULL) {
+    error("Not an AES key.");
+  }
+  return ScalarInteger(32 * (key->rounds - 6));
+}
+
+SEXP aes_implementation_R() {
+  return mkString(aes_implementation());
+}
+
+
+// CBC with PKCS#7 padding
+
+typedef struct {
+  const aes_key *key;
+  const unsigned char *iv;
+  const unsigned char **in;
+  const size_t *in_lens;
+  unsigned char **out;
+  size_t *out_lens;   // decryption: plaintext length, or SIZE_MAX for bad input
+} cbc_batch;
+
+static void encrypt_message(const aes_key *key, const unsigned char *iv_r, const unsigned char *in, size_t len,
+                            unsigned char *out) {
+  unsigned char iv[16], last[16];
+  size_t full = len / 16, rest = len % 16;
+  memcpy(iv, iv_r, 16);
+  aes_cbc_encrypt(key, iv, in, out, full);
+  memcpy(last, in + 16 * full, rest);
+  memset(last + rest, (int) (16 - rest), 16 - rest);
+  aes_cbc_encrypt(key, iv, last, out + 16 * full, 1);
+  secure_wipe(last, sizeof(last));
+}
+
+size_t pkcs7_unpadded_len(const unsigned char *plain, size_t len) {
+  unsigned char pad = plain[len - 1];
+  unsigned char bad = (unsigned char) (pad == 0 || pad > 16);
+  for (size_t i = 1; i <= 16; i++) {
+    bad |= (unsigned char) ((i <= pad) & (plain[len - i] != pad));
+  }
+  return bad ? SIZE_MAX : len - pad;
+}
+
+static void cbc_worker(void *data, const secp256k1_context *ctx, R_xlen_t begin, R_xlen_t end) {
+  cbc_batch *batch = (cbc_batch *) data;
+  for (R_xlen_t i = begin; i < end; i++) {
+    if (batch->in[i] == NULL) {
+      continue;
+    }
+    if (batch->out_lens == NULL) {
+      encrypt_message(batch->key, batch->iv, batch->in[i], batch->in_lens[i], batch->out[i]);
+      continue;
+    }
+    size_t len = batch->in_lens[i];
+    if (len == 0 || len % 16 != 0) {
+      batch->out_lens[i] = SIZE_MAX;
+      continue;
+    }
+    unsigned char iv[16];
+    memcpy(iv, batch->iv, 16);
+    aes_cbc_decrypt(batch->key, iv, batch->in[i], batch->out[i], len / 16);
+    batch->out_lens[i] = pkcs7_unpadded_len(batch->out[i], len);
+  }
+}
+
+// One long message, its blocks split across threads. A chunk takes the
+// ciphertext block before it as its IV.
+typedef struct {
+  const aes_key *key;
+  const unsigned char *iv;
+  const unsigned char *in;
+  unsigned char *out;
+} cbc_blocks;
+
+static void cbc_blocks_worker(void *data, const secp256k1_context *ctx, R_xlen_t begin, R_xlen_t end) {
+  cbc_blocks *job = (cbc_blocks *) data;
+  unsigned char iv[16];
+  memcpy(iv, begin == 0 ? job->iv : job->in + 16 * (begin - 1), 16);
+  aes_cbc_decrypt(job->key, iv, job->in + 16 * begin, job->out + 16 * begin, (size_t) (end - begin));
+}
+
+void aes_cbc_decrypt_parallel(const aes_key *key, unsigned char iv[16], const unsigned char *in, unsigned char *out,
+                              size_t blocks, int n_threads) {
+  if (n_threads == NA_INTEGER || n_threads < 1) {
+    n_threads = 1;
+  }
+  if ((size_t) n_threads > blocks / AES_PARALLEL_BLOCKS) {
+    n_threads = (int) (blocks / AES_PARALLEL_BLOCKS);
+  }
+  if (n_threads <= 1) {
+    aes_cbc_decrypt(key, iv, in, out, blocks);
+    return;
+  }
+  cbc_blocks job = {key, iv, in, out};
+  parallel_for((R_xlen_t) blocks, n_threads, cbc_blocks_worker, &job, 0);
+  memcpy(iv, in + 16 * (blocks - 1), 16);
+}
+
+// The plaintext of one ciphertext, whose length the caller has checked, or
+// NULL if its padding is invalid
+static SEXP decrypt_raw(const aes_key *key, const unsigned char *iv_r, SEXP x, int n_threads) {
+  size_t len = (size_t) XLENGTH(x);
+  unsigned char iv[16];
+  memcpy(iv, iv_r, 16);
+  unsigned char *plain = (unsigned char *) R_alloc(len, 1);
+  aes_cbc_decrypt_parallel(key, iv, RAW(x), plain, len / 16, n_threads);
+  size_t plain_len = pkcs7_unpadded_len(plain, len);
+  if (plain_len == SIZE_MAX) {
+    secure_wipe(plain, len);
+    return NULL;
+  }
+  SEXP result = PROTECT(allocVector(RAWSXP, (R_xlen_t) plain_len));
+  memcpy(RAW(result), plain, plain_len);
+  secure_wipe(plain, len);
+  UNPROTECT(1);
+  return result;
+}
+
+// Encrypt or decrypt with AES-CBC and PKCS#7 padding. x is a raw vector, of
+// which the result is a raw vector, or a character vector (encryption only)
+// or list of raw vectors, of which the result is a list in which NA strings,
+// NULL elements and (decryption) invalid ciphertexts give NULL. Messages are
+// spread across threads; one long ciphertext is decrypted in parallel.
+SEXP aes_cbc_R(SEXP key_r, SEXP iv_r, SEXP x, SEXP encrypt_r, SEXP n_threads_R) {
+  if (TYPEOF(iv_r) != RAWSXP || XLENGTH(iv_r) != 16) {
+    error("Initialization vector must be a 16-byte raw vector.");
+  }
+  int encrypt = asLogical(encrypt_r);
+  int n_threads = asInteger(n_threads_R);
+  aes_key key;
+  aes_key_expand_R(key_r, &key);
+
+  if (TYPEOF(x) == RAWSXP) {
+    SEXP result;
+    if (encrypt) {
+      size_t len = (size_t) XLENGTH(x);
+      result = PROTECT(allocVector(RAWSXP, (R_xlen_t) (len - len % 16 + 16)));
+      encrypt_message(&key, RAW(iv_r), RAW(x), len, RAW(result));
+    } else {
+      size_t len = (size_t) XLENGTH(x);
+      if (len == 0 || len % 16 != 0) {
+        secure_wipe(&key, sizeof(key));
+        error("Ciphertext length must be a positive multiple of 16 bytes.");
+      }
+      result = decrypt_raw(&key, RAW(iv_r), x, n_threads);
+      if (result == NULL) {
+        secure_wipe(&key, sizeof(key));
+        error("Decryption failed: invalid padding.");
+      }
+      PROTECT(result);
+    }
+    secure_wipe(&key, sizeof(key));
+    UNPROTECT(1);
+    return result;
+  }
+  if (TYPEOF(x) != VECSXP && !(encrypt && TYPEOF(x) == STRSXP)) {
+    secure_wipe(&key, sizeof(key));
+    error(encrypt ? "Input must be a raw vector, a character vector or a list of raw vectors."
+                  : "Input must be a raw vector or a list of raw vectors.");
+  }
+
+  R_xlen_t n = XLENGTH(x);
+  cbc_batch batch;
+  batch.key = &key;
+  batch.iv = RAW(iv_r);
+  batch.in = (const unsigned char **) R_alloc(n + 1, sizeof(unsigned char *));
+  batch.in_lens = (size_t *) R_alloc(n + 1, sizeof(size_t));
+  batch.out = (unsigned char **) R_alloc(n + 1, sizeof(unsigned char *));
+  batch.out_lens = encrypt ? NULL : (size_t *) R_alloc(n + 1, sizeof(size_t));
+  size_t *lens = (size_t *) batch.in_lens;
+  size_t total = 0;
+  for (R_xlen_t i = 0; i < n; i++) {
+    batch.in[i] = NULL;
+    lens[i] = 0;
+    if (TYPEOF(x) == STRSXP) {
+      SEXP s = STRING_ELT(x, i);
+      if (s != NA_STRING) {
+        batch.in[i] = (const unsigned char *) CHAR(s);
+        lens[i] = (size_t) LENGTH(s);
+      }
+    } else {
+      SEXP el = VECTOR_ELT(x, i);
+      if (TYPEOF(el) == RAWSXP) {
+        batch.in[i] = RAW(el);
+        lens[i] = (size_t) XLENGTH(el);
+      } else if (el != R_NilValue) {
+        secure_wipe(&key, sizeof(key));
+        error("Element %lld of the input is not a raw vector.", (long long) i + 1);
+      }
+    }
+    total += lens[i];
+  }
+
+  SEXP result = PROTECT(allocVector(VECSXP, n));
+  unsigned char *plain = NULL;
+  if (encrypt) {
+    // Ciphertexts are written straight into their raw vectors
+    for (R_xlen_t i = 0; i < n; i++) {
+      if (batch.in[i] != NULL) {
+        SEXP el = allocVector(RAWSXP, (R_xlen_t) (lens[i] - lens[i] % 16 + 16));
+        SET_VECTOR_ELT(result, i, el);
+        batch.out[i] = RAW(el);
+      }
+    }
+  } else {
+    plain = (unsigned char *) R_alloc(total + 1, 1);
+    size_t offset = 0;
+    for (R_xlen_t i = 0; i < n; i++) {
+      batch.out[i] = plain + offset;
+      offset += lens[i];
+    }
+  }
+
+  parallel_for(n, n_threads, cbc_worker, &batch, 0);
+
+  if (!encrypt) {
+    for (R_xlen_t i = 0; i < n; i++) {
+      if (batch.in[i] != NULL && batch.out_lens[i] != SIZE_MAX) {
+        SEXP el = allocVector(RAWSXP, (R_xlen_t) batch.out_lens[i]);
+        SET_VECTOR_ELT(result, i, el);
+        memcpy(RAW(el), batch.out[i], batch.out_lens[i]);
+      }
+    }
+    secure_wipe(plain, total);
+  }
+  secure_wipe(&key, sizeof(key));
+  UNPROTECT(1);
+  return result;
+}
@@ -0,0 +1,654 @@
+#include <R.h>
+#include <Rinternals.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "flureeCrypto.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#include <cpuid.h>
+#define GHASH_X86 1
+#elif defined(__aarch64__) && (defined(__ARM_FEATURE_AES) || defined(__ARM_FEATURE_CRYPTO))
+#include <arm_neon.h>
+#define GHASH_ARM 1
+#endif
+
+
+// AES-GCM (NIST SP 800-38D) with a 96-bit nonce and no additional data, and
+// raw AES-CTR, on the keystream of aes.c. A message is sealed as
+// nonce || ciphertext || tag (GCM) or counter block || ciphertext (CTR).
+// GHASH uses PCLMULQDQ or PMULL, four blocks per reduction, or a 4-bit
+// table otherwise. A long message is cut into chunks that are encrypted and
+// hashed on separate threads; the chunk hashes are then chained with powers
+// of H.
+
+// Bytes of one chunk of a message split across threads
+#define GCM_CHUNK (1 << 16)
+// Bytes encrypted before they are hashed, so they are still in cache
+#define GCM_STEP 4096
+// Longest GCM plaintext: 2^32 - 2 blocks
+#define GCM_MAX_LEN (((uint64_t) 1 << 36) - 32)
+
+typedef struct {
+  uint64_t hl[16], hh[16];       // multiples of H by 4-bit values
+  unsigned char powers[4][16];   // H, H^2, H^3, H^4
+} ghash_key;
+
+static inline uint64_t load64_be(const unsigned char *p) {
+  uint64_t v = 0;
+  for (int i = 0; i < 8; i++) {
+    v = (v << 8) | p[i];
+  }
+  return v;
+}
+
+static inline void store64_be(unsigned char *p, uint64_t v) {
+  for (int i = 7; i >= 0; i--) {
+    p[i] = (unsigned char) v;
+    v >>= 8;
+  }
+}
+
+
+// Multiplication in GF(2^128) with the bit order of GCM, bit by bit. It is
+// only used for the powers of H.
+static void gf128_mul(const unsigned char x[16], const unsigned char y[16], unsigned char out[16]) {
+  uint64_t zh = 0, zl = 0;
+  uint64_t vh = load64_be(y), vl = load64_be(y + 8);
+  for (int i = 0; i < 128; i++) {
+    uint64_t bit = (uint64_t) 0 - ((x[i / 8] >> (7 - i % 8)) & 1);
+    zh ^= vh & bit;
+    zl ^= vl & bit;
+    uint64_t carry = (uint64_t) 0 - (vl & 1);
+    vl = (vl >> 1) | (vh << 63);
+    vh = (vh >> 1) ^ (carry & 0xe100000000000000ULL);
+  }
+  store64_be(out, zh);
+  store64_be(out + 8, zl);
+}
+
+static void gf128_pow(const unsigned char h[16], uint64_t n, unsigned char out[16]) {
+  unsigned char base[16];
+  memset(out, 0, 16);
+  out[0] = 0x80;   // the unit element
+  memcpy(base, h, 16);
+  while (n > 0) {
+    if (n & 1) {
+      gf128_mul(out, base, out);
+    }
+    gf128_mul(base, base, base);
+    n >>= 1;
+  }
+  secure_wipe(base, sizeof(base));
+}
+
+
+// Portable GHASH: Shoup's method with 4-bit tables
+static const uint64_t last4[16] = {
+  0x0000, 0x1c20, 0x3840, 0x2460, 0x7080, 0x6ca0, 0x48c0, 0x54e0,
+  0xe100, 0xfd20, 0xd940, 0xc560, 0x9180, 0x8da0, 0xa9c0, 0xb5e0
+};
+
+static void ghash_tables(ghash_key *gk, const unsigned char h[16]) {
+  uint64_t vh = load64_be(h), vl = load64_be(h + 8);
+  gk->hl[0] = gk->hh[0] = 0;
+  gk->hl[8] = vl;
+  gk->hh[8] = vh;
+  for (int i = 4; i > 0; i >>= 1) {
+    uint64_t carry = (uint64_t) 0 - (vl & 1);
+    vl = (vh << 63) | (vl >> 1);
+    vh = (vh >> 1) ^ (carry & 0xe100000000000000ULL);
+    gk->hl[i] = vl;
+    gk->hh[i] = vh;
+  }
+  for (int i = 2; i <= 8; i *= 2) {
+    for (int j = 1; j < i; j++) {
+      gk->hh[i + j] = gk->hh[i] ^ gk->hh[j];
+      gk->hl[i + j] = gk->hl[i] ^ gk->hl[j];
+    }
+  }
+}
+
+static void ghash_mul_table(const ghash_key *gk, unsigned char y[16]) {
+  int lo = y[15] & 0xf;
+  uint64_t zh = gk->hh[lo], zl = gk->hl[lo];
+  for (int i = 15; i >= 0; i--) {
+    int hi = y[i] >> 4;
+    lo = y[i] & 0xf;
+    if (i != 15) {
+      int rem = (int) (zl & 0xf);
+      zl = (zh << 60) | (zl >> 4);
+      zh = (zh >> 4) ^ (last4[rem] << 48) ^ gk->hh[lo];
+      zl ^= gk->hl[lo];
+    }
+    int rem = (int) (zl & 0xf);
+    zl = (zh << 60) | (zl >> 4);
+    zh = (zh >> 4) ^ (last4[rem] << 48) ^ gk->hh[hi];
+    zl ^= gk->hl[hi];
+  }
+  store64_be(y, zh);
+  store64_be(y + 8, zl);
+}
+
+static void ghash_generic(const ghash_key *gk, unsigned char y[16], const unsigned char *in, size_t blocks) {
+  for (size_t b = 0; b < blocks; b++) {
+    for (int i = 0; i < 16; i++) {
+      y[i] ^= in[16 * b + i];
+    }
+    ghash_mul_table(gk, y);
+  }
+}
+
+
+#if defined(GHASH_X86)
+static int cpu_has_pclmul() {
+  unsigned int eax, ebx, ecx, edx;
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+    return 0;
+  }
+  return (ecx & bit_PCLMUL) && (ecx & bit_SSSE3);
+}
+
+// Carry-less product of two byte-reversed blocks, unreduced, as in Intel's
+// "Carry-Less Multiplication and Its Usage for Computing the GCM Mode"
+__attribute__((target("pclmul,ssse3,sse2")))
+static inline void clmul_wide(__m128i a, __m128i b, __m128i *lo, __m128i *hi) {
+  __m128i l = _mm_clmulepi64_si128(a, b, 0x00);
+  __m128i m = _mm_xor_si128(_mm_clmulepi64_si128(a, b, 0x10), _mm_clmulepi64_si128(a, b, 0x01));
+  __m128i h = _mm_clmulepi64_si128(a, b, 0x11);
+  *lo = _mm_xor_si128(l, _mm_slli_si128(m, 8));
+  *hi = _mm_xor_si128(h, _mm_srli_si128(m, 8));
+}
+
+// Shift the 256-bit product left by one bit (the operands are bit-reflected)
+// and reduce it modulo x^128 + x^7 + x^2 + x + 1
+__attribute__((target("pclmul,ssse3,sse2")))
+static inline __m128i clmul_reduce(__m128i lo, __m128i hi) {
+  __m128i lo_carry = _mm_srli_epi32(lo, 31);
+  __m128i hi_carry = _mm_srli_epi32(hi, 31);
+  lo = _mm_slli_epi32(lo, 1);
+  hi = _mm_slli_epi32(hi, 1);
+  hi = _mm_or_si128(hi, _mm_srli_si128(lo_carry, 12));
+  hi = _mm_or_si128(hi, _mm_slli_si128(hi_carry, 4));
+  lo = _mm_or_si128(lo, _mm_slli_si128(lo_carry, 4));
+
+  __m128i a = _mm_xor_si128(_mm_xor_si128(_mm_slli_epi32(lo, 31), _mm_slli_epi32(lo, 30)), _mm_slli_epi32(lo, 25));
+  __m128i spill = _mm_srli_si128(a, 4);
+  lo = _mm_xor_si128(lo, _mm_slli_si128(a, 12));
+  __m128i b = _mm_xor_si128(_mm_xor_si128(_mm_srli_epi32(lo, 1), _mm_srli_epi32(lo, 2)), _mm_srli_epi32(lo, 7));
+  b = _mm_xor_si128(b, spill);
+  return _mm_xor_si128(hi, _mm_xor_si128(lo, b));
+}
+
+__attribute__((target("pclmul,ssse3,sse2")))
+static void ghash_pclmul(const ghash_key *gk, unsigned char y[16], const unsigned char *in, size_t blocks) {
+  const __m128i rev = _mm_set_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+  __m128i h1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) gk->powers[0]), rev);
+  __m128i h2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) gk->powers[1]), rev);
+  __m128i h3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) gk->powers[2]), rev);
+  __m128i h4 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) gk->powers[3]), rev);
+  __m128i acc = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) y), rev);
+  __m128i lo, hi, l, h;
+
+  // (acc + X1) H^4 + X2 H^3 + X3 H^2 + X4 H, reduced once
+  for (; blocks >= 4; blocks -= 4, in += 64) {
+    __m128i x1 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) in), rev);
+    __m128i x2 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (in + 16)), rev);
+    __m128i x3 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (in + 32)), rev);
+    __m128i x4 = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (in + 48)), rev);
+    clmul_wide(_mm_xor_si128(acc, x1), h4, &lo, &hi);
+    clmul_wide(x2, h3, &l, &h);
+    lo = _mm_xor_si128(lo, l);
+    hi = _mm_xor_si128(hi, h);
+    clmul_wide(x3, h2, &l, &h);
+    lo = _mm_xor_si128(lo, l);
+    hi = _mm_xor_si128(hi, h);
+    clmul_wide(x4, h1, &l, &h);
+    lo = _mm_xor_si128(lo, l);
+    hi = _mm_xor_si128(hi, h);
+    acc = clmul_reduce(lo, hi);
+  }
+  for (; blocks > 0; blocks--, in += 16) {
+    __m128i x = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) in), rev);
+    clmul_wide(_mm_xor_si128(acc, x), h1, &lo, &hi);
+    acc = clmul_reduce(lo, hi);
+  }
+  _mm_storeu_si128((__m128i *) y, _mm_shuffle_epi8(acc, rev));
+}
+#endif
+
+
+#if defined(GHASH_ARM)
+// The PCLMULQDQ code above with PMULL: byte shifts of a register are
+// vextq_u8 with zero, and blocks are byte-reversed the same way
+static inline uint8x16_t reverse_bytes(uint8x16_t x) {
+  x = vrev64q_u8(x);
+  return vextq_u8(x, x, 8);
+}
+
+static inline uint8x16_t pmull_lanes(uint8x16_t a, int i, uint8x16_t b, int j) {
+  uint64x2_t a64 = vreinterpretq_u64_u8(a), b64 = vreinterpretq_u64_u8(b);
+  poly64_t x = (poly64_t) (i ? vgetq_lane_u64(a64, 1) : vgetq_lane_u64(a64, 0));
+  poly64_t y = (poly64_t) (j ? vgetq_lane_u64(b64, 1) : vgetq_lane_u64(b64, 0));
+  return vreinterpretq_u8_p128(vmull_p64(x, y));
+}
+
+static inline void pmull_wide(uint8x16_t a, uint8x16_t b, uint8x16_t *lo, uint8x16_t *hi) {
+  const uint8x16_t zero = vdupq_n_u8(0);
+  uint8x16_t l = pmull_lanes(a, 0, b, 0);
+  uint8x16_t m = veorq_u8(pmull_lanes(a, 0, b, 1), pmull_lanes(a, 1, b, 0));
+  uint8x16_t h = pmull_lanes(a, 1, b, 1);
+  *lo = veorq_u8(l, vextq_u8(zero, m, 8));
+  *hi = veorq_u8(h, vextq_u8(m, zero, 8));
+}
+
+static inline uint8x16_t pmull_reduce(uint8x16_t lo8, uint8x16_t hi8) {
+  const uint32x4_t zero = vdupq_n_u32(0);
+  uint32x4_t lo = vreinterpretq_u32_u8(lo8), hi = vreinterpretq_u32_u8(hi8);
+  uint32x4_t lo_carry = vshrq_n_u32(lo, 31);
+  uint32x4_t hi_carry = vshrq_n_u32(hi, 31);
+  lo = vshlq_n_u32(lo, 1);
+  hi = vshlq_n_u32(hi, 1);
+  hi = vorrq_u32(hi, vextq_u32(lo_carry, zero, 3));
+  hi = vorrq_u32(hi, vextq_u32(zero, hi_carry, 3));
+  lo = vorrq_u32(lo, vextq_u32(zero, lo_carry, 3));
+
+  uint32x4_t a = veorq_u32(veorq_u32(vshlq_n_u32(lo, 31), vshlq_n_u32(lo, 30)), vshlq_n_u32(lo, 25));
+  uint32x4_t spill = vextq_u32(a, zero, 1);
+  lo = veorq_u32(lo, vextq_u32(zero, a, 1));
+  uint32x4_t b = veorq_u32(veorq_u32(vshrq_n_u32(lo, 1), vshrq_n_u32(lo, 2)), vshrq_n_u32(lo, 7));
+  b = veorq_u32(b, spill);
+  return vreinterpretq_u8_u32(veorq_u32(hi, veorq_u32(lo, b)));
+}
+
+static void ghash_pmull(const ghash_key *gk, unsigned char y[16], const unsigned char *in, size_t blocks) {
+  uint8x16_t h1 = reverse_bytes(vld1q_u8(gk->powers[0]));
+  uint8x16_t h2 = reverse_bytes(vld1q_u8(gk->powers[1]));
+  uint8x16_t h3 = reverse_bytes(vld1q_u8(gk->powers[2]));
+  uint8x16_t h4 = reverse_bytes(vld1q_u8(gk->powers[3]));
+  uint8x16_t acc = reverse_bytes(vld1q_u8(y));
+  uint8x16_t lo, hi, l, h;
+
+  for (; blocks >= 4; blocks -= 4, in += 64) {
+    pmull_wide(veorq_u8(acc, reverse_bytes(vld1q_u8(in))), h4, &lo, &hi);
+    pmull_wide(reverse_bytes(vld1q_u8(in + 16)), h3, &l, &h);
+    lo = veorq_u8(lo, l);
+    hi = veorq_u8(hi, h);
+    pmull_wide(reverse_bytes(vld1q_u8(in + 32)), h2, &l, &h);
+    lo = veorq_u8(lo, l);
+    hi = veorq_u8(hi, h);
+    pmull_wide(reverse_bytes(vld1q_u8(in + 48)), h1, &l, &h);
+    lo = veorq_u8(lo, l);
+    hi = veorq_u8(hi, h);
+    acc = pmull_reduce(lo, hi);
+  }
+  for (; blocks > 0; blocks--, in += 16) {
+    pmull_wide(veorq_u8(acc, reverse_bytes(vld1q_u8(in))), h1, &lo, &hi);
+    acc = pmull_reduce(lo, hi);
+  }
+  vst1q_u8(y, reverse_bytes(acc));
+}
+#endif
+
+
+// Pick the GHASH function once, on first use
+typedef void (*ghash_fn)(const ghash_key *gk, unsigned char y[16], const unsigned char *in, size_t blocks);
+static ghash_fn ghash_blocks = ghash_generic;
+static const char *ghash_backend = "generic";
+static pthread_once_t ghash_once = PTHREAD_ONCE_INIT;
+
+static void ghash_select() {
+#if defined(GHASH_X86)
+  if (cpu_has_pclmul()) {
+    ghash_blocks = ghash_pclmul;
+    ghash_backend = "pclmul";
+  }
+#elif defined(GHASH_ARM)
+  ghash_blocks = ghash_pmull;
+  ghash_backend = "pmull";
+#endif
+}
+
+static const char* ghash_implementation() {
+  pthread_once(&ghash_once, ghash_select);
+  return ghash_backend;
+}
+
+static void ghash_init(ghash_key *gk, const aes_key *key) {
+  pthread_once(&ghash_once, ghash_select);
+  unsigned char zero[16] = {0};
+  aes_encrypt_block(key, zero, gk->powers[0]);
+  for (int i = 1; i < 4; i++) {
+    gf128_mul(gk->powers[i - 1], gk->powers[0], gk->powers[i]);
+  }
+  ghash_tables(gk, gk->powers[0]);
+}
+
+// Absorb len bytes into y; a partial last block is padded with zeros
+static void ghash_update(const ghash_key *gk, unsigned char y[16], const unsigned char *in, size_t len) {
+  ghash_blocks(gk, y, in, len / 16);
+  if (len % 16 != 0) {
+    unsigned char last[16] = {0};
+    memcpy(last, in + len - len % 16, len % 16);
+    ghash_blocks(gk, y, last, 1);
+  }
+}
+
+
+// One message in CTR or GCM mode. Bytes [begin, end) with begin on a block
+// boundary can be processed independently of the others: they take the
+// counter block of their first block and their own GHASH chain.
+typedef struct {
+  const aes_key *key;
+  const ghash_key *hash;    // NULL for CTR
+  const unsigned char *counter;
+  const unsigned char *in;
+  unsigned char *out;
+  size_t len;
+  int encrypt;
+  unsigned char *partials;  // GHASH of each chunk, 16 bytes each
+} crypt_job;
+
+static void crypt_range(const crypt_job *job, size_t begin, size_t end, unsigned char y[16]) {
+  int gcm = job->hash != NULL;
+  unsigned char counter[16];
+  memcpy(counter, job->counter, 16);
+  aes_counter_add(counter, gcm, begin / 16);
+  memset(y, 0, 16);
+  for (size_t offset = begin; offset < end; offset += GCM_STEP) {
+    size_t n = (end - offset < GCM_STEP) ? end - offset : GCM_STEP;
+    if (gcm && !job->encrypt) {
+      ghash_update(job->hash, y, job->in + offset, n);
+    }
+    aes_ctr_xor(job->key, counter, gcm, job->in + offset, job->out + offset, n);
+    if (gcm && job->encrypt) {
+      ghash_update(job->hash, y, job->out + offset, n);
+    }
+  }
+}
+
+static void crypt_chunk_worker(void *data, const secp256k1_context *ctx, R_xlen_t begin, R_xlen_t end) {
+  crypt_job *job = (crypt_job *) data;
+  for (R_xlen_t c = begin; c < end; c++) {
+    size_t from = (size_t) c * GCM_CHUNK;
+    size_t to = (job->len - from < GCM_CHUNK) ? job->len : from + GCM_CHUNK;
+    crypt_range(job, from, to, job->partials + 16 * c);
+  }
+}
+
+// Process the whole message, leaving the GHASH of the ciphertext in y.
+// n_threads > 1 splits it into chunks (parallel_for, so only on the R
+// thread); the chunk hashes are chained as Y = Y * H^m + G for a chunk of m
+// blocks.
+static void crypt_message(crypt_job *job, int n_threads, unsigned char y[16]) {
+  size_t chunks = (job->len + GCM_CHUNK - 1) / GCM_CHUNK;
+  if (n_threads == NA_INTEGER || n_threads <= 1 || chunks < 2) {
+    crypt_range(job, 0, job->len, y);
+    return;
+  }
+  job->partials = (unsigned char *) R_alloc(chunks, 16);
+  parallel_for((R_xlen_t) chunks, n_threads, crypt_chunk_worker, job, 0);
+  if (job->hash == NULL) {
+    return;
+  }
+  unsigned char h_chunk[16], h_last[16];
+  size_t last_len = job->len - (chunks - 1) * GCM_CHUNK;
+  gf128_pow(job->hash->powers[0], GCM_CHUNK / 16, h_chunk);
+  gf128_pow(job->hash->powers[0], (last_len + 15) / 16, h_last);
+  memcpy(y, job->partials, 16);
+  for (size_t c = 1; c < chunks; c++) {
+    gf128_mul(y, c == chunks - 1 ? h_last : h_chunk, y);
+    for (int i = 0; i < 16; i++) {
+      y[i] ^= job->partials[16 * c + i];
+    }
+  }
+}
+
+// Finish a GCM tag from the GHASH of the ciphertext
+static void gcm_tag(const aes_key *key, const ghash_key *gk, const unsigned char j0[16], unsigned char y[16],
+                    size_t len, unsigned char tag[16]) {
+  unsigned char lengths[16] = {0};
+  store64_be(lengths + 8, (uint64_t) len * 8);
+  ghash_update(gk, y, lengths, 16);
+  aes_encrypt_block(key, j0, tag);
+  for (int i = 0; i < 16; i++) {
+    tag[i] ^= y[i];
+  }
+}
+
+static size_t nonce_size(int gcm) {
+  return gcm ? 12 : 16;
+}
+
+static size_t overhead(int gcm) {
+  return gcm ? 12 + 16 : 16;
+}
+
+// Seal len bytes of in with the given nonce into out, which has room for
+// len + overhead() bytes
+static void seal_message(const aes_key *key, const ghash_key *gk, const unsigned char *nonce, const unsigned char *in,
+                         size_t len, unsigned char *out, int n_threads) {
+  int gcm = gk != NULL;
+  unsigned char counter[16], y[16];
+  memcpy(out, nonce, nonce_size(gcm));
+  memcpy(counter, nonce, nonce_size(gcm));
+  if (gcm) {
+    counter[12] = counter[13] = counter[14] = 0;
+    counter[15] = 2;    // J0 + 1
+  }
+  crypt_job job = {key, gk, counter, in, out + nonce_size(gcm), len, 1, NULL};
+  crypt_message(&job, n_threads, y);
+  if (gcm) {
+    counter[15] = 1;
+    gcm_tag(key, gk, counter, y, len, out + nonce_size(gcm) + len);
+  }
+}
+
+// Open a sealed message of len bytes into out, which has room for
+// len - overhead() bytes. Returns the plaintext length, or SIZE_MAX if the
+// message is too short or its tag does not match, in which case out is
+// wiped.
+static size_t open_message(const aes_key *key, const ghash_key *gk, const unsigned char *in, size_t len,
+                           unsigned char *out, int n_threads) {
+  int gcm = gk != NULL;
+  if (len < overhead(gcm)) {
+    return SIZE_MAX;
+  }
+  size_t plain_len = len - overhead(gcm);
+  unsigned char counter[16], y[16], tag[16];
+  memcpy(counter, in, nonce_size(gcm));
+  if (gcm) {
+    counter[12] = counter[13] = counter[14] = 0;
+    counter[15] = 2;
+  }
+  crypt_job job = {key, gk, counter, in + nonce_size(gcm), out, plain_len, 0, NULL};
+  crypt_message(&job, n_threads, y);
+  if (gcm) {
+    counter[15] = 1;
+    gcm_tag(key, gk, counter, y, plain_len, tag);
+    if (!constant_time_equal(tag, in + nonce_size(gcm) + plain_len, 16)) {
+      secure_wipe(out, plain_len);
+      return SIZE_MAX;
+    }
+  }
+  return plain_len;
+}
+
+
+typedef struct {
+  const aes_key *key;
+  const ghash_key *hash;
+  const unsigned char *nonces;   // encryption: one nonce per message
+  const unsigned char **in;
+  const size_t *in_lens;
+  unsigned char **out;
+  size_t *out_lens;   // decryption: plaintext length, or SIZE_MAX for bad input
+} mode_batch;
+
+static void mode_worker(void *data, const secp256k1_context *ctx, R_xlen_t i0, R_xlen_t end) {
+  mode_batch *batch = (mode_batch *) data;
+  int gcm = batch->hash != NULL;
+  for (R_xlen_t i = i0; i < end; i++) {
+    if (batch->in[i] == NULL) {
+      continue;
+    }
+    if (batch->out_lens == NULL) {
+      seal_message(batch->key, batch->hash, batch->nonces + nonce_size(gcm) * i, batch->in[i], batch->in_lens[i],
+                   batch->out[i], 1);
+    } else {
+      batch->out_lens[i] = open_message(batch->key, batch->hash, batch->in[i], batch->in_lens[i], batch->out[i], 1);
+    }
+  }
+}
+
+static void wipe_keys(aes_key *key, ghash_key *gk) {
+  secure_wipe(key, sizeof(aes_key));
+  secure_wipe(gk, sizeof(ghash_key));
+}
+
+// Encrypt or decrypt with AES-GCM (gcm TRUE) or AES-CTR. x is a raw vector,
+// of which the result is a raw vector, or a character vector (encryption
+// only) or list of raw vectors, of which the result is a list in which NA
+// strings, NULL elements and (decryption) short or forged messages give
+// NULL. Encryption takes a fresh random nonce for every message unless iv_r
+// is given, which is only allowed for a single message. Messages are spread
+// across threads; one long message is split across them.
+SEXP aes_mode_R(SEXP key_r, SEXP iv_r, SEXP x, SEXP encrypt_r, SEXP gcm_r, SEXP n_threads_R) {
+  int encrypt = asLogical(encrypt_r);
+  int gcm = asLogical(gcm_r);
+  int n_threads = asInteger(n_threads_R);
+  size_t nonce_len = nonce_size(gcm);
+  if (iv_r != R_NilValue && (TYPEOF(iv_r) != RAWSXP || (size_t) XLENGTH(iv_r) != nonce_len)) {
+    error(gcm ? "The GCM nonce must be a 12-byte raw vector." : "The CTR counter block must be a 16-byte raw vector.");
+  }
+  if (TYPEOF(x) != RAWSXP && TYPEOF(x) != VECSXP && !(encrypt && TYPEOF(x) == STRSXP)) {
+    error(encrypt ? "Input must be a raw vector, a character vector or a list of raw vectors."
+                  : "Input must be a raw vector or a list of raw vectors.");
+  }
+  int single = TYPEOF(x) == RAWSXP;
+  R_xlen_t n = single ? 1 : XLENGTH(x);
+  if (encrypt && iv_r != R_NilValue && n > 1) {
+    error("A fixed nonce can only encrypt a single message; leave it out to draw one per message.");
+  }
+
+  mode_batch batch;
+  batch.in = (const unsigned char **) R_alloc(n + 1, sizeof(unsigned char *));
+  batch.in_lens = (size_t *) R_alloc(n + 1, sizeof(size_t));
+  batch.out = (unsigned char **) R_alloc(n + 1, sizeof(unsigned char *));
+  batch.out_lens = encrypt ? NULL : (size_t *) R_alloc(n + 1, sizeof(size_t));
+  size_t *lens = (size_t *) batch.in_lens;
+  size_t total = 0;
+  for (R_xlen_t i = 0; i < n; i++) {
+    batch.in[i] = NULL;
+    lens[i] = 0;
+    if (single) {
+      batch.in[i] = RAW(x);
+      lens[i] = (size_t) XLENGTH(x);
+    } else if (TYPEOF(x) == STRSXP) {
+      SEXP s = STRING_ELT(x, i);
+      if (s != NA_STRING) {
+        batch.in[i] = (const unsigned char *) CHAR(s);
+        lens[i] = (size_t) LENGTH(s);
+      }
+    } else {
+      SEXP el = VECTOR_ELT(x, i);
+      if (TYPEOF(el) == RAWSXP) {
+        batch.in[i] = RAW(el);
+        lens[i] = (size_t) XLENGTH(el);
+      } else if (el != R_NilValue) {
+        error("Element %lld of the input is not a raw vector.", (long long) i + 1);
+      }
+    }
+    if (gcm && encrypt && (uint64_t) lens[i] > GCM_MAX_LEN) {
+      error("AES-GCM messages are limited to 64 GiB.");
+    }
+    total += lens[i];
+  }
+
+  unsigned char *nonces = NULL;
+  if (encrypt) {
+    nonces = (unsigned char *) R_alloc(n + 1, nonce_len);
+    if (iv_r != R_NilValue) {
+      memcpy(nonces, RAW(iv_r), nonce_len);
+    } else if (!random_fill(nonces, nonce_len * (size_t) n)) {
+      error("Failed to generate random nonces");
+    }
+  }
+
+  aes_key key;
+  ghash_key gk;
+  aes_key_expand_R(key_r, &key);
+  if (gcm) {
+    ghash_init(&gk, &key);
+  }
+  batch.key = &key;
+  batch.hash = gcm ? &gk : NULL;
+  batch.nonces = nonces;
+
+  if (single) {
+    SEXP result;
+    size_t len = lens[0];
+    if (encrypt) {
+      result = PROTECT(allocVector(RAWSXP, (R_xlen_t) (len + overhead(gcm))));
+      seal_message(&key, batch.hash, nonces, RAW(x), len, RAW(result), n_threads);
+    } else {
+      if (len < overhead(gcm)) {
+        wipe_keys(&key, &gk);
+        error("Decryption failed: the message is shorter than its nonce and tag.");
+      }
+      unsigned char *plain = (unsigned char *) R_alloc(len - overhead(gcm) + 1, 1);
+      size_t plain_len = open_message(&key, batch.hash, RAW(x), len, plain, n_threads);
+      if (plain_len == SIZE_MAX) {
+        wipe_keys(&key, &gk);
+        error("Decryption failed: the authentication tag does not match.");
+      }
+      result = PROTECT(allocVector(RAWSXP, (R_xlen_t) plain_len));
+      memcpy(RAW(result), plain, plain_len);
+      secure_wipe(plain, plain_len);
+    }
+    wipe_keys(&key, &gk);
+    UNPROTECT(1);
+    return result;
+  }
+
+  SEXP result = PROTECT(allocVector(VECSXP, n));
+  unsigned char *plain = NULL;
+  if (encrypt) {
+    for (R_xlen_t i = 0; i < n; i++) {
+      if (batch.in[i] != NULL) {
+        SEXP el = allocVector(RAWSXP, (R_xlen_t) (lens[i] + overhead(gcm)));
+        SET_VECTOR_ELT(result, i, el);
+        batch.out[i] = RAW(el);
+      }
+    }
+  } else {
+    plain = (unsigned char *) R_alloc(total + 1, 1);
+    size_t offset = 0;
+    for (R_xlen_t i = 0; i < n; i++) {
+      batch.out[i] = plain + offset;
+      offset += lens[i];
+    }
+  }
+
+  parallel_for(n, n_threads, mode_worker, &batch, 0);
+
+  if (!encrypt) {
+    for (R_xlen_t i = 0; i < n; i++) {
+      if (batch.in[i] != NULL && batch.out_lens[i] != SIZE_MAX) {
+        SEXP el = allocVector(RAWSXP, (R_xlen_t) batch.out_lens[i]);
+        SET_VECTOR_ELT(result, i, el);
+        memcpy(RAW(el), batch.out[i], batch.out_lens[i]);
+      }
+    }
+    secure_wipe(plain, total);
+  }
+  wipe_keys(&key, &gk);
+  UNPROTECT(1);
+  return result;
+}
+
+SEXP ghash_implementation_R() {
+  return mkString(ghash_implementation());
+}
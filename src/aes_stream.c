@@ -0,0 +1,284 @@
+#define _FILE_OFFSET_BITS 64
+#include <R.h>
+#include <Rinternals.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <errno.h>
+#include "flureeCrypto.h"
+
+
+// Streaming AES-CBC with PKCS#7 padding. A stream carries the expanded key,
+// the chaining block and the bytes of an unfinished block across calls, so
+// the output is the same as that of one aes_cbc_R() call on all the input.
+// A decryptor holds back the last full block until the end, as it carries
+// the padding.
+
+// Bytes read per step by the file functions
+#define AES_FILE_CHUNK (1 << 20)
+
+typedef struct {
+  aes_key key;
+  unsigned char iv[16];
+  unsigned char pending[16];
+  size_t pending_len;
+  int encrypt;
+  int finished;
+} aes_stream;
+
+static SEXP aes_stream_tag() {
+  return install("flureeCrypto_aes_stream");
+}
+
+static void aes_stream_finalizer(SEXP ptr) {
+  aes_stream *s = (aes_stream *) R_ExternalPtrAddr(ptr);
+  if (s != NULL) {
+    secure_wipe(s, sizeof(aes_stream));
+    free(s);
+    R_ClearExternalPtr(ptr);
+  }
+}
+
+static aes_stream* aes_stream_from_R(SEXP ptr) {
+  if (TYPEOF(ptr) != EXTPTRSXP || R_ExternalPtrTag(ptr) != aes_stream_tag()) {
+    error("Not an AES stream.");
+  }
+  aes_stream *s = (aes_stream *) R_ExternalPtrAddr(ptr);
+  if (s == NULL) {
+    error("The AES stream is no longer valid.");
+  }
+  return s;
+}
+
+static void stream_start(aes_stream *s, SEXP key_r, SEXP iv_r, int encrypt) {
+  if (TYPEOF(iv_r) != RAWSXP || XLENGTH(iv_r) != 16) {
+    error("Initialization vector must be a 16-byte raw vector.");
+  }
+  aes_key_expand_R(key_r, &s->key);
+  memcpy(s->iv, RAW(iv_r), 16);
+  s->pending_len = 0;
+  s->encrypt = encrypt;
+  s->finished = 0;
+}
+
+// Number of bytes stream_update() writes for len more input bytes
+static size_t stream_output_len(const aes_stream *s, size_t len) {
+  size_t total = s->pending_len + len;
+  if (s->encrypt) {
+    return total - total % 16;
+  }
+  // Keep the last full block back
+  return (total == 0) ? 0 : 16 * ((total - 1) / 16);
+}
+
+// Process len more input bytes into out, which has room for
+// stream_output_len() bytes. Returns the number of bytes written.
+static size_t stream_update(aes_stream *s, const unsigned char *in, size_t len, unsigned char *out, int n_threads) {
+  size_t out_len = stream_output_len(s, len);
+  size_t written = 0;
+  if (out_len == 0) {
+    memcpy(s->pending + s->pending_len, in, len);
+    s->pending_len += len;
+    return 0;
+  }
+
+  // Complete the pending block first
+  if (s->pending_len > 0) {
+    size_t take = 16 - s->pending_len;
+    memcpy(s->pending + s->pending_len, in, take);
+    in += take;
+    len -= take;
+    if (s->encrypt) {
+      aes_cbc_encrypt(&s->key, s->iv, s->pending, out, 1);
+    } else {
+      aes_cbc_decrypt(&s->key, s->iv, s->pending, out, 1);
+    }
+    written = 16;
+    s->pending_len = 0;
+  }
+
+  size_t blocks = (out_len - written) / 16;
+  if (blocks > 0) {
+    if (s->encrypt) {
+      aes_cbc_encrypt(&s->key, s->iv, in, out + written, blocks);
+    } else {
+      aes_cbc_decrypt_parallel(&s->key, s->iv, in, out + written, blocks, n_threads);
+    }
+    in += 16 * blocks;
+    len -= 16 * blocks;
+    written += 16 * blocks;
+  }
+  memcpy(s->pending, in, len);
+  s->pending_len = len;
+  return written;
+}
+
+// Write the last block into out (16 bytes). Returns its length without the
+// padding, or SIZE_MAX if a decryptor's input was not whole blocks or its
+// padding is invalid.
+static size_t stream_final(aes_stream *s, unsigned char out[16]) {
+  s->finished = 1;
+  if (s->encrypt) {
+    memset(s->pending + s->pending_len, (int) (16 - s->pending_len), 16 - s->pending_len);
+    aes_cbc_encrypt(&s->key, s->iv, s->pending, out, 1);
+    return 16;
+  }
+  if (s->pending_len != 16) {
+    return SIZE_MAX;
+  }
+  aes_cbc_decrypt(&s->key, s->iv, s->pending, out, 1);
+  return pkcs7_unpadded_len(out, 16);
+}
+
+
+SEXP aes_stream_new_R(SEXP key_r, SEXP iv_r, SEXP encrypt_r) {
+  aes_stream *s = (aes_stream *) calloc(1, sizeof(aes_stream));
+  if (s == NULL) {
+    error("Failed to allocate an AES stream");
+  }
+  SEXP ptr = PROTECT(R_MakeExternalPtr(s, aes_stream_tag(), R_NilValue));
+  R_RegisterCFinalizerEx(ptr, aes_stream_finalizer, TRUE);
+  stream_start(s, key_r, iv_r, asLogical(encrypt_r));
+  UNPROTECT(1);
+  return ptr;
+}
+
+// Feed a raw vector, or the bytes of every string of a character vector in
+// order, and return the output that is complete so far
+SEXP aes_stream_update_R(SEXP ptr, SEXP x, SEXP n_threads_R) {
+  aes_stream *s = aes_stream_from_R(ptr);
+  if (s->finished) {
+    error("The AES stream has already been finalised.");
+  }
+  int n_threads = asInteger(n_threads_R);
+
+  if (TYPEOF(x) == RAWSXP) {
+    size_t len = (size_t) XLENGTH(x);
+    SEXP result = PROTECT(allocVector(RAWSXP, (R_xlen_t) stream_output_len(s, len)));
+    stream_update(s, RAW(x), len, RAW(result), n_threads);
+    UNPROTECT(1);
+    return result;
+  }
+  if (TYPEOF(x) != STRSXP) {
+    error("Input must be a raw vector or a character vector.");
+  }
+  R_xlen_t n = XLENGTH(x);
+  size_t total = 0;
+  for (R_xlen_t i = 0; i < n; i++) {
+    if (STRING_ELT(x, i) == NA_STRING) {
+      error("Cannot encrypt NA strings.");
+    }
+    total += (size_t) LENGTH(STRING_ELT(x, i));
+  }
+  SEXP result = PROTECT(allocVector(RAWSXP, (R_xlen_t) stream_output_len(s, total)));
+  size_t offset = 0;
+  for (R_xlen_t i = 0; i < n; i++) {
+    SEXP el = STRING_ELT(x, i);
+    offset += stream_update(s, (const unsigned char *) CHAR(el), (size_t) LENGTH(el), RAW(result) + offset,
+                            n_threads);
+  }
+  UNPROTECT(1);
+  return result;
+}
+
+SEXP aes_stream_final_R(SEXP ptr) {
+  aes_stream *s = aes_stream_from_R(ptr);
+  if (s->finished) {
+    error("The AES stream has already been finalised.");
+  }
+  unsigned char last[16];
+  size_t len = stream_final(s, last);
+  secure_wipe(&s->key, sizeof(aes_key));
+  if (len == SIZE_MAX) {
+    secure_wipe(last, sizeof(last));
+    error("Decryption failed: the input is not whole blocks with valid padding.");
+  }
+  SEXP result = PROTECT(allocVector(RAWSXP, (R_xlen_t) len));
+  memcpy(RAW(result), last, len);
+  secure_wipe(last, sizeof(last));
+  UNPROTECT(1);
+  return result;
+}
+
+SEXP aes_stream_direction_R(SEXP ptr) {
+  return mkString(aes_stream_from_R(ptr)->encrypt ? "encryptor" : "decryptor");
+}
+
+
+// Encrypt or decrypt the file at in_path into out_path in chunks, so memory
+// use does not depend on the file size. The output is the raw ciphertext
+// that aes_encrypt() returns with output_format = "none". On failure the
+// partial output file is removed.
+SEXP aes_file_R(SEXP in_path_r, SEXP out_path_r, SEXP key_r, SEXP iv_r, SEXP encrypt_r, SEXP n_threads_R) {
+  if (TYPEOF(in_path_r) != STRSXP || XLENGTH(in_path_r) != 1 || STRING_ELT(in_path_r, 0) == NA_STRING ||
+      TYPEOF(out_path_r) != STRSXP || XLENGTH(out_path_r) != 1 || STRING_ELT(out_path_r, 0) == NA_STRING) {
+    error("Paths must be single strings.");
+  }
+  int n_threads = asInteger(n_threads_R);
+  aes_stream *s = (aes_stream *) R_alloc(1, sizeof(aes_stream));
+  stream_start(s, key_r, iv_r, asLogical(encrypt_r));
+
+  // R_ExpandFileName returns a static buffer, so copy the first path
+  const char *expanded = R_ExpandFileName(translateChar(STRING_ELT(in_path_r, 0)));
+  char *in_path = R_alloc(strlen(expanded) + 1, 1);
+  strcpy(in_path, expanded);
+  const char *out_path = R_ExpandFileName(translateChar(STRING_ELT(out_path_r, 0)));
+
+  FILE *in = fopen(in_path, "rb");
+  if (in == NULL) {
+    secure_wipe(s, sizeof(aes_stream));
+    error("Cannot open file '%s': %s", in_path, strerror(errno));
+  }
+  FILE *out = fopen(out_path, "wb");
+  if (out == NULL) {
+    int err = errno;
+    fclose(in);
+    secure_wipe(s, sizeof(aes_stream));
+    error("Cannot create file '%s': %s", out_path, strerror(err));
+  }
+
+  unsigned char *buffer = (unsigned char *) R_alloc(AES_FILE_CHUNK, 1);
+  unsigned char *result = (unsigned char *) R_alloc(AES_FILE_CHUNK + 16, 1);
+  const char *failure = NULL, *failed_path = out_path;
+  int err = 0;
+  size_t got;
+  while ((got = fread(buffer, 1, AES_FILE_CHUNK, in)) > 0) {
+    size_t len = stream_update(s, buffer, got, result, n_threads);
+    if (fwrite(result, 1, len, out) != len) {
+      failure = "Error writing file";
+      err = errno;
+      break;
+    }
+  }
+  if (failure == NULL && ferror(in)) {
+    failure = "Error reading file";
+    failed_path = in_path;
+    err = EIO;
+  }
+  if (failure == NULL) {
+    size_t len = stream_final(s, result);
+    if (len == SIZE_MAX) {
+      failure = "Decryption failed: the input is not whole blocks with valid padding";
+    } else if (fwrite(result, 1, len, out) != len) {
+      failure = "Error writing file";
+      err = errno;
+    }
+  }
+  fclose(in);
+  if (fclose(out) != 0 && failure == NULL) {
+    failure = "Error writing file";
+    err = errno;
+  }
+  secure_wipe(buffer, AES_FILE_CHUNK);
+  secure_wipe(result, AES_FILE_CHUNK + 16);
+  secure_wipe(s, sizeof(aes_stream));
+
+  if (failure != NULL) {
+    remove(out_path);
+    if (err != 0) {
+      error("%s '%s': %s", failure, failed_path, strerror(err));
+    }
+    error("%s.", failure);
+  }
+  return R_NilValue;
+}
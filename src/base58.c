@@ -0,0 +1,315 @@
+#include <R.h>
+#include <Rinternals.h>
+#include <string.h>
+#include <stdlib.h>
+#include "flureeCrypto.h"
+
+
+static const char base58_alphabet[] = "123456789ABCDEFGHJKLMNPQRSTUVWXYZabcdefghijkmnopqrstuvwxyz";
+
+// Decoding table: the value of a Base58 digit, or 0xff for any other character
+static const unsigned char base58_values[256] = {
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f, 0x10, 0xff, 0x11, 0x12, 0x13, 0x14, 0x15, 0xff,
+  0x16, 0x17, 0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f, 0x20, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28, 0x29, 0x2a, 0x2b, 0xff, 0x2c, 0x2d, 0x2e,
+  0x2f, 0x30, 0x31, 0x32, 0x33, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff
+};
+
+// The conversion works on limbs of five Base58 digits (58^5 < 2^30) against
+// 32-bit words of the input, so a 26-byte account ID takes seven words and
+// at most eight limbs. Dividing by the constant compiles to a multiply and
+// shift. Inputs of up to STACK_LIMBS limbs stay on the stack.
+#define BASE58_LIMB 656356768ULL  // 58^5
+#define STACK_LIMBS 64
+
+
+// Encode len bytes as Base58, one leading '1' per leading zero byte.
+// Returns the number of characters written, or (size_t) -1 if scratch space
+// for a very long input could not be allocated.
+size_t base58_encode(const unsigned char *bytes, size_t len, char *out) {
+  size_t zeros = 0;
+  while (zeros < len && bytes[zeros] == 0) {
+    zeros++;
+  }
+
+  size_t cap = (len - zeros) * 138 / 500 + 2;
+  uint32_t stack_limbs[STACK_LIMBS];
+  uint32_t *limbs = stack_limbs;
+  if (cap > STACK_LIMBS) {
+    limbs = (uint32_t *) malloc(cap * sizeof(uint32_t));
+    if (limbs == NULL) {
+      return (size_t) -1;
+    }
+  }
+
+  // Feed the input one big-endian word at a time, the first one partial
+  size_t n_limbs = 0;
+  size_t i = zeros;
+  size_t take = (len - zeros) % 4;
+  if (take == 0) {
+    take = 4;
+  }
+  while (i < len) {
+    uint64_t carry = 0;
+    for (size_t k = 0; k < take; k++) {
+      carry = (carry << 8) | bytes[i++];
+    }
+    int shift = 8 * (int) take;
+    for (size_t j = 0; j < n_limbs; j++) {
+      uint64_t t = ((uint64_t) limbs[j] << shift) + carry;
+      limbs[j] = (uint32_t) (t % BASE58_LIMB);
+      carry = t / BASE58_LIMB;
+    }
+    while (carry > 0) {
+      limbs[n_limbs++] = (uint32_t) (carry % BASE58_LIMB);
+      carry /= BASE58_LIMB;
+    }
+    take = 4;
+  }
+
+  size_t pos = 0;
+  for (size_t k = 0; k < zeros; k++) {
+    out[pos++] = '1';
+  }
+  if (n_limbs > 0) {
+    // The top limb without leading zeros, then five digits per limb
+    char digits[5];
+    int n_digits = 0;
+    uint32_t top = limbs[n_limbs - 1];
+    while (top > 0) {
+      digits[n_digits++] = base58_alphabet[top % 58];
+      top /= 58;
+    }
+    while (n_digits > 0) {
+      out[pos++] = digits[--n_digits];
+    }
+    for (size_t j = n_limbs - 1; j-- > 0;) {
+      uint32_t limb = limbs[j];
+      for (int k = 4; k >= 0; k--) {
+        out[pos + k] = base58_alphabet[limb % 58];
+        limb /= 58;
+      }
+      pos += 5;
+    }
+  }
+
+  if (limbs != stack_limbs) {
+    free(limbs);
+  }
+  return pos;
+}
+
+// Decode len Base58 characters into out, which needs room for len bytes.
+// Returns the number of bytes, or -1 if a character is not a Base58 digit
+// (or scratch space could not be allocated).
+long base58_decode(const char *chars, size_t len, unsigned char *out) {
+  size_t zeros = 0;
+  while (zeros < len && chars[zeros] == '1') {
+    zeros++;
+  }
+
+  size_t cap = (len - zeros) * 733 / 4000 + 2;
+  uint32_t stack_limbs[STACK_LIMBS];
+  uint32_t *limbs = stack_limbs;
+  if (cap > STACK_LIMBS) {
+    limbs = (uint32_t *) malloc(cap * sizeof(uint32_t));
+    if (limbs == NULL) {
+      return -1;
+    }
+  }
+
+  // Fold in five digits at a time, the first group partial
+  size_t n_limbs = 0;
+  size_t i = zeros;
+  size_t take = (len - zeros) % 5;
+  if (take == 0) {
+    take = 5;
+  }
+  int invalid = 0;
+  while (i < len) {
+    uint64_t carry = 0;
+    uint64_t scale = 1;
+    for (size_t k = 0; k < take; k++) {
+      unsigned char value = base58_values[(unsigned char) chars[i++]];
+      invalid |= (value == 0xff);
+      carry = carry * 58 + (value & 0x3f);
+      scale *= 58;
+    }
+    for (size_t j = 0; j < n_limbs; j++) {
+      uint64_t t = (uint64_t) limbs[j] * scale + carry;
+      limbs[j] = (uint32_t) t;
+      carry = t >> 32;
+    }
+    while (carry > 0) {
+      limbs[n_limbs++] = (uint32_t) carry;
+      carry >>= 32;
+    }
+    take = 5;
+  }
+
+  long pos = 0;
+  if (!invalid) {
+    memset(out, 0, zeros);
+    pos = (long) zeros;
+    int started = 0;
+    for (size_t j = n_limbs; j-- > 0;) {
+      for (int shift = 24; shift >= 0; shift -= 8) {
+        unsigned char byte = (unsigned char) (limbs[j] >> shift);
+        if (started || byte != 0) {
+          out[pos++] = byte;
+          started = 1;
+        }
+      }
+    }
+  }
+
+  if (limbs != stack_limbs) {
+    free(limbs);
+  }
+  return invalid ? -1 : pos;
+}
+
+
+// Base58Check: the payload followed by the first four bytes of its double
+// SHA-256. out needs room for 138 * (len + 4) / 100 + 1 characters.
+size_t base58check_encode(const unsigned char *payload, size_t len, char *out) {
+  unsigned char stack_buf[128];
+  unsigned char *buf = (len + 4 <= sizeof(stack_buf)) ? stack_buf : (unsigned char *) malloc(len + 4);
+  if (buf == NULL) {
+    return (size_t) -1;
+  }
+  unsigned char digest[32];
+  memcpy(buf, payload, len);
+  sha256(payload, len, digest);
+  sha256(digest, 32, digest);
+  memcpy(buf + len, digest, 4);
+  size_t written = base58_encode(buf, len + 4, out);
+  if (buf != stack_buf) {
+    free(buf);
+  }
+  return written;
+}
+
+// Decode Base58Check and verify the checksum. out needs room for len bytes.
+// Returns the payload length, or -1 if the string is not Base58, is too
+// short to hold a checksum or the checksum does not match.
+long base58check_decode(const char *chars, size_t len, unsigned char *out) {
+  long n = base58_decode(chars, len, out);
+  if (n < 4) {
+    return -1;
+  }
+  unsigned char digest[32];
+  sha256(out, (size_t) n - 4, digest);
+  sha256(digest, 32, digest);
+  if (memcmp(digest, out + n - 4, 4) != 0) {
+    return -1;
+  }
+  return n - 4;
+}
+
+
+// Encode every raw vector of a list, or every width bytes of a raw vector
+// (the columns of a raw matrix), as Base58 or Base58Check. NULL list
+// elements give NA.
+SEXP base58_encode_R(SEXP x, SEXP width_r, SEXP check_r) {
+  int check = asLogical(check_r) == TRUE;
+  R_xlen_t n;
+  R_xlen_t width = 0;
+
+  if (TYPEOF(x) == RAWSXP) {
+    int width_int = asInteger(width_r);
+    width = (width_int == NA_INTEGER || width_int <= 0) ? XLENGTH(x) : (R_xlen_t) width_int;
+    if (width == 0) {
+      n = 1;
+    } else {
+      if (XLENGTH(x) % width != 0) {
+        error("Raw vector length is not a multiple of the width.");
+      }
+      n = XLENGTH(x) / width;
+    }
+  } else if (TYPEOF(x) == VECSXP) {
+    n = XLENGTH(x);
+  } else {
+    error("Input must be a raw vector or a list of raw vectors.");
+  }
+
+  SEXP result = PROTECT(allocVector(STRSXP, n));
+  char stack_chars[256];
+  for (R_xlen_t i = 0; i < n; i++) {
+    const unsigned char *bytes;
+    size_t len;
+    if (TYPEOF(x) == RAWSXP) {
+      bytes = RAW(x) + i * width;
+      len = (size_t) width;
+    } else {
+      SEXP el = VECTOR_ELT(x, i);
+      if (el == R_NilValue) {
+        SET_STRING_ELT(result, i, NA_STRING);
+        continue;
+      }
+      if (TYPEOF(el) != RAWSXP) {
+        error("Element %lld is not a raw vector.", (long long) i + 1);
+      }
+      bytes = RAW(el);
+      len = (size_t) XLENGTH(el);
+    }
+    if (len > INT_MAX / 2) {
+      error("Raw vector is too long to encode as a single string");
+    }
+
+    size_t cap = (len + 4) * 138 / 100 + 1;
+    char *chars = (cap <= sizeof(stack_chars)) ? stack_chars : R_alloc(cap, 1);
+    size_t written = check ? base58check_encode(bytes, len, chars) : base58_encode(bytes, len, chars);
+    if (written == (size_t) -1) {
+      error("Failed to allocate memory for Base58 encoding");
+    }
+    SET_STRING_ELT(result, i, mkCharLen(chars, (int) written));
+  }
+
+  UNPROTECT(1);
+  return result;
+}
+
+// Decode every string of a character vector. Returns a list with NULL for
+// NA strings, strings that are not Base58 and, with check, strings whose
+// checksum does not match.
+SEXP base58_decode_R(SEXP x, SEXP check_r) {
+  if (TYPEOF(x) != STRSXP) {
+    error("Input must be a character vector of Base58 strings.");
+  }
+  int check = asLogical(check_r) == TRUE;
+
+  R_xlen_t n = XLENGTH(x);
+  SEXP result = PROTECT(allocVector(VECSXP, n));
+  unsigned char stack_bytes[256];
+  for (R_xlen_t i = 0; i < n; i++) {
+    SEXP s = STRING_ELT(x, i);
+    if (s == NA_STRING) {
+      continue;
+    }
+    size_t len = (size_t) LENGTH(s);
+    unsigned char *bytes = (len <= sizeof(stack_bytes)) ? stack_bytes : (unsigned char *) R_alloc(len, 1);
+    long decoded = check ? base58check_decode(CHAR(s), len, bytes) : base58_decode(CHAR(s), len, bytes);
+    if (decoded < 0) {
+      continue;
+    }
+    SEXP bytes_r = allocVector(RAWSXP, decoded);
+    SET_VECTOR_ELT(result, i, bytes_r);
+    memcpy(RAW(bytes_r), bytes, (size_t) decoded);
+  }
+
+  UNPROTECT(1);
+  return result;
+}
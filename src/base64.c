@@ -0,0 +1,371 @@
+#include <R.h>
+#include <Rinternals.h>
+#include <string.h>
+#include "flureeCrypto.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define BASE64_SSSE3 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define BASE64_NEON 1
+#endif
+
+
+// Base64 (RFC 4648) in the standard and the URL-safe alphabet. Padding is
+// part of the codec: the encoder writes it or not, and the decoder takes
+// either alphabet with or without it, so callers never post-process the
+// strings. The SIMD paths handle whole groups of 12 (SSSE3) or 48 (NEON)
+// bytes and the tables finish the tail.
+
+static const char base64_alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+static const char base64url_alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+// Decoding table for both alphabets: the value of a character, or 0xff
+static const unsigned char base64_values[256] = {
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x3e, 0xff, 0x3e, 0xff, 0x3f,
+  0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x3b, 0x3c, 0x3d, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e,
+  0x0f, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0xff, 0xff, 0xff, 0xff, 0x3f,
+  0xff, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f, 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27, 0x28,
+  0x29, 0x2a, 0x2b, 0x2c, 0x2d, 0x2e, 0x2f, 0x30, 0x31, 0x32, 0x33, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff
+};
+
+
+#ifdef BASE64_SSSE3
+
+// Encode 12 bytes into 16 characters per iteration (W. Muła's method: split
+// into 6-bit indices with multiplies, then map each index range to its
+// character with one shuffle). The 16-byte loads need 4 readable bytes past
+// the group, so the loop stops a group early.
+__attribute__((target("ssse3")))
+static size_t ssse3_base64_encode(const unsigned char *in, size_t len, char *out, int url) {
+  const __m128i spread = _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1);
+  const __m128i offsets = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                        '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                        url ? '-' - 62 : '+' - 62, url ? '_' - 63 : '/' - 63, 'A', 0, 0);
+  size_t i = 0;
+  for (; i + 16 <= len; i += 12) {
+    __m128i v = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (in + i)), spread);
+    __m128i high = _mm_mulhi_epu16(_mm_and_si128(v, _mm_set1_epi32(0x0fc0fc00)), _mm_set1_epi32(0x04000040));
+    __m128i low = _mm_mullo_epi16(_mm_and_si128(v, _mm_set1_epi32(0x003f03f0)), _mm_set1_epi32(0x01000010));
+    __m128i indices = _mm_or_si128(high, low);
+
+    // 0 for 26-51, 1-10 for 52-61, 11 and 12 for 62 and 63, 13 for 0-25
+    __m128i range = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+    range = _mm_or_si128(range, _mm_and_si128(_mm_cmpgt_epi8(_mm_set1_epi8(26), indices), _mm_set1_epi8(13)));
+    __m128i chars = _mm_add_epi8(indices, _mm_shuffle_epi8(offsets, range));
+    _mm_storeu_si128((__m128i *) (out + i / 3 * 4), chars);
+  }
+  return i;
+}
+
+// Decode 16 characters of either alphabet into 12 bytes per iteration.
+// Sets *invalid to a non-zero mask if any character is outside both.
+__attribute__((target("ssse3")))
+static size_t ssse3_base64_decode(const char *in, size_t len, unsigned char *out, int *invalid) {
+  const __m128i pack = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+  size_t i = 0;
+  for (; i + 16 <= len; i += 16) {
+    __m128i c = _mm_loadu_si128((const __m128i *) (in + i));
+    // Bytes from 0x80 compare as negative and fall outside every range
+    __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('A' - 1)), _mm_cmplt_epi8(c, _mm_set1_epi8('Z' + 1)));
+    __m128i lower = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(c, _mm_set1_epi8('z' + 1)));
+    __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(c, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(c, _mm_set1_epi8('9' + 1)));
+    __m128i v62 = _mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8('+')), _mm_cmpeq_epi8(c, _mm_set1_epi8('-')));
+    __m128i v63 = _mm_or_si128(_mm_cmpeq_epi8(c, _mm_set1_epi8('/')), _mm_cmpeq_epi8(c, _mm_set1_epi8('_')));
+    __m128i valid = _mm_or_si128(_mm_or_si128(upper, lower), _mm_or_si128(digit, _mm_or_si128(v62, v63)));
+    *invalid |= 0xffff ^ _mm_movemask_epi8(valid);
+
+    __m128i values = _mm_and_si128(upper, _mm_sub_epi8(c, _mm_set1_epi8('A')));
+    values = _mm_or_si128(values, _mm_and_si128(lower, _mm_sub_epi8(c, _mm_set1_epi8('a' - 26))));
+    values = _mm_or_si128(values, _mm_and_si128(digit, _mm_add_epi8(c, _mm_set1_epi8(52 - '0'))));
+    values = _mm_or_si128(values, _mm_and_si128(v62, _mm_set1_epi8(62)));
+    values = _mm_or_si128(values, _mm_and_si128(v63, _mm_set1_epi8(63)));
+
+    // Four 6-bit values to 24 bits per 32-bit lane, then bytes in order
+    __m128i merged = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+    merged = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+    merged = _mm_shuffle_epi8(merged, pack);
+    _mm_storel_epi64((__m128i *) (out + i / 4 * 3), merged);
+    uint32_t last = (uint32_t) _mm_cvtsi128_si32(_mm_srli_si128(merged, 8));
+    memcpy(out + i / 4 * 3 + 8, &last, 4);
+  }
+  return i;
+}
+
+#endif
+
+#ifdef BASE64_NEON
+
+// Encode 48 bytes into 64 characters per iteration with a 64-entry lookup
+static size_t neon_base64_encode(const unsigned char *in, size_t len, char *out, int url) {
+  const char *alphabet = url ? base64url_alphabet : base64_alphabet;
+  uint8x16x4_t table;
+  table.val[0] = vld1q_u8((const uint8_t *) alphabet);
+  table.val[1] = vld1q_u8((const uint8_t *) alphabet + 16);
+  table.val[2] = vld1q_u8((const uint8_t *) alphabet + 32);
+  table.val[3] = vld1q_u8((const uint8_t *) alphabet + 48);
+  const uint8x16_t mask = vdupq_n_u8(0x3f);
+  size_t i = 0;
+  for (; i + 48 <= len; i += 48) {
+    uint8x16x3_t b = vld3q_u8(in + i);
+    uint8x16x4_t c;
+    c.val[0] = vshrq_n_u8(b.val[0], 2);
+    c.val[1] = vandq_u8(vorrq_u8(vshlq_n_u8(b.val[0], 4), vshrq_n_u8(b.val[1], 4)), mask);
+    c.val[2] = vandq_u8(vorrq_u8(vshlq_n_u8(b.val[1], 2), vshrq_n_u8(b.val[2], 6)), mask);
+    c.val[3] = vandq_u8(b.val[2], mask);
+    c.val[0] = vqtbl4q_u8(table, c.val[0]);
+    c.val[1] = vqtbl4q_u8(table, c.val[1]);
+    c.val[2] = vqtbl4q_u8(table, c.val[2]);
+    c.val[3] = vqtbl4q_u8(table, c.val[3]);
+    vst4q_u8((uint8_t *) (out + i / 3 * 4), c);
+  }
+  return i;
+}
+
+// The values of 16 characters of either alphabet, collecting invalid ones
+static inline uint8x16_t neon_base64_values(uint8x16_t c, uint8x16_t *valid) {
+  uint8x16_t upper = vandq_u8(vcgeq_u8(c, vdupq_n_u8('A')), vcleq_u8(c, vdupq_n_u8('Z')));
+  uint8x16_t lower = vandq_u8(vcgeq_u8(c, vdupq_n_u8('a')), vcleq_u8(c, vdupq_n_u8('z')));
+  uint8x16_t digit = vandq_u8(vcgeq_u8(c, vdupq_n_u8('0')), vcleq_u8(c, vdupq_n_u8('9')));
+  uint8x16_t v62 = vorrq_u8(vceqq_u8(c, vdupq_n_u8('+')), vceqq_u8(c, vdupq_n_u8('-')));
+  uint8x16_t v63 = vorrq_u8(vceqq_u8(c, vdupq_n_u8('/')), vceqq_u8(c, vdupq_n_u8('_')));
+  *valid = vandq_u8(*valid, vorrq_u8(vorrq_u8(upper, lower), vorrq_u8(digit, vorrq_u8(v62, v63))));
+
+  uint8x16_t values = vandq_u8(upper, vsubq_u8(c, vdupq_n_u8('A')));
+  values = vorrq_u8(values, vandq_u8(lower, vsubq_u8(c, vdupq_n_u8('a' - 26))));
+  values = vorrq_u8(values, vandq_u8(digit, vaddq_u8(c, vdupq_n_u8(52 - '0'))));
+  values = vorrq_u8(values, vandq_u8(v62, vdupq_n_u8(62)));
+  return vorrq_u8(values, vandq_u8(v63, vdupq_n_u8(63)));
+}
+
+// Decode 64 characters into 48 bytes per iteration
+static size_t neon_base64_decode(const char *in, size_t len, unsigned char *out, int *invalid) {
+  uint8x16_t valid = vdupq_n_u8(0xff);
+  size_t i = 0;
+  for (; i + 64 <= len; i += 64) {
+    uint8x16x4_t c = vld4q_u8((const uint8_t *) (in + i));
+    uint8x16_t a = neon_base64_values(c.val[0], &valid);
+    uint8x16_t b = neon_base64_values(c.val[1], &valid);
+    uint8x16_t d = neon_base64_values(c.val[2], &valid);
+    uint8x16_t e = neon_base64_values(c.val[3], &valid);
+    uint8x16x3_t bytes;
+    bytes.val[0] = vorrq_u8(vshlq_n_u8(a, 2), vshrq_n_u8(b, 4));
+    bytes.val[1] = vorrq_u8(vshlq_n_u8(b, 4), vshrq_n_u8(d, 2));
+    bytes.val[2] = vorrq_u8(vshlq_n_u8(d, 6), e);
+    vst3q_u8(out + i / 4 * 3, bytes);
+  }
+  if (vminvq_u8(valid) != 0xff) {
+    *invalid = 1;
+  }
+  return i;
+}
+
+#endif
+
+
+// Number of characters base64_encode() writes for len bytes
+size_t base64_encoded_len(size_t len, int pad) {
+  return pad ? (len + 2) / 3 * 4 : (len * 4 + 2) / 3;
+}
+
+// Encode len bytes into out, in the URL-safe alphabet if url is set and
+// with '=' padding if pad is set. Returns the number of characters written
+// (not null-terminated).
+size_t base64_encode(const unsigned char *in, size_t len, char *out, int url, int pad) {
+  const char *alphabet = url ? base64url_alphabet : base64_alphabet;
+  size_t i = 0;
+#if defined(BASE64_SSSE3)
+  if (__builtin_cpu_supports("ssse3")) {
+    i = ssse3_base64_encode(in, len, out, url);
+  }
+#elif defined(BASE64_NEON)
+  i = neon_base64_encode(in, len, out, url);
+#endif
+  size_t o = i / 3 * 4;
+  for (; i + 3 <= len; i += 3) {
+    uint32_t v = ((uint32_t) in[i] << 16) | ((uint32_t) in[i + 1] << 8) | in[i + 2];
+    out[o++] = alphabet[v >> 18];
+    out[o++] = alphabet[(v >> 12) & 63];
+    out[o++] = alphabet[(v >> 6) & 63];
+    out[o++] = alphabet[v & 63];
+  }
+  if (len - i == 1) {
+    out[o++] = alphabet[in[i] >> 2];
+    out[o++] = alphabet[(in[i] & 3) << 4];
+    if (pad) {
+      out[o++] = '=';
+      out[o++] = '=';
+    }
+  } else if (len - i == 2) {
+    uint32_t v = ((uint32_t) in[i] << 8) | in[i + 1];
+    out[o++] = alphabet[v >> 10];
+    out[o++] = alphabet[(v >> 4) & 63];
+    out[o++] = alphabet[(v & 15) << 2];
+    if (pad) {
+      out[o++] = '=';
+    }
+  }
+  return o;
+}
+
+// Decode len characters of either alphabet, with or without padding, into
+// out, which needs room for 3 * len / 4 bytes. Returns the number of bytes,
+// or -1 if a character is outside both alphabets or the length or padding
+// is impossible.
+long base64_decode(const char *in, size_t len, unsigned char *out) {
+  size_t padding = 0;
+  while (padding < 2 && len > padding && in[len - 1 - padding] == '=') {
+    padding++;
+  }
+  if (padding > 0 && len % 4 != 0) {
+    return -1;
+  }
+  len -= padding;
+  if (len % 4 == 1) {
+    return -1;
+  }
+
+  size_t i = 0;
+  int invalid = 0;
+#if defined(BASE64_SSSE3)
+  if (__builtin_cpu_supports("ssse3")) {
+    i = ssse3_base64_decode(in, len, out, &invalid);
+  }
+#elif defined(BASE64_NEON)
+  i = neon_base64_decode(in, len, out, &invalid);
+#endif
+  size_t o = i / 4 * 3;
+  unsigned char checked = 0;
+  for (; i + 4 <= len; i += 4) {
+    unsigned char a = base64_values[(unsigned char) in[i]], b = base64_values[(unsigned char) in[i + 1]];
+    unsigned char c = base64_values[(unsigned char) in[i + 2]], d = base64_values[(unsigned char) in[i + 3]];
+    checked |= a | b | c | d;
+    uint32_t v = ((uint32_t) (a & 63) << 18) | ((uint32_t) (b & 63) << 12) | ((uint32_t) (c & 63) << 6) | (d & 63);
+    out[o++] = (unsigned char) (v >> 16);
+    out[o++] = (unsigned char) (v >> 8);
+    out[o++] = (unsigned char) v;
+  }
+  if (len - i >= 2) {
+    unsigned char a = base64_values[(unsigned char) in[i]], b = base64_values[(unsigned char) in[i + 1]];
+    checked |= a | b;
+    out[o++] = (unsigned char) (((a & 63) << 2) | ((b & 63) >> 4));
+    if (len - i == 3) {
+      unsigned char c = base64_values[(unsigned char) in[i + 2]];
+      checked |= c;
+      out[o++] = (unsigned char) (((b & 63) << 4) | ((c & 63) >> 2));
+    }
+  }
+  return (invalid || (checked & 0xc0)) ? -1 : (long) o;
+}
+
+
+// Encode every raw vector of a list, every width bytes of a raw vector (the
+// columns of a raw matrix) or the bytes of every string of a character
+// vector. NULL list elements and NA strings give NA.
+SEXP base64_encode_R(SEXP x, SEXP width_r, SEXP url_r, SEXP pad_r) {
+  int url = asLogical(url_r) == TRUE;
+  int pad = asLogical(pad_r) == TRUE;
+  R_xlen_t n;
+  R_xlen_t width = 0;
+
+  if (TYPEOF(x) == RAWSXP) {
+    int width_int = asInteger(width_r);
+    width = (width_int == NA_INTEGER || width_int <= 0) ? XLENGTH(x) : (R_xlen_t) width_int;
+    if (width == 0) {
+      n = 1;
+    } else {
+      if (XLENGTH(x) % width != 0) {
+        error("Raw vector length is not a multiple of the width.");
+      }
+      n = XLENGTH(x) / width;
+    }
+  } else if (TYPEOF(x) == VECSXP || TYPEOF(x) == STRSXP) {
+    n = XLENGTH(x);
+  } else {
+    error("Input must be a raw vector, a list of raw vectors or a character vector.");
+  }
+
+  SEXP result = PROTECT(allocVector(STRSXP, n));
+  char stack_chars[256];
+  for (R_xlen_t i = 0; i < n; i++) {
+    const unsigned char *bytes;
+    size_t len;
+    if (TYPEOF(x) == RAWSXP) {
+      bytes = RAW(x) + i * width;
+      len = (size_t) width;
+    } else if (TYPEOF(x) == STRSXP) {
+      SEXP s = STRING_ELT(x, i);
+      if (s == NA_STRING) {
+        SET_STRING_ELT(result, i, NA_STRING);
+        continue;
+      }
+      bytes = (const unsigned char *) CHAR(s);
+      len = (size_t) LENGTH(s);
+    } else {
+      SEXP el = VECTOR_ELT(x, i);
+      if (el == R_NilValue) {
+        SET_STRING_ELT(result, i, NA_STRING);
+        continue;
+      }
+      if (TYPEOF(el) != RAWSXP) {
+        error("Element %lld is not a raw vector.", (long long) i + 1);
+      }
+      bytes = RAW(el);
+      len = (size_t) XLENGTH(el);
+    }
+    if (len > (size_t) INT_MAX / 4 * 3 - 3) {
+      error("Input is too long to encode as a single string");
+    }
+
+    size_t cap = base64_encoded_len(len, pad);
+    char *chars = (cap <= sizeof(stack_chars)) ? stack_chars : R_alloc(cap, 1);
+    size_t written = base64_encode(bytes, len, chars, url, pad);
+    SET_STRING_ELT(result, i, mkCharLen(chars, (int) written));
+  }
+
+  UNPROTECT(1);
+  return result;
+}
+
+// Decode every string of a character vector straight into its raw vector.
+// Returns a list with NULL for NA strings and strings that are not base64.
+SEXP base64_decode_R(SEXP x) {
+  if (TYPEOF(x) != STRSXP) {
+    error("Input must be a character vector of base64 strings.");
+  }
+
+  R_xlen_t n = XLENGTH(x);
+  SEXP result = PROTECT(allocVector(VECSXP, n));
+  unsigned char stack_bytes[192];
+  for (R_xlen_t i = 0; i < n; i++) {
+    SEXP s = STRING_ELT(x, i);
+    if (s == NA_STRING) {
+      continue;
+    }
+    size_t len = (size_t) LENGTH(s);
+    size_t cap = len / 4 * 3 + 2;
+    unsigned char *bytes = (cap <= sizeof(stack_bytes)) ? stack_bytes : (unsigned char *) R_alloc(cap, 1);
+    long decoded = base64_decode(CHAR(s), len, bytes);
+    if (decoded < 0) {
+      continue;
+    }
+    SEXP bytes_r = allocVector(RAWSXP, decoded);
+    SET_VECTOR_ELT(result, i, bytes_r);
+    memcpy(RAW(bytes_r), bytes, (size_t) decoded);
+  }
+
+  UNPROTECT(1);
+  return result;
+}
@@ -0,0 +1,122 @@
+#include <R.h>
+#include <Rinternals.h>
+#include <string.h>
+#include <secp256k1_ecdh.h>
+#include "flureeCrypto.h"
+
+
+// ECDH shared secrets of one private key with many peer public keys. Each
+// secret is the SHA-256 of the compressed shared point, the default of
+// secp256k1_ecdh(), so it can be used as an AES-256 key as it is. The
+// secrets are computed into one buffer on worker threads and wiped once the
+// result has been built; as AES key handles they never reach R.
+
+#define ECDH_RAW 0
+#define ECDH_HEX 1
+#define ECDH_AES_KEY 2
+
+typedef struct {
+  const unsigned char *seckey;
+  const unsigned char **keys;       // n keys, or NULL when one key is shared
+  const size_t *key_lens;
+  const secp256k1_pubkey *shared_key;
+  unsigned char *secrets;           // n concatenated 32-byte outputs
+  int *status;                      // in: 0 if the key decoded; out: 0 on success
+} ecdh_batch;
+
+static void ecdh_worker(void *data, const secp256k1_context *ctx, R_xlen_t begin, R_xlen_t end) {
+  ecdh_batch *batch = (ecdh_batch *) data;
+  for (R_xlen_t i = begin; i < end; i++) {
+    if (batch->status[i] != 0) {
+      continue;
+    }
+    secp256k1_pubkey parsed;
+    const secp256k1_pubkey *pubkey = batch->shared_key;
+    if (pubkey == NULL) {
+      if (!secp256k1_ec_pubkey_parse(ctx, &parsed, batch->keys[i], batch->key_lens[i])) {
+        batch->status[i] = 1;
+        continue;
+      }
+      pubkey = &parsed;
+    }
+    batch->status[i] = !secp256k1_ecdh(ctx, batch->secrets + i * 32, pubkey, batch->seckey, NULL, NULL);
+  }
+}
+
+// The shared secrets of a private key (a handle, 32 raw bytes or hex) with
+// public keys given as a single key handle or as public key inputs, as a
+// list of raw vectors or of AES key handles (NULL for invalid peer keys) or
+// as hex strings (NA), by output format
+SEXP ecdh_R(SEXP priv_key_r, SEXP pubkeys_R, SEXP format_r, SEXP n_threads_R) {
+  int format = asInteger(format_r);
+  if (format != ECDH_RAW && format != ECDH_HEX && format != ECDH_AES_KEY) {
+    error("Unsupported output format.");
+  }
+  int n_threads = asInteger(n_threads_R);
+
+  const public_key_handle *handle = public_key_handle_from_R(pubkeys_R);
+  R_xlen_t n = handle ? 1 : public_key_count(pubkeys_R);
+  const unsigned char **keys = (const unsigned char **) R_alloc(n + 1, sizeof(unsigned char *));
+  size_t *key_lens = (size_t *) R_alloc(n + 1, sizeof(size_t));
+  int *status = (int *) R_alloc(n + 1, sizeof(int));
+  unsigned char *secrets = (unsigned char *) R_alloc(n * 32 + 1, 1);
+
+  ecdh_batch batch;
+  batch.keys = NULL;
+  batch.key_lens = NULL;
+  batch.shared_key = NULL;
+  if (handle != NULL) {
+    status[0] = 0;
+    batch.shared_key = &handle->pubkey;
+  } else {
+    decode_public_keys(pubkeys_R, n, keys, key_lens, status);
+    batch.keys = keys;
+    batch.key_lens = key_lens;
+  }
+
+  // Copied, so the key stays put while the workers read it
+  unsigned char decoded[32], seckey[32];
+  const unsigned char *priv_key = private_key_bytes_R(priv_key_r, decoded);
+  if (priv_key == NULL) {
+    secure_wipe(decoded, sizeof(decoded));
+    error("Private key must be a key handle, a 32-byte raw vector or a 64-character hexadecimal string.");
+  }
+  memcpy(seckey, priv_key, 32);
+  secure_wipe(decoded, sizeof(decoded));
+  if (!secp256k1_ec_seckey_verify(get_context(), seckey)) {
+    secure_wipe(seckey, sizeof(seckey));
+    error("Invalid private key");
+  }
+
+  batch.seckey = seckey;
+  batch.secrets = secrets;
+  batch.status = status;
+  parallel_for(n, n_threads, ecdh_worker, &batch, 1);
+  secure_wipe(seckey, sizeof(seckey));
+
+  SEXP result = PROTECT(allocVector(format == ECDH_HEX ? STRSXP : VECSXP, n));
+  char hex[65];
+  for (R_xlen_t i = 0; i < n; i++) {
+    const unsigned char *secret = secrets + i * 32;
+    if (format == ECDH_HEX) {
+      if (status[i] != 0) {
+        SET_STRING_ELT(result, i, NA_STRING);
+      } else {
+        hex_encode(secret, 32, hex);
+        SET_STRING_ELT(result, i, mkCharLen(hex, 64));
+      }
+    } else if (status[i] == 0) {
+      if (format == ECDH_AES_KEY) {
+        SET_VECTOR_ELT(result, i, aes_key_handle(secret, 32));
+      } else {
+        SEXP secret_r = allocVector(RAWSXP, 32);
+        SET_VECTOR_ELT(result, i, secret_r);
+        memcpy(RAW(secret_r), secret, 32);
+      }
+    }
+  }
+  secure_wipe(hex, sizeof(hex));
+  secure_wipe(secrets, (size_t) n * 32);
+  UNPROTECT(1);
+  return result;
+}
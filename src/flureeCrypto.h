@@ -0,0 +1,222 @@
+// Declarations shared between the C files of the package
+#ifndef FLUREECRYPTO_H
+#define FLUREECRYPTO_H
+
+#include <R.h>
+#include <Rinternals.h>
+#include <stdint.h>
+#include "secp256k1.h"
+#include <secp256k1_extrakeys.h>
+
+// A recovery byte followed by a DER signature of at most 72 bytes
+#define MAX_SIGNATURE_LEN 73
+
+// r || s followed by the recovery byte
+#define COMPACT_SIGNATURE_LEN 65
+
+// Longest public key accepted, an uncompressed point
+#define MAX_PUBKEY_LEN 65
+
+// Upper bound on the number of worker threads of a parallel call
+#define MAX_THREADS 64
+
+// Shared secp256k1 contexts (secp256k1.c)
+secp256k1_context* get_context();
+secp256k1_context* get_worker_context(int slot);
+
+// Sign a 32-byte hash into a recovery byte + DER signature, or the compact
+// r || s || v form, of *out_len bytes (secp256k1.c). Returns 0 on success.
+// Safe on worker threads.
+int sign_recoverable(const secp256k1_context *ctx, const unsigned char *msg_hash, const unsigned char *priv_key,
+                     int compact, unsigned char *out, size_t *out_len);
+int sign_recoverable_der(const secp256k1_context *ctx, const unsigned char *msg_hash,
+                         const unsigned char *priv_key, unsigned char *out, size_t *out_len);
+
+// Signature recovery (secp256k1.c) from DER or compact signatures.
+// recover_public_key returns 0 on success. Signature inputs are hex
+// strings, raw vectors (used in place), lists of them or raw matrices.
+int recover_public_key(const secp256k1_context *ctx, const unsigned char *signature, size_t signature_len,
+                       const unsigned char *hash, unsigned char *pubkey_output);
+R_xlen_t signature_count(SEXP signatures_R);
+const unsigned char** decode_signatures(SEXP signatures_R, R_xlen_t n, size_t *signature_lens, int *status);
+
+// The same with the opt-in LRU cache of recovered keys in front of it
+// (recovery_cache.c). Safe on worker threads.
+int recover_public_key_cached(const secp256k1_context *ctx, const unsigned char *signature, size_t signature_len,
+                              const unsigned char *hash, unsigned char *pubkey_output);
+
+// Direct verification against a known key (secp256k1.c), 1 if valid
+int verify_signature_direct(const secp256k1_context *ctx, const unsigned char *signature, size_t signature_len,
+                            const unsigned char *hash, const secp256k1_pubkey *pubkey);
+
+// Public key inputs (secp256k1.c): hex strings, concatenated 33-byte raw
+// keys or a list of raw vectors and key handles
+R_xlen_t public_key_count(SEXP pubkeys_R);
+void decode_public_keys(SEXP pubkeys_R, R_xlen_t n, const unsigned char **pubkeys, size_t *pubkey_lens, int *status);
+
+// Key handles (key_handle.c): parsed keys owned by R external pointers.
+// The lookups return NULL when x is not a handle of the right kind; a
+// private key handle also serves as a public key handle.
+typedef struct {
+  secp256k1_pubkey pubkey;
+  unsigned char compressed[33];
+} public_key_handle;
+typedef struct {
+  unsigned char seckey[32];
+  secp256k1_keypair keypair;
+  public_key_handle pub;
+} private_key_handle;
+const private_key_handle* private_key_handle_from_R(SEXP x);
+const public_key_handle* public_key_handle_from_R(SEXP x);
+// The bytes of a private key given as a handle, 32 raw bytes or hex, or NULL
+const unsigned char* private_key_bytes_R(SEXP priv_key_r, unsigned char decoded[32]);
+
+// Hex codec (hex.c)
+int hex_decode(const char *hex, size_t hex_len, unsigned char *out);
+void hex_encode(const unsigned char *bytes, size_t bytes_len, char *out);
+int hex_to_bytes(const char *hex, unsigned char *bytes, size_t bytes_len);
+void bytes_to_hex(const unsigned char *bytes, size_t bytes_len, char *hex);
+
+// Entropy pool (random.c). Safe to call from worker threads.
+int random_fill(unsigned char *out, size_t len);
+void secure_wipe(void *ptr, size_t len);
+int constant_time_equal(const unsigned char *a, const unsigned char *b, size_t len);
+
+// SHA-256 (sha256.c). The compression function is picked at runtime from
+// SHA-NI, the ARMv8 SHA2 extension or portable C. Safe on worker threads.
+typedef struct {
+  uint32_t state[8];
+  uint64_t bytes;
+  unsigned char buffer[64];
+  size_t buffer_len;
+} sha256_ctx;
+void sha256_init(sha256_ctx *ctx);
+void sha256_update(sha256_ctx *ctx, const unsigned char *data, size_t len);
+void sha256_final(sha256_ctx *ctx, unsigned char out[32]);
+void sha256(const unsigned char *data, size_t len, unsigned char out[32]);
+void sha256_many(const unsigned char *const *data, const size_t *lens, size_t n, unsigned char *out);
+const char* sha256_implementation();
+
+// HMAC-SHA256 and PBKDF2-HMAC-SHA256 (hmac.c). Safe on worker threads.
+typedef struct {
+  sha256_ctx inner;
+  sha256_ctx outer;
+} hmac_sha256_ctx;
+void hmac_sha256_init(hmac_sha256_ctx *ctx, const unsigned char *key, size_t key_len);
+void hmac_sha256_update(hmac_sha256_ctx *ctx, const unsigned char *data, size_t len);
+void hmac_sha256_final(hmac_sha256_ctx *ctx, unsigned char out[32]);
+void hmac_sha256(const unsigned char *key, size_t key_len, const unsigned char *data, size_t len,
+                 unsigned char out[32]);
+void pbkdf2_sha256(const unsigned char *password, size_t password_len, const unsigned char *salt, size_t salt_len,
+                   uint64_t iterations, unsigned char *out, size_t out_len);
+
+// SHA-512 (sha512.c)
+typedef struct {
+  uint64_t state[8];
+  uint64_t bytes;
+  unsigned char buffer[128];
+  size_t buffer_len;
+} sha512_ctx;
+void sha512_init(sha512_ctx *ctx);
+void sha512_update(sha512_ctx *ctx, const unsigned char *data, size_t len);
+void sha512_final(sha512_ctx *ctx, unsigned char out[64]);
+void sha512(const unsigned char *data, size_t len, unsigned char out[64]);
+
+// SHA-3 and Keccak (sha3.c). out_len is the digest size in bytes. Batches of
+// SHA3 digests use a four-way AVX2 Keccak where the CPU has it. Safe on
+// worker threads.
+typedef struct {
+  uint64_t state[25];
+  size_t rate;
+  size_t pos;
+  size_t out_len;
+  unsigned char pad;
+} sha3_ctx;
+void sha3_init(sha3_ctx *ctx, size_t out_len);
+void keccak_init(sha3_ctx *ctx, size_t out_len);
+void sha3_update(sha3_ctx *ctx, const unsigned char *data, size_t len);
+void sha3_final(sha3_ctx *ctx, unsigned char *out);
+void sha3(const unsigned char *data, size_t len, size_t out_len, unsigned char *out);
+void sha3_many(const unsigned char *const *data, const size_t *lens, size_t n, size_t out_len, unsigned char *out);
+const char* sha3_implementation();
+
+// RIPEMD-160 (ripemd160.c)
+typedef struct {
+  uint32_t state[5];
+  uint64_t bytes;
+  unsigned char buffer[64];
+  size_t buffer_len;
+} ripemd160_ctx;
+void ripemd160_init(ripemd160_ctx *ctx);
+void ripemd160_update(ripemd160_ctx *ctx, const unsigned char *data, size_t len);
+void ripemd160_final(ripemd160_ctx *ctx, unsigned char out[20]);
+void ripemd160(const unsigned char *data, size_t len, unsigned char out[20]);
+
+// AES (aes.c). A key holds the expanded schedules of both directions; the
+// block functions pick AES-NI or ARMv8 AES when the CPU has them. The CBC
+// functions leave the last ciphertext block in iv so calls can be chained,
+// and are safe on worker threads.
+typedef struct {
+  unsigned char enc[240];   // round keys in FIPS-197 byte order
+  unsigned char dec[240];   // round keys of the equivalent inverse cipher
+  int rounds;
+} aes_key;
+void aes_expand_key(aes_key *key, const unsigned char *bytes, size_t len);
+void aes_cbc_encrypt(const aes_key *key, unsigned char iv[16], const unsigned char *in, unsigned char *out,
+                     size_t blocks);
+void aes_cbc_decrypt(const aes_key *key, unsigned char iv[16], const unsigned char *in, unsigned char *out,
+                     size_t blocks);
+void aes_encrypt_block(const aes_key *key, const unsigned char in[16], unsigned char out[16]);
+// XOR len bytes with the keystream of counter, which is left on the next
+// unused block. The counter steps in its last 32 bits (GCM, inc32) or as a
+// whole 128-bit big-endian number (CTR); aes_counter_add() skips n blocks.
+void aes_ctr_xor(const aes_key *key, unsigned char counter[16], int inc32, const unsigned char *in,
+                 unsigned char *out, size_t len);
+void aes_counter_add(unsigned char counter[16], int inc32, uint64_t n);
+// As aes_cbc_decrypt, split across up to n_threads threads for long inputs
+// (parallel_for, so only on the R thread). in and out must not overlap.
+void aes_cbc_decrypt_parallel(const aes_key *key, unsigned char iv[16], const unsigned char *in, unsigned char *out,
+                              size_t blocks, int n_threads);
+// Length of a decrypted message without its PKCS#7 padding, or SIZE_MAX if
+// the padding is invalid. len is a positive multiple of 16.
+size_t pkcs7_unpadded_len(const unsigned char *plain, size_t len);
+const char* aes_implementation();
+// The key behind an AES key handle, or NULL if x is not one
+const aes_key* aes_key_from_R(SEXP x);
+// Expand a key given as a handle, a 16-, 24- or 32-byte raw vector or a
+// string (the first 32 bytes of its SHA3-512, as hash_string_key() does)
+void aes_key_expand_R(SEXP key_r, aes_key *key);
+// A new AES key handle (class and all) expanded from 16, 24 or 32 bytes
+SEXP aes_key_handle(const unsigned char *bytes, size_t len);
+
+// Base58 and Base58Check (base58.c). The encoders return the number of
+// characters written to out (not null-terminated), which needs room for
+// 138 * len / 100 + 1 characters plus the checksum for Base58Check. The
+// decoders write at most len bytes and return -1 for invalid input or a bad
+// checksum. Safe on worker threads.
+size_t base58_encode(const unsigned char *bytes, size_t len, char *out);
+long base58_decode(const char *chars, size_t len, unsigned char *out);
+size_t base58check_encode(const unsigned char *payload, size_t len, char *out);
+long base58check_decode(const char *chars, size_t len, unsigned char *out);
+
+// Base64 and base64url (base64.c). The encoder writes
+// base64_encoded_len() characters (not null-terminated); the decoder takes
+// either alphabet with or without padding, needs room for 3 * len / 4 bytes
+// and returns -1 for invalid input. Safe on worker threads.
+size_t base64_encoded_len(size_t len, int pad);
+size_t base64_encode(const unsigned char *in, size_t len, char *out, int url, int pad);
+long base64_decode(const char *in, size_t len, unsigned char *out);
+
+// Fluree account IDs (account_id.c): version 0x0f02, the RIPEMD-160 of the
+// SHA-256 of the public key and a 4-byte double SHA-256 checksum
+#define ACCOUNT_ID_BYTES 26
+#define ACCOUNT_ID_MAX_CHARS 36
+void account_id_bytes(const unsigned char *pubkey, size_t pubkey_len, unsigned char out[ACCOUNT_ID_BYTES]);
+
+// Worker threads (parallel.c). fn is called with the half-open item range
+// [begin, end) of one thread and, when contexts are requested, the cloned
+// context of that thread. fn must not call the R API.
+typedef void (*parallel_fn)(void *data, const secp256k1_context *ctx, R_xlen_t begin, R_xlen_t end);
+void parallel_for(R_xlen_t n, int n_threads, parallel_fn fn, void *data, int use_context);
+
+#endif
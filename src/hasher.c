@@ -0,0 +1,252 @@
+#define _FILE_OFFSET_BITS 64
+#include <R.h>
+#include <Rinternals.h>
+#include <string.h>
+#include <errno.h>
+#include <stdio.h>
+#include "flureeCrypto.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+
+// Bytes hashed between readahead hints, and the read size without mmap
+#define FILE_CHUNK (4 << 20)
+
+typedef enum {
+  HASH_SHA2_256,
+  HASH_SHA2_512,
+  HASH_SHA3_256,
+  HASH_SHA3_512,
+  HASH_RIPEMD_160,
+  HASH_COUNT
+} hash_algo;
+
+static const char *hash_names[HASH_COUNT] = {"sha2_256", "sha2_512", "sha3_256", "sha3_512", "ripemd_160"};
+static const size_t hash_lens[HASH_COUNT] = {32, 64, 32, 64, 20};
+
+// An incremental hasher for any of the algorithms above
+typedef struct {
+  hash_algo algo;
+  int finished;
+  union {
+    sha256_ctx sha256;
+    sha512_ctx sha512;
+    sha3_ctx sha3;
+    ripemd160_ctx ripemd160;
+  } ctx;
+} hasher;
+
+
+static hash_algo hash_algo_from_R(SEXP algo_r) {
+  if (TYPEOF(algo_r) != STRSXP || XLENGTH(algo_r) != 1 || STRING_ELT(algo_r, 0) == NA_STRING) {
+    error("Algorithm must be a single string.");
+  }
+  const char *name = CHAR(STRING_ELT(algo_r, 0));
+  for (int i = 0; i < HASH_COUNT; i++) {
+    if (strcmp(name, hash_names[i]) == 0) {
+      return (hash_algo) i;
+    }
+  }
+  error("Unsupported algorithm '%s'.", name);
+  return HASH_COUNT;  // not reached
+}
+
+static void hasher_start(hasher *h, hash_algo algo) {
+  h->algo = algo;
+  h->finished = 0;
+  switch (algo) {
+  case HASH_SHA2_256: sha256_init(&h->ctx.sha256); break;
+  case HASH_SHA2_512: sha512_init(&h->ctx.sha512); break;
+  case HASH_SHA3_256: sha3_init(&h->ctx.sha3, 32); break;
+  case HASH_SHA3_512: sha3_init(&h->ctx.sha3, 64); break;
+  default: ripemd160_init(&h->ctx.ripemd160); break;
+  }
+}
+
+static void hasher_feed(hasher *h, const unsigned char *data, size_t len) {
+  switch (h->algo) {
+  case HASH_SHA2_256: sha256_update(&h->ctx.sha256, data, len); break;
+  case HASH_SHA2_512: sha512_update(&h->ctx.sha512, data, len); break;
+  case HASH_SHA3_256:
+  case HASH_SHA3_512: sha3_update(&h->ctx.sha3, data, len); break;
+  default: ripemd160_update(&h->ctx.ripemd160, data, len); break;
+  }
+}
+
+static SEXP hasher_finish(hasher *h) {
+  SEXP result = PROTECT(allocVector(RAWSXP, hash_lens[h->algo]));
+  switch (h->algo) {
+  case HASH_SHA2_256: sha256_final(&h->ctx.sha256, RAW(result)); break;
+  case HASH_SHA2_512: sha512_final(&h->ctx.sha512, RAW(result)); break;
+  case HASH_SHA3_256:
+  case HASH_SHA3_512: sha3_final(&h->ctx.sha3, RAW(result)); break;
+  default: ripemd160_final(&h->ctx.ripemd160, RAW(result)); break;
+  }
+  h->finished = 1;
+  UNPROTECT(1);
+  return result;
+}
+
+
+static void hasher_finalizer(SEXP ptr) {
+  hasher *h = (hasher *) R_ExternalPtrAddr(ptr);
+  if (h != NULL) {
+    secure_wipe(h, sizeof(hasher));
+    free(h);
+    R_ClearExternalPtr(ptr);
+  }
+}
+
+static hasher* hasher_from_R(SEXP ptr) {
+  if (TYPEOF(ptr) != EXTPTRSXP || R_ExternalPtrTag(ptr) != install("flureeCrypto_hasher")) {
+    error("Not a hasher object.");
+  }
+  hasher *h = (hasher *) R_ExternalPtrAddr(ptr);
+  if (h == NULL) {
+    error("The hasher is no longer valid.");
+  }
+  return h;
+}
+
+SEXP hasher_new_R(SEXP algo_r) {
+  hash_algo algo = hash_algo_from_R(algo_r);
+  SEXP ptr = PROTECT(R_MakeExternalPtr(NULL, install("flureeCrypto_hasher"), R_NilValue));
+  R_RegisterCFinalizerEx(ptr, hasher_finalizer, TRUE);
+  hasher *h = (hasher *) calloc(1, sizeof(hasher));
+  if (h == NULL) {
+    error("Failed to allocate a hasher");
+  }
+  R_SetExternalPtrAddr(ptr, h);
+  hasher_start(h, algo);
+  UNPROTECT(1);
+  return ptr;
+}
+
+// Feed a raw vector, or the bytes of every string of a character vector in
+// order, to the hasher
+SEXP hasher_update_R(SEXP ptr, SEXP x) {
+  hasher *h = hasher_from_R(ptr);
+  if (h->finished) {
+    error("The hasher has already been finalised.");
+  }
+
+  if (TYPEOF(x) == RAWSXP) {
+    hasher_feed(h, RAW(x), (size_t) XLENGTH(x));
+  } else if (TYPEOF(x) == STRSXP) {
+    for (R_xlen_t i = 0; i < XLENGTH(x); i++) {
+      if (STRING_ELT(x, i) == NA_STRING) {
+        error("Cannot hash a missing value.");
+      }
+    }
+    for (R_xlen_t i = 0; i < XLENGTH(x); i++) {
+      SEXP s = STRING_ELT(x, i);
+      hasher_feed(h, (const unsigned char *) CHAR(s), (size_t) LENGTH(s));
+    }
+  } else {
+    error("Input must be a raw vector or a character vector.");
+  }
+  return ptr;
+}
+
+SEXP hasher_final_R(SEXP ptr) {
+  hasher *h = hasher_from_R(ptr);
+  if (h->finished) {
+    error("The hasher has already been finalised.");
+  }
+  return hasher_finish(h);
+}
+
+SEXP hasher_algorithm_R(SEXP ptr) {
+  return mkString(hash_names[hasher_from_R(ptr)->algo]);
+}
+
+
+#ifndef _WIN32
+// Hash a regular file through a read-only mapping. Pages are dropped from
+// the mapping once hashed and the next chunk is requested ahead of time, so
+// the resident size stays at a few chunks whatever the size of the file.
+// Returns 0 if the file could not be mapped.
+static int hash_mapped(hasher *h, int fd, size_t size) {
+  unsigned char *map = (unsigned char *) mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (map == MAP_FAILED) {
+    return 0;
+  }
+  madvise(map, size, MADV_SEQUENTIAL);
+  for (size_t offset = 0; offset < size; offset += FILE_CHUNK) {
+    size_t len = (size - offset < FILE_CHUNK) ? size - offset : FILE_CHUNK;
+    if (offset + len < size) {
+      size_t ahead = (size - offset - len < FILE_CHUNK) ? size - offset - len : FILE_CHUNK;
+      madvise(map + offset + len, ahead, MADV_WILLNEED);
+    }
+    hasher_feed(h, map + offset, len);
+    madvise(map + offset, len, MADV_DONTNEED);
+  }
+  munmap(map, size);
+  return 1;
+}
+#endif
+
+// Hash a file with constant memory. Regular files are memory-mapped; pipes,
+// devices and files that cannot be mapped are read in large blocks.
+SEXP hash_file_R(SEXP path_r, SEXP algo_r) {
+  hash_algo algo = hash_algo_from_R(algo_r);
+  if (TYPEOF(path_r) != STRSXP || XLENGTH(path_r) != 1 || STRING_ELT(path_r, 0) == NA_STRING) {
+    error("Path must be a single string.");
+  }
+  const char *path = R_ExpandFileName(translateChar(STRING_ELT(path_r, 0)));
+  hasher h;
+  hasher_start(&h, algo);
+  unsigned char *buffer = (unsigned char *) R_alloc(FILE_CHUNK, 1);
+  int read_error = 0;
+
+#ifndef _WIN32
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    error("Cannot open file '%s': %s", path, strerror(errno));
+  }
+  struct stat sb;
+  int mapped = 0;
+  if (fstat(fd, &sb) == 0 && S_ISREG(sb.st_mode) && sb.st_size > 0 && (uint64_t) sb.st_size <= SIZE_MAX) {
+    mapped = hash_mapped(&h, fd, (size_t) sb.st_size);
+  }
+  if (!mapped) {
+#ifdef POSIX_FADV_SEQUENTIAL
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+    for (;;) {
+      ssize_t got = read(fd, buffer, FILE_CHUNK);
+      if (got < 0 && errno == EINTR) {
+        continue;
+      }
+      if (got <= 0) {
+        read_error = (got < 0) ? errno : 0;
+        break;
+      }
+      hasher_feed(&h, buffer, (size_t) got);
+    }
+  }
+  close(fd);
+#else
+  FILE *file = fopen(path, "rb");
+  if (file == NULL) {
+    error("Cannot open file '%s': %s", path, strerror(errno));
+  }
+  size_t got;
+  while ((got = fread(buffer, 1, FILE_CHUNK, file)) > 0) {
+    hasher_feed(&h, buffer, got);
+  }
+  read_error = ferror(file) ? EIO : 0;
+  fclose(file);
+#endif
+
+  if (read_error) {
+    secure_wipe(&h, sizeof(h));
+    error("Error reading file '%s': %s", path, strerror(read_error));
+  }
+  return hasher_finish(&h);
+}
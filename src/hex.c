@@ -0,0 +1,336 @@
+#include <R.h>
+#include <Rinternals.h>
+#include <string.h>
+#include "flureeCrypto.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HEX_X86 1
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define HEX_NEON 1
+#endif
+
+
+// Decoding table: the value of a hex digit, or 0xff for any other character
+static const unsigned char hex_values[256] = {
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff
+};
+
+// Encoding table: the lowercase hex digit of every nibble
+static const char hex_digits[] = "0123456789abcdef";
+
+
+#ifdef HEX_X86
+
+// Convert 16 hex characters to their values. Sets *invalid to a non-zero
+// mask if any character is not a hex digit.
+static inline __m128i sse2_hex_values(__m128i chars, int *invalid) {
+  // '0'-'9' are taken as they are, letters are folded to lowercase first
+  __m128i folded = _mm_or_si128(chars, _mm_set1_epi8(0x20));
+  __m128i is_digit = _mm_and_si128(_mm_cmpgt_epi8(chars, _mm_set1_epi8('0' - 1)),
+                                   _mm_cmplt_epi8(chars, _mm_set1_epi8('9' + 1)));
+  __m128i is_alpha = _mm_and_si128(_mm_cmpgt_epi8(folded, _mm_set1_epi8('a' - 1)),
+                                   _mm_cmplt_epi8(folded, _mm_set1_epi8('f' + 1)));
+  *invalid |= 0xffff ^ _mm_movemask_epi8(_mm_or_si128(is_digit, is_alpha));
+
+  __m128i digit_values = _mm_sub_epi8(chars, _mm_set1_epi8('0'));
+  __m128i alpha_values = _mm_sub_epi8(folded, _mm_set1_epi8('a' - 10));
+  return _mm_or_si128(_mm_and_si128(is_digit, digit_values), _mm_andnot_si128(is_digit, alpha_values));
+}
+
+// Combine the nibble pairs of 16 values into 8 bytes held in 16-bit lanes
+static inline __m128i sse2_pack_nibbles(__m128i values) {
+  __m128i high = _mm_and_si128(_mm_slli_epi16(values, 4), _mm_set1_epi16(0x00f0));
+  __m128i low = _mm_srli_epi16(values, 8);
+  return _mm_or_si128(high, low);
+}
+
+// Decode 32 hex characters into 16 bytes per iteration. Returns the number
+// of bytes written; the caller finishes the tail with the table.
+static size_t sse2_hex_decode(const char *hex, size_t n_bytes, unsigned char *out, int *invalid) {
+  size_t i = 0;
+  for (; i + 16 <= n_bytes; i += 16) {
+    __m128i a = sse2_hex_values(_mm_loadu_si128((const __m128i *) (hex + 2 * i)), invalid);
+    __m128i b = sse2_hex_values(_mm_loadu_si128((const __m128i *) (hex + 2 * i + 16)), invalid);
+    _mm_storeu_si128((__m128i *) (out + i), _mm_packus_epi16(sse2_pack_nibbles(a), sse2_pack_nibbles(b)));
+  }
+  return i;
+}
+
+// Encode 16 bytes into 32 lowercase hex characters per iteration
+static size_t sse2_hex_encode(const unsigned char *bytes, size_t n_bytes, char *out) {
+  const __m128i mask = _mm_set1_epi8(0x0f);
+  const __m128i nine = _mm_set1_epi8(9);
+  const __m128i zero_char = _mm_set1_epi8('0');
+  const __m128i letter_gap = _mm_set1_epi8('a' - '0' - 10);
+  size_t i = 0;
+  for (; i + 16 <= n_bytes; i += 16) {
+    __m128i b = _mm_loadu_si128((const __m128i *) (bytes + i));
+    __m128i high = _mm_and_si128(_mm_srli_epi16(b, 4), mask);
+    __m128i low = _mm_and_si128(b, mask);
+    high = _mm_add_epi8(_mm_add_epi8(high, zero_char), _mm_and_si128(_mm_cmpgt_epi8(high, nine), letter_gap));
+    low = _mm_add_epi8(_mm_add_epi8(low, zero_char), _mm_and_si128(_mm_cmpgt_epi8(low, nine), letter_gap));
+    _mm_storeu_si128((__m128i *) (out + 2 * i), _mm_unpacklo_epi8(high, low));
+    _mm_storeu_si128((__m128i *) (out + 2 * i + 16), _mm_unpackhi_epi8(high, low));
+  }
+  return i;
+}
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define HEX_AVX2 1
+
+// AVX2 version of sse2_hex_values for 32 characters
+__attribute__((target("avx2")))
+static inline __m256i avx2_hex_values(__m256i chars, int *invalid) {
+  __m256i folded = _mm256_or_si256(chars, _mm256_set1_epi8(0x20));
+  __m256i is_digit = _mm256_and_si256(_mm256_cmpgt_epi8(chars, _mm256_set1_epi8('0' - 1)),
+                                      _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), chars));
+  __m256i is_alpha = _mm256_and_si256(_mm256_cmpgt_epi8(folded, _mm256_set1_epi8('a' - 1)),
+                                      _mm256_cmpgt_epi8(_mm256_set1_epi8('f' + 1), folded));
+  *invalid |= ~_mm256_movemask_epi8(_mm256_or_si256(is_digit, is_alpha));
+
+  __m256i digit_values = _mm256_sub_epi8(chars, _mm256_set1_epi8('0'));
+  __m256i alpha_values = _mm256_sub_epi8(folded, _mm256_set1_epi8('a' - 10));
+  return _mm256_blendv_epi8(alpha_values, digit_values, is_digit);
+}
+
+// Decode 64 hex characters into 32 bytes per iteration
+__attribute__((target("avx2")))
+static size_t avx2_hex_decode(const char *hex, size_t n_bytes, unsigned char *out, int *invalid) {
+  size_t i = 0;
+  for (; i + 32 <= n_bytes; i += 32) {
+    __m256i a = avx2_hex_values(_mm256_loadu_si256((const __m256i *) (hex + 2 * i)), invalid);
+    __m256i b = avx2_hex_values(_mm256_loadu_si256((const __m256i *) (hex + 2 * i + 32)), invalid);
+    a = _mm256_or_si256(_mm256_and_si256(_mm256_slli_epi16(a, 4), _mm256_set1_epi16(0x00f0)), _mm256_srli_epi16(a, 8));
+    b = _mm256_or_si256(_mm256_and_si256(_mm256_slli_epi16(b, 4), _mm256_set1_epi16(0x00f0)), _mm256_srli_epi16(b, 8));
+    // packus works within 128-bit lanes, so restore the byte order afterwards
+    __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xd8);
+    _mm256_storeu_si256((__m256i *) (out + i), packed);
+  }
+  return i;
+}
+#endif
+
+#endif
+
+#ifdef HEX_NEON
+
+// Convert 16 hex characters to their values, collecting invalid characters
+static inline uint8x16_t neon_hex_values(uint8x16_t chars, uint8x16_t *valid) {
+  uint8x16_t folded = vorrq_u8(chars, vdupq_n_u8(0x20));
+  uint8x16_t is_digit = vandq_u8(vcgeq_u8(chars, vdupq_n_u8('0')), vcleq_u8(chars, vdupq_n_u8('9')));
+  uint8x16_t is_alpha = vandq_u8(vcgeq_u8(folded, vdupq_n_u8('a')), vcleq_u8(folded, vdupq_n_u8('f')));
+  *valid = vandq_u8(*valid, vorrq_u8(is_digit, is_alpha));
+  return vbslq_u8(is_digit, vsubq_u8(chars, vdupq_n_u8('0')), vsubq_u8(folded, vdupq_n_u8('a' - 10)));
+}
+
+static size_t neon_hex_decode(const char *hex, size_t n_bytes, unsigned char *out, int *invalid) {
+  uint8x16_t valid = vdupq_n_u8(0xff);
+  size_t i = 0;
+  for (; i + 16 <= n_bytes; i += 16) {
+    // Split the 32 characters into the high (even) and low (odd) nibbles
+    uint8x16x2_t pairs = vld2q_u8((const uint8_t *) (hex + 2 * i));
+    uint8x16_t high = neon_hex_values(pairs.val[0], &valid);
+    uint8x16_t low = neon_hex_values(pairs.val[1], &valid);
+    vst1q_u8(out + i, vorrq_u8(vshlq_n_u8(high, 4), low));
+  }
+  if (vminvq_u8(valid) != 0xff) {
+    *invalid = 1;
+  }
+  return i;
+}
+
+static inline uint8x16_t neon_hex_chars(uint8x16_t nibbles) {
+  uint8x16_t chars = vaddq_u8(nibbles, vdupq_n_u8('0'));
+  return vaddq_u8(chars, vandq_u8(vcgtq_u8(nibbles, vdupq_n_u8(9)), vdupq_n_u8('a' - '0' - 10)));
+}
+
+static size_t neon_hex_encode(const unsigned char *bytes, size_t n_bytes, char *out) {
+  size_t i = 0;
+  for (; i + 16 <= n_bytes; i += 16) {
+    uint8x16_t b = vld1q_u8(bytes + i);
+    uint8x16x2_t pairs;
+    pairs.val[0] = neon_hex_chars(vshrq_n_u8(b, 4));
+    pairs.val[1] = neon_hex_chars(vandq_u8(b, vdupq_n_u8(0x0f)));
+    vst2q_u8((uint8_t *) (out + 2 * i), pairs);
+  }
+  return i;
+}
+
+#endif
+
+
+// Decode hex_len characters of hex into hex_len / 2 bytes. Upper- and
+// lowercase digits are accepted. Returns 1 on success and 0 if the length is
+// odd or a character is not a hex digit, in which case out is unspecified.
+int hex_decode(const char *hex, size_t hex_len, unsigned char *out) {
+  if (hex_len % 2 != 0) {
+    return 0;
+  }
+  size_t n_bytes = hex_len / 2;
+  size_t i = 0;
+  int invalid = 0;
+
+#if defined(HEX_AVX2)
+  if (__builtin_cpu_supports("avx2")) {
+    i = avx2_hex_decode(hex, n_bytes, out, &invalid);
+  }
+#endif
+#if defined(HEX_X86)
+  i += sse2_hex_decode(hex + 2 * i, n_bytes - i, out + i, &invalid);
+#elif defined(HEX_NEON)
+  i = neon_hex_decode(hex, n_bytes, out, &invalid);
+#endif
+
+  unsigned char checked = 0;
+  for (; i < n_bytes; i++) {
+    unsigned char high = hex_values[(unsigned char) hex[2 * i]];
+    unsigned char low = hex_values[(unsigned char) hex[2 * i + 1]];
+    checked |= high | low;
+    out[i] = (unsigned char) ((high << 4) | (low & 0x0f));
+  }
+
+  return !invalid && !(checked & 0xf0);
+}
+
+// Encode bytes_len bytes as 2 * bytes_len lowercase hex characters (the
+// output is not null-terminated)
+void hex_encode(const unsigned char *bytes, size_t bytes_len, char *out) {
+  size_t i = 0;
+#if defined(HEX_X86)
+  i = sse2_hex_encode(bytes, bytes_len, out);
+#elif defined(HEX_NEON)
+  i = neon_hex_encode(bytes, bytes_len, out);
+#endif
+  for (; i < bytes_len; i++) {
+    out[2 * i] = hex_digits[bytes[i] >> 4];
+    out[2 * i + 1] = hex_digits[bytes[i] & 0x0f];
+  }
+}
+
+
+// Function to convert a null-terminated hex string to a byte array
+int hex_to_bytes(const char *hex, unsigned char *bytes, size_t bytes_len) {
+  size_t hex_len = strlen(hex);
+  if (hex_len % 2 != 0 || bytes_len < hex_len / 2) {
+    return 0; // Invalid hex string
+  }
+  return hex_decode(hex, hex_len, bytes);
+}
+
+// Function to convert a byte array to a lowercase hex string (not terminated)
+void bytes_to_hex(const unsigned char *bytes, size_t bytes_len, char *hex) {
+  hex_encode(bytes, bytes_len, hex);
+}
+
+
+// Encode every raw vector of a list as a hex string, with NA for NULL
+// elements. A raw vector gives one string, or one string per width bytes
+// when width is positive (the columns of a raw matrix).
+SEXP hex_encode_R(SEXP x, SEXP width_r) {
+  if (TYPEOF(x) == RAWSXP) {
+    R_xlen_t len = XLENGTH(x);
+    int width_int = asInteger(width_r);
+    R_xlen_t width = (width_int == NA_INTEGER || width_int <= 0) ? len : (R_xlen_t) width_int;
+    if (width == 0) {
+      return ScalarString(mkChar(""));
+    }
+    if (width > INT_MAX / 2) {
+      error("Raw vector is too long to encode as a single string");
+    }
+    if (len % width != 0) {
+      error("Raw vector length is not a multiple of the width.");
+    }
+    R_xlen_t n = len / width;
+    SEXP result = PROTECT(allocVector(STRSXP, n));
+    char *hex = R_alloc(2 * width + 1, 1);
+    for (R_xlen_t i = 0; i < n; i++) {
+      hex_encode(RAW(x) + i * width, width, hex);
+      SET_STRING_ELT(result, i, mkCharLen(hex, (int) (2 * width)));
+    }
+    UNPROTECT(1);
+    return result;
+  }
+  if (TYPEOF(x) != VECSXP) {
+    error("Input must be a raw vector or a list of raw vectors.");
+  }
+
+  R_xlen_t n = XLENGTH(x);
+  size_t max_len = 0;
+  for (R_xlen_t i = 0; i < n; i++) {
+    SEXP el = VECTOR_ELT(x, i);
+    if (TYPEOF(el) == RAWSXP) {
+      if ((size_t) XLENGTH(el) > max_len) {
+        max_len = XLENGTH(el);
+      }
+    } else if (el != R_NilValue) {
+      error("Element %lld is not a raw vector.", (long long) i + 1);
+    }
+  }
+  if (max_len > INT_MAX / 2) {
+    error("Raw vector is too long to encode as a single string");
+  }
+
+  // One scratch buffer for the longest element, reused for every string
+  SEXP result = PROTECT(allocVector(STRSXP, n));
+  char *hex = R_alloc(2 * max_len + 1, 1);
+  for (R_xlen_t i = 0; i < n; i++) {
+    SEXP el = VECTOR_ELT(x, i);
+    if (el == R_NilValue) {
+      SET_STRING_ELT(result, i, NA_STRING);
+      continue;
+    }
+    hex_encode(RAW(el), XLENGTH(el), hex);
+    SET_STRING_ELT(result, i, mkCharLen(hex, (int) (2 * XLENGTH(el))));
+  }
+
+  UNPROTECT(1);
+  return result;
+}
+
+// Decode every string of a character vector into a raw vector. Returns a
+// list; invalid strings raise an error naming the first bad element.
+SEXP hex_decode_R(SEXP x) {
+  if (TYPEOF(x) != STRSXP) {
+    error("Input must be a character vector of hexadecimal strings.");
+  }
+
+  R_xlen_t n = XLENGTH(x);
+  SEXP result = PROTECT(allocVector(VECSXP, n));
+  for (R_xlen_t i = 0; i < n; i++) {
+    SEXP hex_r = STRING_ELT(x, i);
+    if (hex_r == NA_STRING) {
+      continue;
+    }
+    size_t hex_len = (size_t) LENGTH(hex_r);
+    if (hex_len % 2 != 0) {
+      error("Element %lld has an odd number of hexadecimal characters.", (long long) i + 1);
+    }
+
+    // Decode straight into the output vector
+    SEXP bytes_r = allocVector(RAWSXP, hex_len / 2);
+    SET_VECTOR_ELT(result, i, bytes_r);
+    if (!hex_decode(CHAR(hex_r), hex_len, RAW(bytes_r))) {
+      error("Element %lld is not a valid hexadecimal string.", (long long) i + 1);
+    }
+  }
+
+  UNPROTECT(1);
+  return result;
+}
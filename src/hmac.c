@@ -0,0 +1,246 @@
+#include <R.h>
+#include <Rinternals.h>
+#include <string.h>
+#include <stdlib.h>
+#include "flureeCrypto.h"
+
+
+// HMAC-SHA256 (RFC 2104) on top of the incremental SHA-256. The context
+// keeps the inner and outer hashes after their key blocks, so a key can be
+// set once and the midstates copied for every message.
+
+void hmac_sha256_init(hmac_sha256_ctx *ctx, const unsigned char *key, size_t key_len) {
+  unsigned char block[64];
+  unsigned char key_hash[32];
+  memset(block, 0, sizeof(block));
+  if (key_len > 64) {
+    sha256(key, key_len, key_hash);
+    memcpy(block, key_hash, 32);
+  } else if (key_len > 0) {
+    memcpy(block, key, key_len);
+  }
+
+  for (int i = 0; i < 64; i++) {
+    block[i] ^= 0x36;
+  }
+  sha256_init(&ctx->inner);
+  sha256_update(&ctx->inner, block, 64);
+
+  for (int i = 0; i < 64; i++) {
+    block[i] ^= 0x36 ^ 0x5c;
+  }
+  sha256_init(&ctx->outer);
+  sha256_update(&ctx->outer, block, 64);
+
+  secure_wipe(block, sizeof(block));
+  secure_wipe(key_hash, sizeof(key_hash));
+}
+
+void hmac_sha256_update(hmac_sha256_ctx *ctx, const unsigned char *data, size_t len) {
+  sha256_update(&ctx->inner, data, len);
+}
+
+void hmac_sha256_final(hmac_sha256_ctx *ctx, unsigned char out[32]) {
+  unsigned char inner_digest[32];
+  sha256_final(&ctx->inner, inner_digest);
+  sha256_update(&ctx->outer, inner_digest, 32);
+  sha256_final(&ctx->outer, out);
+  secure_wipe(inner_digest, sizeof(inner_digest));
+}
+
+void hmac_sha256(const unsigned char *key, size_t key_len, const unsigned char *data, size_t len,
+                 unsigned char out[32]) {
+  hmac_sha256_ctx ctx;
+  hmac_sha256_init(&ctx, key, key_len);
+  hmac_sha256_update(&ctx, data, len);
+  hmac_sha256_final(&ctx, out);
+  secure_wipe(&ctx, sizeof(ctx));
+}
+
+
+// PBKDF2-HMAC-SHA256 (RFC 8018). The password midstates and the salt are
+// absorbed once; each output block and iteration only copies a context.
+void pbkdf2_sha256(const unsigned char *password, size_t password_len, const unsigned char *salt, size_t salt_len,
+                   uint64_t iterations, unsigned char *out, size_t out_len) {
+  hmac_sha256_ctx keyed, salted, ctx;
+  unsigned char u[32], t[32], counter[4];
+  hmac_sha256_init(&keyed, password, password_len);
+  salted = keyed;
+  hmac_sha256_update(&salted, salt, salt_len);
+
+  for (uint32_t block = 1; out_len > 0; block++) {
+    counter[0] = (unsigned char) (block >> 24);
+    counter[1] = (unsigned char) (block >> 16);
+    counter[2] = (unsigned char) (block >> 8);
+    counter[3] = (unsigned char) block;
+    ctx = salted;
+    hmac_sha256_update(&ctx, counter, 4);
+    hmac_sha256_final(&ctx, u);
+    memcpy(t, u, 32);
+    for (uint64_t i = 1; i < iterations; i++) {
+      ctx = keyed;
+      hmac_sha256_update(&ctx, u, 32);
+      hmac_sha256_final(&ctx, u);
+      for (int k = 0; k < 32; k++) {
+        t[k] ^= u[k];
+      }
+    }
+    size_t take = out_len < 32 ? out_len : 32;
+    memcpy(out, t, take);
+    out += take;
+    out_len -= take;
+  }
+
+  secure_wipe(&keyed, sizeof(keyed));
+  secure_wipe(&salted, sizeof(salted));
+  secure_wipe(&ctx, sizeof(ctx));
+  secure_wipe(u, sizeof(u));
+  secure_wipe(t, sizeof(t));
+}
+
+
+// HMAC keys held by R external pointers: the context right after the key
+// blocks, so each message costs its own blocks and two finals only
+static SEXP hmac_key_tag() {
+  return install("flureeCrypto_hmac_key");
+}
+
+static void hmac_key_finalizer(SEXP ptr) {
+  hmac_sha256_ctx *ctx = (hmac_sha256_ctx *) R_ExternalPtrAddr(ptr);
+  if (ctx != NULL) {
+    secure_wipe(ctx, sizeof(hmac_sha256_ctx));
+    free(ctx);
+    R_ClearExternalPtr(ptr);
+  }
+}
+
+SEXP hmac_key_R(SEXP key_r) {
+  if (TYPEOF(key_r) != RAWSXP) {
+    error("HMAC key must be a raw vector.");
+  }
+  // The wiping finalizer is in place before the midstates are written
+  SEXP ptr = PROTECT(R_MakeExternalPtr(NULL, hmac_key_tag(), R_NilValue));
+  R_RegisterCFinalizerEx(ptr, hmac_key_finalizer, TRUE);
+  hmac_sha256_ctx *ctx = (hmac_sha256_ctx *) calloc(1, sizeof(hmac_sha256_ctx));
+  if (ctx == NULL) {
+    error("Failed to allocate an HMAC key");
+  }
+  R_SetExternalPtrAddr(ptr, ctx);
+  hmac_sha256_init(ctx, RAW(key_r), (size_t) XLENGTH(key_r));
+  UNPROTECT(1);
+  return ptr;
+}
+
+// Set ctx from a raw key or an HMAC key handle
+static void hmac_key_from_R(SEXP key_r, hmac_sha256_ctx *ctx) {
+  if (TYPEOF(key_r) == RAWSXP) {
+    hmac_sha256_init(ctx, RAW(key_r), (size_t) XLENGTH(key_r));
+    return;
+  }
+  if (TYPEOF(key_r) != EXTPTRSXP || R_ExternalPtrTag(key_r) != hmac_key_tag()) {
+    error("HMAC key must be a raw vector or an HMAC key.");
+  }
+  const hmac_sha256_ctx *handle = (const hmac_sha256_ctx *) R_ExternalPtrAddr(key_r);
+  if (handle == NULL) {
+    error("The HMAC key is no longer valid.");
+  }
+  *ctx = *handle;
+}
+
+typedef struct {
+  const hmac_sha256_ctx *keyed;
+  const unsigned char **data;
+  const size_t *lens;
+  unsigned char *out;
+} hmac_batch;
+
+static void hmac_worker(void *data, const secp256k1_context *ctx, R_xlen_t begin, R_xlen_t end) {
+  hmac_batch *batch = (hmac_batch *) data;
+  hmac_sha256_ctx mac;
+  for (R_xlen_t i = begin; i < end; i++) {
+    mac = *batch->keyed;
+    hmac_sha256_update(&mac, batch->data[i], batch->lens[i]);
+    hmac_sha256_final(&mac, batch->out + 32 * i);
+  }
+  secure_wipe(&mac, sizeof(mac));
+}
+
+// HMAC-SHA256 of a raw vector, or of every element of a list of raw vectors
+// under the same key. Like sha256_R(), a list gives hex strings (NA for NULL
+// elements) or a 32 x N raw matrix. Long lists are spread across threads.
+SEXP hmac_sha256_R(SEXP key_r, SEXP x, SEXP output_hex_r, SEXP n_threads_R) {
+  int output_hex = asLogical(output_hex_r) == TRUE;
+  if (TYPEOF(x) != RAWSXP && TYPEOF(x) != VECSXP) {
+    error("Input must be a raw vector or a list of raw vectors.");
+  }
+  hmac_sha256_ctx keyed;
+  hmac_key_from_R(key_r, &keyed);
+
+  if (TYPEOF(x) == RAWSXP) {
+    unsigned char mac[32];
+    hmac_sha256_update(&keyed, RAW(x), (size_t) XLENGTH(x));
+    hmac_sha256_final(&keyed, mac);
+    secure_wipe(&keyed, sizeof(keyed));
+    if (output_hex) {
+      char hex[64];
+      hex_encode(mac, 32, hex);
+      return ScalarString(mkCharLen(hex, 64));
+    }
+    SEXP result = PROTECT(allocVector(RAWSXP, 32));
+    memcpy(RAW(result), mac, 32);
+    UNPROTECT(1);
+    return result;
+  }
+
+  R_xlen_t n = XLENGTH(x);
+  const unsigned char **data = (const unsigned char **) R_alloc(n > 0 ? n : 1, sizeof(unsigned char *));
+  size_t *lens = (size_t *) R_alloc(n > 0 ? n : 1, sizeof(size_t));
+  R_xlen_t *index = (R_xlen_t *) R_alloc(n > 0 ? n : 1, sizeof(R_xlen_t));
+  R_xlen_t present = 0;
+  for (R_xlen_t i = 0; i < n; i++) {
+    SEXP el = VECTOR_ELT(x, i);
+    if (el == R_NilValue) {
+      continue;
+    }
+    if (TYPEOF(el) != RAWSXP) {
+      secure_wipe(&keyed, sizeof(keyed));
+      error("Element %lld is not a raw vector.", (long long) i + 1);
+    }
+    data[present] = RAW(el);
+    lens[present] = (size_t) XLENGTH(el);
+    index[present++] = i;
+  }
+  if (!output_hex && present < n) {
+    secure_wipe(&keyed, sizeof(keyed));
+    error("Cannot put missing values into a raw matrix.");
+  }
+  if (!output_hex && n > INT_MAX) {
+    secure_wipe(&keyed, sizeof(keyed));
+    error("Too many messages for a raw matrix.");
+  }
+
+  SEXP result;
+  hmac_batch batch = {&keyed, data, lens, NULL};
+  if (output_hex) {
+    result = PROTECT(allocVector(STRSXP, n));
+    batch.out = (unsigned char *) R_alloc(present > 0 ? present : 1, 32);
+  } else {
+    result = PROTECT(allocMatrix(RAWSXP, 32, (int) n));
+    batch.out = RAW(result);
+  }
+  parallel_for(present, asInteger(n_threads_R), hmac_worker, &batch, 0);
+  secure_wipe(&keyed, sizeof(keyed));
+
+  if (output_hex) {
+    char hex[64];
+    for (R_xlen_t i = 0; i < n; i++) {
+      SET_STRING_ELT(result, i, NA_STRING);
+    }
+    for (R_xlen_t j = 0; j < present; j++) {
+      hex_encode(batch.out + 32 * j, 32, hex);
+      SET_STRING_ELT(result, index[j], mkCharLen(hex, 64));
+    }
+  }
+  UNPROTECT(1);
+  return result;
+}
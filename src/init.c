@@ -1,28 +1,220 @@
 #include <R.h>
 #include <Rinternals.h>
 #include <R_ext/Rdynload.h>
+#include <stdint.h>
 
-extern SEXP valid_private_R(SEXP private_key_hex);
+extern SEXP valid_private_R(SEXP private_keys);
 extern SEXP generate_seckey_R();
 extern SEXP format_public_key_R(SEXP pubkey_r);
 extern SEXP generate_keypair_R();
 extern SEXP generate_keypair_with_seckey_R(SEXP seckey_r);
+extern SEXP generate_keypairs_R(SEXP n_r, SEXP n_threads_R);
 extern SEXP sign_R_R(SEXP msg_hash_r, SEXP priv_key_r);
-extern SEXP ecrecover_R(SEXP hex_signature_R, SEXP hash_R); 
+extern SEXP sign_message_R(SEXP msg_r, SEXP priv_key_r, SEXP output_hex_r, SEXP compact_r);
+extern SEXP sign_batch_R(SEXP hashes_r, SEXP keys_r, SEXP output_hex_r, SEXP compact_r);
+extern SEXP ecrecover_R(SEXP signature_R, SEXP hash_R);
+extern SEXP ecrecover_batch_R(SEXP signatures_R, SEXP hashes_R, SEXP n_threads_R);
+extern SEXP verify_batch_R(SEXP pubkeys_R, SEXP signatures_R, SEXP hashes_R, SEXP n_threads_R);
+extern SEXP context_count_R();
+extern SEXP ecdh_R(SEXP priv_key_r, SEXP pubkeys_R, SEXP format_r, SEXP n_threads_R);
+extern SEXP schnorr_sign_R(SEXP hashes_r, SEXP priv_key_r, SEXP output_hex_r);
+extern SEXP schnorr_verify_R(SEXP pubkeys_R, SEXP signatures_R, SEXP hashes_R, SEXP n_threads_R);
+extern SEXP scrypt_R(SEXP password_r, SEXP salt_r, SEXP N_r, SEXP r_r, SEXP p_r, SEXP dk_len_r, SEXP n_threads_R);
+extern SEXP scrypt_check_batch_R(SEXP passwords_r, SEXP salts_r, SEXP expected_r, SEXP N_r, SEXP r_r, SEXP p_r, SEXP n_threads_R);
+extern SEXP scrypt_release_memory_R();
+extern SEXP load_private_key_R(SEXP seckey_r);
+extern SEXP load_public_key_R(SEXP pubkey_r);
+extern SEXP key_handle_public_R(SEXP ptr);
+extern SEXP hex_encode_R(SEXP x, SEXP width_r);
+extern SEXP hex_decode_R(SEXP x);
+extern SEXP random_bytes_R(SEXP size_r);
+extern SEXP sha256_R(SEXP x, SEXP output_hex_r);
+extern SEXP sha256_implementation_R();
+extern SEXP sha3_R(SEXP x, SEXP out_len_r, SEXP output_hex_r);
+extern SEXP sha3_implementation_R();
+extern SEXP hash_string_key_R(SEXP key_r, SEXP n_r);
+extern SEXP nfkc_quick_check_R(SEXP x);
+extern SEXP hasher_new_R(SEXP algo_r);
+extern SEXP hasher_update_R(SEXP ptr, SEXP x);
+extern SEXP hasher_final_R(SEXP ptr);
+extern SEXP hasher_algorithm_R(SEXP ptr);
+extern SEXP hash_file_R(SEXP path_r, SEXP algo_r);
+extern SEXP account_ids_R(SEXP pubkeys_R, SEXP base58_R, SEXP n_threads_R);
+extern SEXP account_ids_from_signatures_R(SEXP signatures_R, SEXP hashes_R, SEXP base58_R, SEXP n_threads_R);
+extern SEXP account_ids_valid_R(SEXP ids_R);
+extern SEXP recovery_cache_configure_R(SEXP capacity_r);
+extern SEXP recovery_cache_flush_R();
+extern SEXP recovery_cache_stats_R();
+extern SEXP base58_encode_R(SEXP x, SEXP width_r, SEXP check_r);
+extern SEXP base58_decode_R(SEXP x, SEXP check_r);
+extern SEXP base64_encode_R(SEXP x, SEXP width_r, SEXP url_r, SEXP pad_r);
+extern SEXP base64_decode_R(SEXP x);
+extern SEXP jws_serialize_R(SEXP payloads_r, SEXP priv_key_r, SEXP n_threads_R);
+extern SEXP jws_verify_R(SEXP tokens_r, SEXP account_ids_r, SEXP n_threads_R);
+extern SEXP hmac_key_R(SEXP key_r);
+extern SEXP hmac_sha256_R(SEXP key_r, SEXP x, SEXP output_hex_r, SEXP n_threads_R);
+extern SEXP aes_key_R(SEXP key_r);
+extern SEXP aes_key_bits_R(SEXP ptr);
+extern SEXP aes_implementation_R();
+extern SEXP aes_cbc_R(SEXP key_r, SEXP iv_r, SEXP x, SEXP encrypt_r, SEXP n_threads_R);
+extern SEXP aes_mode_R(SEXP key_r, SEXP iv_r, SEXP x, SEXP encrypt_r, SEXP gcm_r, SEXP n_threads_R);
+extern SEXP ghash_implementation_R();
+extern SEXP aes_stream_new_R(SEXP key_r, SEXP iv_r, SEXP encrypt_r);
+extern SEXP aes_stream_update_R(SEXP ptr, SEXP x, SEXP n_threads_R);
+extern SEXP aes_stream_final_R(SEXP ptr);
+extern SEXP aes_stream_direction_R(SEXP ptr);
+extern SEXP aes_file_R(SEXP in_path_r, SEXP out_path_r, SEXP key_r, SEXP iv_r, SEXP encrypt_r, SEXP n_threads_R);
 
+extern SEXP crypto_stats_enable_R(SEXP enabled_r);
+extern SEXP crypto_stats_reset_R();
+extern SEXP crypto_stats_R();
 
+extern int stats_enabled;
+extern void stats_register(const char *const *names, int n);
+extern uint64_t stats_clock();
+extern void stats_count(int op, const SEXP *args, int n_args);
+extern void stats_record(int op, uint64_t start);
+
+extern void init_shared_context();
+extern void free_shared_context();
+extern void free_random_pool();
+extern void free_scrypt_arenas();
+extern void free_stats();
+
+
+// Every entry point below is registered through a wrapper that times it
+// for crypto_stats() when the instrumentation is enabled (stats.c)
+#define TIMED_CALLS(X) \
+  X(valid_private_R, 1) \
+  X(generate_seckey_R, 0) \
+  X(format_public_key_R, 1) \
+  X(generate_keypair_R, 0) \
+  X(generate_keypair_with_seckey_R, 1) \
+  X(generate_keypairs_R, 2) \
+  X(sign_R_R, 2) \
+  X(sign_message_R, 4) \
+  X(sign_batch_R, 4) \
+  X(ecrecover_R, 2) \
+  X(ecrecover_batch_R, 3) \
+  X(verify_batch_R, 4) \
+  X(context_count_R, 0) \
+  X(ecdh_R, 4) \
+  X(schnorr_sign_R, 3) \
+  X(schnorr_verify_R, 4) \
+  X(scrypt_R, 7) \
+  X(scrypt_check_batch_R, 7) \
+  X(scrypt_release_memory_R, 0) \
+  X(load_private_key_R, 1) \
+  X(load_public_key_R, 1) \
+  X(key_handle_public_R, 1) \
+  X(hex_encode_R, 2) \
+  X(hex_decode_R, 1) \
+  X(random_bytes_R, 1) \
+  X(sha256_R, 2) \
+  X(sha256_implementation_R, 0) \
+  X(sha3_R, 3) \
+  X(sha3_implementation_R, 0) \
+  X(hash_string_key_R, 2) \
+  X(nfkc_quick_check_R, 1) \
+  X(hasher_new_R, 1) \
+  X(hasher_update_R, 2) \
+  X(hasher_final_R, 1) \
+  X(hasher_algorithm_R, 1) \
+  X(hash_file_R, 2) \
+  X(account_ids_R, 3) \
+  X(account_ids_from_signatures_R, 4) \
+  X(account_ids_valid_R, 1) \
+  X(recovery_cache_configure_R, 1) \
+  X(recovery_cache_flush_R, 0) \
+  X(recovery_cache_stats_R, 0) \
+  X(base58_encode_R, 3) \
+  X(base58_decode_R, 2) \
+  X(base64_encode_R, 4) \
+  X(base64_decode_R, 1) \
+  X(jws_serialize_R, 3) \
+  X(jws_verify_R, 3) \
+  X(hmac_key_R, 1) \
+  X(hmac_sha256_R, 4) \
+  X(aes_key_R, 1) \
+  X(aes_key_bits_R, 1) \
+  X(aes_implementation_R, 0) \
+  X(aes_cbc_R, 5) \
+  X(aes_mode_R, 6) \
+  X(ghash_implementation_R, 0) \
+  X(aes_stream_new_R, 3) \
+  X(aes_stream_update_R, 3) \
+  X(aes_stream_final_R, 1) \
+  X(aes_stream_direction_R, 1) \
+  X(aes_file_R, 6)
+
+#define STAT_ID(name, n) STAT_##name,
+enum { TIMED_CALLS(STAT_ID) N_TIMED_CALLS };
+#define STAT_NAME(name, n) #name,
+static const char *const timed_call_names[] = { TIMED_CALLS(STAT_NAME) };
+
+#define PARAMS_0 (void)
+#define PARAMS_1 (SEXP a1)
+#define PARAMS_2 (SEXP a1, SEXP a2)
+#define PARAMS_3 (SEXP a1, SEXP a2, SEXP a3)
+#define PARAMS_4 (SEXP a1, SEXP a2, SEXP a3, SEXP a4)
+#define PARAMS_5 (SEXP a1, SEXP a2, SEXP a3, SEXP a4, SEXP a5)
+#define PARAMS_6 (SEXP a1, SEXP a2, SEXP a3, SEXP a4, SEXP a5, SEXP a6)
+#define PARAMS_7 (SEXP a1, SEXP a2, SEXP a3, SEXP a4, SEXP a5, SEXP a6, SEXP a7)
+#define ARGS_0 ()
+#define ARGS_1 (a1)
+#define ARGS_2 (a1, a2)
+#define ARGS_3 (a1, a2, a3)
+#define ARGS_4 (a1, a2, a3, a4)
+#define ARGS_5 (a1, a2, a3, a4, a5)
+#define ARGS_6 (a1, a2, a3, a4, a5, a6)
+#define ARGS_7 (a1, a2, a3, a4, a5, a6, a7)
+#define ARGV_0 {R_NilValue}
+#define ARGV_1 {a1}
+#define ARGV_2 {a1, a2}
+#define ARGV_3 {a1, a2, a3}
+#define ARGV_4 {a1, a2, a3, a4}
+#define ARGV_5 {a1, a2, a3, a4, a5}
+#define ARGV_6 {a1, a2, a3, a4, a5, a6}
+#define ARGV_7 {a1, a2, a3, a4, a5, a6, a7}
+
+// Disabled, a wrapper costs one predictable branch. The call is counted
+// before it runs, so calls that error() are counted too; only their
+// latency is lost.
+#define TIMED_WRAPPER(name, n) \
+  static SEXP name##_timed PARAMS_##n { \
+    if (!stats_enabled) { \
+      return name ARGS_##n; \
+    } \
+    const SEXP argv[] = ARGV_##n; \
+    stats_count(STAT_##name, argv, n); \
+    uint64_t start = stats_clock(); \
+    SEXP result = name ARGS_##n; \
+    stats_record(STAT_##name, start); \
+    return result; \
+  }
+TIMED_CALLS(TIMED_WRAPPER)
+
+#define TIMED_ENTRY(name, n) {#name, (DL_FUNC) &name##_timed, n},
 static const R_CallMethodDef CallEntries[] = {
-  {"valid_private_R", (DL_FUNC) &valid_private_R, 1},
-  {"generate_seckey_R", (DL_FUNC) &generate_seckey_R, 0},
-  {"format_public_key_R", (DL_FUNC) &format_public_key_R, 1},
-  {"generate_keypair_R", (DL_FUNC) &generate_keypair_R, 0},
-	{"generate_keypair_with_seckey_R", (DL_FUNC) &generate_keypair_with_seckey_R, 1},
-	{"sign_R_R", (DL_FUNC) &sign_R_R, 2},
-	{"ecrecover_R", (DL_FUNC) &ecrecover_R, 2},
+	TIMED_CALLS(TIMED_ENTRY)
+	{"crypto_stats_enable_R", (DL_FUNC) &crypto_stats_enable_R, 1},
+	{"crypto_stats_reset_R", (DL_FUNC) &crypto_stats_reset_R, 0},
+	{"crypto_stats_R", (DL_FUNC) &crypto_stats_R, 0},
 	{NULL, NULL, 0}
 };
 
 void R_init_flureeCrypto(DllInfo *dll) {
 	R_registerRoutines(dll, NULL, CallEntries, NULL, NULL);
 	R_useDynamicSymbols(dll, FALSE);
+	
+	// Create and randomize the shared secp256k1 context once per process
+	init_shared_context();
+	stats_register(timed_call_names, N_TIMED_CALLS);
+}
+
+void R_unload_flureeCrypto(DllInfo *dll) {
+	free_shared_context();
+	free_random_pool();
+	free_scrypt_arenas();
+	free_stats();
 }
@@ -0,0 +1,225 @@
+#include <R.h>
+#include <Rinternals.h>
+#include <string.h>
+#include "flureeCrypto.h"
+
+
+// JWS compact serialization with the ES256K-R header of Fluree. The signing
+// input is base64url(header) "." base64url(payload), signed like
+// sign_message() does, and the third part is the base64url of the hex
+// signature. Signing and verification of a token are one pass over its
+// bytes, and vectors of tokens are spread across threads.
+
+// base64url of {"alg":"ES256K-R","b64":false,"crit":["b64"]}
+static const char jws_header[] = "eyJhbGciOiJFUzI1NkstUiIsImI2NCI6ZmFsc2UsImNyaXQiOlsiYjY0Il19";
+#define JWS_HEADER_LEN (sizeof(jws_header) - 1)
+
+// Characters of the base64url of the longest hex signature
+#define JWS_SIGNATURE_CHARS ((2 * MAX_SIGNATURE_LEN * 4 + 2) / 3)
+
+typedef struct {
+  const char **payloads;
+  const size_t *payload_lens;
+  const unsigned char *seckey;
+  char **out;           // one token buffer per payload
+  size_t *out_lens;
+  int *status;          // 0 on success
+} jws_sign_batch;
+
+static void jws_sign_worker(void *data, const secp256k1_context *ctx, R_xlen_t begin, R_xlen_t end) {
+  jws_sign_batch *batch = (jws_sign_batch *) data;
+  unsigned char hash[32], signature[MAX_SIGNATURE_LEN];
+  char hex[2 * MAX_SIGNATURE_LEN];
+  for (R_xlen_t i = begin; i < end; i++) {
+    if (batch->payloads[i] == NULL) {
+      continue;
+    }
+    char *out = batch->out[i];
+    size_t len = JWS_HEADER_LEN;
+    memcpy(out, jws_header, JWS_HEADER_LEN);
+    out[len++] = '.';
+    len += base64_encode((const unsigned char *) batch->payloads[i], batch->payload_lens[i], out + len, 1, 0);
+    sha256((const unsigned char *) out, len, hash);
+
+    size_t signature_len = 0;
+    batch->status[i] = sign_recoverable_der(ctx, hash, batch->seckey, signature, &signature_len);
+    if (batch->status[i] != 0) {
+      continue;
+    }
+    bytes_to_hex(signature, signature_len, hex);
+    out[len++] = '.';
+    len += base64_encode((const unsigned char *) hex, 2 * signature_len, out + len, 1, 0);
+    batch->out_lens[i] = len;
+  }
+}
+
+// Serialize every string of payloads_r into a JWS signed with one private
+// key (raw, hex or a key handle). NA payloads give NA.
+SEXP jws_serialize_R(SEXP payloads_r, SEXP priv_key_r, SEXP n_threads_R) {
+  if (TYPEOF(payloads_r) != STRSXP) {
+    error("Payloads must be a character vector.");
+  }
+  R_xlen_t n = XLENGTH(payloads_r);
+  jws_sign_batch batch;
+  batch.payloads = (const char **) R_alloc(n + 1, sizeof(char *));
+  batch.payload_lens = (size_t *) R_alloc(n + 1, sizeof(size_t));
+  batch.out = (char **) R_alloc(n + 1, sizeof(char *));
+  batch.out_lens = (size_t *) R_alloc(n + 1, sizeof(size_t));
+  batch.status = (int *) R_alloc(n + 1, sizeof(int));
+  size_t *lens = (size_t *) batch.payload_lens;
+  for (R_xlen_t i = 0; i < n; i++) {
+    SEXP s = STRING_ELT(payloads_r, i);
+    batch.payloads[i] = NULL;
+    batch.status[i] = 1;
+    if (s == NA_STRING) {
+      continue;
+    }
+    batch.payloads[i] = CHAR(s);
+    lens[i] = (size_t) LENGTH(s);
+    batch.out[i] = R_alloc(JWS_HEADER_LEN + base64_encoded_len(lens[i], 0) + JWS_SIGNATURE_CHARS + 2, 1);
+  }
+
+  unsigned char decoded_key[32];
+  batch.seckey = private_key_bytes_R(priv_key_r, decoded_key);
+  if (batch.seckey == NULL) {
+    error("The private key should be 32 bytes, as raw, hexadecimal or a key handle.");
+  }
+  parallel_for(n, asInteger(n_threads_R), jws_sign_worker, &batch, 1);
+  secure_wipe(decoded_key, sizeof(decoded_key));
+
+  SEXP result = PROTECT(allocVector(STRSXP, n));
+  for (R_xlen_t i = 0; i < n; i++) {
+    if (batch.payloads[i] == NULL) {
+      SET_STRING_ELT(result, i, NA_STRING);
+    } else if (batch.status[i] != 0) {
+      error("Failed to sign payload %lld.", (long long) i + 1);
+    } else {
+      SET_STRING_ELT(result, i, mkCharLen(batch.out[i], (int) batch.out_lens[i]));
+    }
+  }
+  UNPROTECT(1);
+  return result;
+}
+
+
+typedef struct {
+  const char **tokens;
+  const size_t *token_lens;
+  int account_ids;
+  unsigned char *payloads;   // decoded payload i at the offset of token i
+  const size_t *offsets;
+  size_t *payload_lens;
+  char *keys;                // hex public key or Base58 account ID of token i
+  int *key_lens;
+  int *status;               // 0 for a valid token
+} jws_verify_batch;
+
+// Check one token and recover its signer. Returns 0 on success.
+static int verify_token(const secp256k1_context *ctx, const char *token, size_t len, unsigned char *payload,
+                        size_t *payload_len, unsigned char pubkey[33]) {
+  if (len < JWS_HEADER_LEN + 2 || memcmp(token, jws_header, JWS_HEADER_LEN) != 0 || token[JWS_HEADER_LEN] != '.') {
+    return 1;
+  }
+  const char *b64_payload = token + JWS_HEADER_LEN + 1;
+  const char *dot = memchr(b64_payload, '.', len - JWS_HEADER_LEN - 1);
+  if (dot == NULL) {
+    return 1;
+  }
+  size_t signing_len = (size_t) (dot - token);
+  const char *b64_signature = dot + 1;
+  size_t b64_signature_len = len - signing_len - 1;
+  if (b64_signature_len > JWS_SIGNATURE_CHARS || memchr(b64_signature, '.', b64_signature_len) != NULL) {
+    return 1;
+  }
+
+  long decoded = base64_decode(b64_payload, (size_t) (dot - b64_payload), payload);
+  if (decoded < 0 || memchr(payload, 0, (size_t) decoded) != NULL) {
+    return 1;
+  }
+  *payload_len = (size_t) decoded;
+
+  unsigned char hex[JWS_SIGNATURE_CHARS], signature[MAX_SIGNATURE_LEN], hash[32];
+  long hex_len = base64_decode(b64_signature, b64_signature_len, hex);
+  if (hex_len <= 0 || hex_len % 2 != 0 || hex_len > 2 * MAX_SIGNATURE_LEN ||
+      !hex_decode((const char *) hex, (size_t) hex_len, signature)) {
+    return 1;
+  }
+  sha256((const unsigned char *) token, signing_len, hash);
+  return recover_public_key_cached(ctx, signature, (size_t) hex_len / 2, hash, pubkey);
+}
+
+static void jws_verify_worker(void *data, const secp256k1_context *ctx, R_xlen_t begin, R_xlen_t end) {
+  jws_verify_batch *batch = (jws_verify_batch *) data;
+  unsigned char pubkey[33], id[ACCOUNT_ID_BYTES];
+  for (R_xlen_t i = begin; i < end; i++) {
+    if (batch->tokens[i] == NULL) {
+      continue;
+    }
+    batch->status[i] = verify_token(ctx, batch->tokens[i], batch->token_lens[i], batch->payloads + batch->offsets[i],
+                                    &batch->payload_lens[i], pubkey);
+    if (batch->status[i] != 0) {
+      continue;
+    }
+    char *key = batch->keys + i * 2 * 33;
+    if (batch->account_ids) {
+      account_id_bytes(pubkey, 33, id);
+      batch->key_lens[i] = (int) base58_encode(id, ACCOUNT_ID_BYTES, key);
+    } else {
+      bytes_to_hex(pubkey, 33, key);
+      batch->key_lens[i] = 66;
+    }
+  }
+}
+
+// Verify every token of tokens_r by recovering its signer. Returns a list of
+// the payloads and the compressed public keys in hex (or the account IDs),
+// with NA for tokens that are NA, malformed or not signed with the header.
+SEXP jws_verify_R(SEXP tokens_r, SEXP account_ids_r, SEXP n_threads_R) {
+  if (TYPEOF(tokens_r) != STRSXP) {
+    error("Tokens must be a character vector.");
+  }
+  R_xlen_t n = XLENGTH(tokens_r);
+  jws_verify_batch batch;
+  batch.tokens = (const char **) R_alloc(n + 1, sizeof(char *));
+  batch.token_lens = (size_t *) R_alloc(n + 1, sizeof(size_t));
+  batch.account_ids = asLogical(account_ids_r) == TRUE;
+  batch.payload_lens = (size_t *) R_alloc(n + 1, sizeof(size_t));
+  batch.keys = R_alloc(n + 1, 2 * 33);
+  batch.key_lens = (int *) R_alloc(n + 1, sizeof(int));
+  batch.status = (int *) R_alloc(n + 1, sizeof(int));
+  size_t *lens = (size_t *) batch.token_lens;
+  size_t *offsets = (size_t *) R_alloc(n + 1, sizeof(size_t));
+  size_t total = 0;
+  for (R_xlen_t i = 0; i < n; i++) {
+    SEXP s = STRING_ELT(tokens_r, i);
+    batch.tokens[i] = NULL;
+    batch.status[i] = 1;
+    offsets[i] = total;
+    if (s != NA_STRING) {
+      batch.tokens[i] = CHAR(s);
+      lens[i] = (size_t) LENGTH(s);
+      total += lens[i];
+    }
+  }
+  batch.offsets = offsets;
+  batch.payloads = (unsigned char *) R_alloc(total + 1, 1);
+  parallel_for(n, asInteger(n_threads_R), jws_verify_worker, &batch, 1);
+
+  SEXP payloads = PROTECT(allocVector(STRSXP, n));
+  SEXP keys = PROTECT(allocVector(STRSXP, n));
+  for (R_xlen_t i = 0; i < n; i++) {
+    if (batch.status[i] != 0) {
+      SET_STRING_ELT(payloads, i, NA_STRING);
+      SET_STRING_ELT(keys, i, NA_STRING);
+      continue;
+    }
+    SET_STRING_ELT(payloads, i, mkCharLenCE((const char *) batch.payloads + offsets[i], (int) batch.payload_lens[i],
+                                            CE_UTF8));
+    SET_STRING_ELT(keys, i, mkCharLen(batch.keys + i * 2 * 33, batch.key_lens[i]));
+  }
+  SEXP result = PROTECT(allocVector(VECSXP, 2));
+  SET_VECTOR_ELT(result, 0, payloads);
+  SET_VECTOR_ELT(result, 1, keys);
+  UNPROTECT(3);
+  return result;
+}
@@ -0,0 +1,157 @@
+#include <R.h>
+#include <Rinternals.h>
+#include <string.h>
+#include <stdlib.h>
+#include "flureeCrypto.h"
+
+
+// Parsed keys held by R external pointers, so long-lived keys are decoded
+// and validated once instead of on every call. The structs live in malloc'ed
+// memory that is wiped before it is freed.
+
+static SEXP private_key_tag() {
+  return install("flureeCrypto_private_key");
+}
+
+static SEXP public_key_tag() {
+  return install("flureeCrypto_public_key");
+}
+
+static void key_handle_finalizer(SEXP ptr) {
+  void *handle = R_ExternalPtrAddr(ptr);
+  if (handle != NULL) {
+    size_t size = (R_ExternalPtrTag(ptr) == private_key_tag()) ? sizeof(private_key_handle) : sizeof(public_key_handle);
+    secure_wipe(handle, size);
+    free(handle);
+    R_ClearExternalPtr(ptr);
+  }
+}
+
+// An external pointer with the finalizer already registered, for a handle
+// of size bytes that is allocated and filled afterwards: from
+// R_SetExternalPtrAddr() on, the finalizer wipes and frees it even if R
+// longjmps away. Returned protected.
+static SEXP new_handle_ptr(SEXP tag, size_t size, void **handle) {
+  SEXP ptr = PROTECT(R_MakeExternalPtr(NULL, tag, R_NilValue));
+  R_RegisterCFinalizerEx(ptr, key_handle_finalizer, TRUE);
+  *handle = calloc(1, size);
+  if (*handle == NULL) {
+    error("Failed to allocate a key handle");
+  }
+  R_SetExternalPtrAddr(ptr, *handle);
+  return ptr;
+}
+
+static void* handle_address(SEXP x) {
+  void *handle = R_ExternalPtrAddr(x);
+  if (handle == NULL) {
+    error("The key handle is no longer valid; load the key again.");
+  }
+  return handle;
+}
+
+// The private key behind a handle, or NULL if x is not a private key handle
+const private_key_handle* private_key_handle_from_R(SEXP x) {
+  if (TYPEOF(x) != EXTPTRSXP || R_ExternalPtrTag(x) != private_key_tag()) {
+    return NULL;
+  }
+  return (const private_key_handle *) handle_address(x);
+}
+
+// The public key behind a public or private key handle, or NULL if x is not
+// a key handle
+const public_key_handle* public_key_handle_from_R(SEXP x) {
+  if (TYPEOF(x) != EXTPTRSXP) {
+    return NULL;
+  }
+  if (R_ExternalPtrTag(x) == private_key_tag()) {
+    return &((const private_key_handle *) handle_address(x))->pub;
+  }
+  if (R_ExternalPtrTag(x) == public_key_tag()) {
+    return (const public_key_handle *) handle_address(x);
+  }
+  return NULL;
+}
+
+// The 32 bytes of a private key given as a handle, a raw vector or a
+// 64-character hex string (decoded into decoded, which the caller wipes),
+// or NULL if priv_key_r is none of these
+const unsigned char* private_key_bytes_R(SEXP priv_key_r, unsigned char decoded[32]) {
+  const private_key_handle *handle = private_key_handle_from_R(priv_key_r);
+  if (handle != NULL) {
+    return handle->seckey;
+  }
+  if (TYPEOF(priv_key_r) == RAWSXP && XLENGTH(priv_key_r) == 32) {
+    return RAW(priv_key_r);
+  }
+  if (TYPEOF(priv_key_r) == STRSXP && XLENGTH(priv_key_r) == 1 && STRING_ELT(priv_key_r, 0) != NA_STRING &&
+      LENGTH(STRING_ELT(priv_key_r, 0)) == 64 && hex_decode(CHAR(STRING_ELT(priv_key_r, 0)), 64, decoded)) {
+    return decoded;
+  }
+  return NULL;
+}
+
+static void set_public(const secp256k1_context *ctx, public_key_handle *pub) {
+  size_t len = 33;
+  secp256k1_ec_pubkey_serialize(ctx, pub->compressed, &len, &pub->pubkey, SECP256K1_EC_COMPRESSED);
+}
+
+
+// Load a 32-byte private key into a handle holding the key, its keypair and
+// its public key
+SEXP load_private_key_R(SEXP seckey_r) {
+  if (TYPEOF(seckey_r) != RAWSXP || XLENGTH(seckey_r) != 32) {
+    error("Private key must be a 32-byte raw vector");
+  }
+  secp256k1_context *ctx = get_context();
+  if (!secp256k1_ec_seckey_verify(ctx, RAW(seckey_r))) {
+    error("Invalid private key");
+  }
+
+  void *mem;
+  SEXP ptr = new_handle_ptr(private_key_tag(), sizeof(private_key_handle), &mem);
+  private_key_handle *handle = (private_key_handle *) mem;
+  memcpy(handle->seckey, RAW(seckey_r), 32);
+  if (!secp256k1_keypair_create(ctx, &handle->keypair, handle->seckey) ||
+      !secp256k1_keypair_pub(ctx, &handle->pub.pubkey, &handle->keypair)) {
+    error("Failed to create public key");  // the finalizer wipes the handle
+  }
+  set_public(ctx, &handle->pub);
+  UNPROTECT(1);
+  return ptr;
+}
+
+// Load a 33- or 65-byte public key, or the public half of a private key
+// handle, into a public key handle. The key is parsed before the handle is
+// allocated.
+SEXP load_public_key_R(SEXP pubkey_r) {
+  public_key_handle parsed;
+  const public_key_handle *existing = public_key_handle_from_R(pubkey_r);
+  if (existing != NULL) {
+    memcpy(&parsed, existing, sizeof(public_key_handle));
+  } else if (TYPEOF(pubkey_r) != RAWSXP || (XLENGTH(pubkey_r) != 33 && XLENGTH(pubkey_r) != 65)) {
+    error("Public key must be a 33- or 65-byte raw vector");
+  } else if (!secp256k1_ec_pubkey_parse(get_context(), &parsed.pubkey, RAW(pubkey_r), (size_t) XLENGTH(pubkey_r))) {
+    error("Invalid public key");
+  } else {
+    set_public(get_context(), &parsed);
+  }
+
+  void *handle;
+  SEXP ptr = new_handle_ptr(public_key_tag(), sizeof(public_key_handle), &handle);
+  memcpy(handle, &parsed, sizeof(public_key_handle));
+  UNPROTECT(1);
+  return ptr;
+}
+
+// The compressed public key of a key handle
+SEXP key_handle_public_R(SEXP ptr) {
+  const public_key_handle *handle = public_key_handle_from_R(ptr);
+  if (handle == NULL) {
+    error("Not a key handle.");
+  }
+  SEXP result = PROTECT(allocVector(RAWSXP, 33));
+  memcpy(RAW(result), handle->compressed, 33);
+  UNPROTECT(1);
+  return result;
+}
@@ -0,0 +1,91 @@
+#include <R.h>
+#include <Rinternals.h>
+#include <string.h>
+#include <stdint.h>
+#include "flureeCrypto.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+
+// A quick check for strings that NFKC leaves as they are, so normalize_string()
+// only hands the others to ICU. ASCII is always in NFKC; so are the Latin-1
+// letters and symbols other than those with a compatibility decomposition,
+// and none of them combine with one another. Anything else, including
+// strings that may be marked as UTF-8 but are not, takes the ICU path.
+
+// Code points U+0080 to U+00BF (the second byte after 0xC2) that NFKC
+// changes: U+00A0, A8, AA, AF, B2-B5, B8-BA and BC-BE
+static const uint64_t nfkc_unstable_c2 = 0x773c850100000000ULL;
+
+// The length of the leading run of ASCII bytes, scanned 16 bytes at a time
+static size_t ascii_run(const unsigned char *s, size_t len) {
+  size_t i = 0;
+#if defined(__SSE2__)
+  for (; i + 16 <= len; i += 16) {
+    int mask = _mm_movemask_epi8(_mm_loadu_si128((const __m128i *) (s + i)));
+    if (mask != 0) {
+      return i + (size_t) __builtin_ctz((unsigned int) mask);
+    }
+  }
+#elif defined(__aarch64__)
+  for (; i + 16 <= len; i += 16) {
+    if (vmaxvq_u8(vld1q_u8(s + i)) >= 0x80) {
+      break;
+    }
+  }
+#endif
+  for (; i + 8 <= len; i += 8) {
+    uint64_t w;
+    memcpy(&w, s + i, 8);
+    if (w & 0x8080808080808080ULL) {
+      break;
+    }
+  }
+  while (i < len && s[i] < 0x80) {
+    i++;
+  }
+  return i;
+}
+
+// 1 if NFKC leaves the string unchanged; utf8 says whether bytes above
+// 0x7F may be read as UTF-8
+static int nfkc_quick_check(const unsigned char *s, size_t len, int utf8) {
+  size_t i = ascii_run(s, len);
+  while (i < len) {
+    if (!utf8 || i + 1 >= len) {
+      return 0;
+    }
+    unsigned char lead = s[i], cont = s[i + 1];
+    if ((lead != 0xc2 && lead != 0xc3) || (cont & 0xc0) != 0x80) {
+      return 0;
+    }
+    if (lead == 0xc2 && ((nfkc_unstable_c2 >> (cont - 0x80)) & 1)) {
+      return 0;
+    }
+    i += 2;
+    i += ascii_run(s + i, len - i);
+  }
+  return 1;
+}
+
+// TRUE for each string of a character vector (and each NA) that is already
+// in NFKC by the quick check, FALSE for those that need normalizing
+SEXP nfkc_quick_check_R(SEXP x) {
+  if (TYPEOF(x) != STRSXP) {
+    error("Input must be a character vector.");
+  }
+  R_xlen_t n = XLENGTH(x);
+  SEXP result = PROTECT(allocVector(LGLSXP, n));
+  int *stable = LOGICAL(result);
+  for (R_xlen_t i = 0; i < n; i++) {
+    SEXP s = STRING_ELT(x, i);
+    stable[i] = (s == NA_STRING) ||
+      nfkc_quick_check((const unsigned char *) CHAR(s), (size_t) LENGTH(s), getCharCE(s) == CE_UTF8);
+  }
+  UNPROTECT(1);
+  return result;
+}
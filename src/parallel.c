@@ -0,0 +1,79 @@
+#include <R.h>
+#include <Rinternals.h>
+#include <pthread.h>
+#include "flureeCrypto.h"
+
+
+// One contiguous slice of the items of a parallel call
+typedef struct {
+  parallel_fn fn;
+  void *data;
+  const secp256k1_context *ctx;
+  R_xlen_t begin;
+  R_xlen_t end;
+} parallel_chunk;
+
+
+static void* run_chunk(void *arg) {
+  parallel_chunk *chunk = (parallel_chunk *) arg;
+  chunk->fn(chunk->data, chunk->ctx, chunk->begin, chunk->end);
+  return NULL;
+}
+
+
+// Split n items into n_threads contiguous chunks and process them on native
+// threads. The calling thread works on the first chunk itself. If a thread
+// cannot be started its chunk is run on the calling thread instead, so the
+// result never depends on how many threads were actually available.
+void parallel_for(R_xlen_t n, int n_threads, parallel_fn fn, void *data, int use_context) {
+  if (n <= 0) {
+    return;
+  }
+  if (n_threads == NA_INTEGER || n_threads < 1) {
+    n_threads = 1;
+  }
+  if (n_threads > MAX_THREADS) {
+    n_threads = MAX_THREADS;
+  }
+  if ((R_xlen_t) n_threads > n) {
+    n_threads = (int) n;
+  }
+  
+  // Contexts are set up here because get_worker_context() may call into R
+  parallel_chunk *chunks = (parallel_chunk *) R_alloc(n_threads, sizeof(parallel_chunk));
+  R_xlen_t chunk_size = n / n_threads;
+  R_xlen_t remainder = n % n_threads;
+  R_xlen_t begin = 0;
+  for (int t = 0; t < n_threads; t++) {
+    chunks[t].fn = fn;
+    chunks[t].data = data;
+    chunks[t].ctx = NULL;
+    if (use_context) {
+      chunks[t].ctx = (n_threads == 1) ? get_context() : get_worker_context(t);
+    }
+    chunks[t].begin = begin;
+    begin += chunk_size + (t < remainder ? 1 : 0);
+    chunks[t].end = begin;
+  }
+  
+  if (n_threads == 1) {
+    run_chunk(&chunks[0]);
+    return;
+  }
+  
+  pthread_t *threads = (pthread_t *) R_alloc(n_threads, sizeof(pthread_t));
+  int *started = (int *) R_alloc(n_threads, sizeof(int));
+  for (int t = 1; t < n_threads; t++) {
+    started[t] = (pthread_create(&threads[t], NULL, run_chunk, &chunks[t]) == 0);
+  }
+  
+  run_chunk(&chunks[0]);
+  
+  for (int t = 1; t < n_threads; t++) {
+    if (started[t]) {
+      pthread_join(threads[t], NULL);
+    } else {
+      run_chunk(&chunks[t]);
+    }
+  }
+}
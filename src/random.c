@@ -0,0 +1,227 @@
+#include <R.h>
+#include <Rinternals.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "flureeCrypto.h"
+
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 25))
+#include <sys/random.h>
+#define HAVE_GETRANDOM 1
+#elif defined(__APPLE__) || defined(__OpenBSD__) || defined(__FreeBSD__) || defined(__NetBSD__)
+#define HAVE_ARC4RANDOM 1
+#endif
+
+// glibc removes the fork handlers of a library when it is unloaded, so one
+// can be registered for good; elsewhere forks are detected with getpid()
+#if defined(__GLIBC__)
+#define HAVE_FORK_HANDLER 1
+#endif
+
+
+// Bytes drawn from the operating system per refill
+#define POOL_SIZE 4096
+
+// Each thread keeps its own pool, so no locking is needed. Bytes are wiped
+// as soon as they have been handed out, and a pool inherited through fork()
+// is discarded because parent and child would otherwise share it. A pool
+// records the fork generation it was filled in: a counter a child handler
+// bumps, so drawing bytes costs no system call, or the process id.
+typedef struct {
+  unsigned char bytes[POOL_SIZE];
+  size_t pos;
+  unsigned long generation;
+} entropy_pool;
+
+static pthread_key_t pool_key;
+static pthread_once_t pool_key_once = PTHREAD_ONCE_INIT;
+static int pool_key_ready = 0;
+
+#ifdef HAVE_FORK_HANDLER
+static volatile unsigned long fork_generation = 0;
+static int fork_handler_ready = 0;
+
+static void count_fork() {
+  fork_generation++;
+}
+#endif
+
+static inline unsigned long current_generation() {
+#ifdef HAVE_FORK_HANDLER
+  if (fork_handler_ready) {
+    return fork_generation;
+  }
+#endif
+  return (unsigned long) getpid();
+}
+
+
+// Overwrite memory in a way the compiler cannot optimise away. With GCC and
+// clang an empty asm statement that may read the buffer keeps the memset
+// alive, which is much faster than storing through a volatile pointer.
+void secure_wipe(void *ptr, size_t len) {
+#if defined(__GNUC__)
+  memset(ptr, 0, len);
+  __asm__ __volatile__("" : : "r"(ptr) : "memory");
+#else
+  volatile unsigned char *p = (volatile unsigned char *) ptr;
+  while (len--) {
+    *p++ = 0;
+  }
+#endif
+}
+
+// Compare two byte strings in time that depends only on len. Returns 1 if
+// they are equal.
+int constant_time_equal(const unsigned char *a, const unsigned char *b, size_t len) {
+  volatile unsigned char diff = 0;
+  for (size_t i = 0; i < len; i++) {
+    diff |= a[i] ^ b[i];
+  }
+  return diff == 0;
+}
+
+static void destroy_pool(void *pool) {
+  secure_wipe(pool, sizeof(entropy_pool));
+  free(pool);
+}
+
+static void make_pool_key() {
+#ifdef HAVE_FORK_HANDLER
+  fork_handler_ready = (pthread_atfork(NULL, NULL, count_fork) == 0);
+#endif
+  pool_key_ready = (pthread_key_create(&pool_key, destroy_pool) == 0);
+}
+
+// Read len bytes from the operating system's CSPRNG
+static int os_random(unsigned char *out, size_t len) {
+#if defined(HAVE_ARC4RANDOM)
+  arc4random_buf(out, len);
+  return 1;
+#else
+#if defined(HAVE_GETRANDOM)
+  size_t done = 0;
+  while (done < len) {
+    ssize_t got = getrandom(out + done, len - done, 0);
+    if (got < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;  // e.g. ENOSYS on old kernels, fall back to /dev/urandom
+    }
+    done += (size_t) got;
+  }
+  if (done == len) {
+    return 1;
+  }
+#endif
+  int fd = open("/dev/urandom", O_RDONLY);
+  if (fd < 0) {
+    return 0;
+  }
+  size_t total = 0;
+  while (total < len) {
+    ssize_t got = read(fd, out + total, len - total);
+    if (got < 0 && errno == EINTR) {
+      continue;
+    }
+    if (got <= 0) {
+      break;
+    }
+    total += (size_t) got;
+  }
+  close(fd);
+  return total == len;
+#endif
+}
+
+static entropy_pool* get_pool() {
+  pthread_once(&pool_key_once, make_pool_key);
+  if (!pool_key_ready) {
+    return NULL;
+  }
+  entropy_pool *pool = (entropy_pool *) pthread_getspecific(pool_key);
+  if (pool == NULL) {
+    pool = (entropy_pool *) calloc(1, sizeof(entropy_pool));
+    if (pool == NULL) {
+      return NULL;
+    }
+    pool->pos = POOL_SIZE;  // empty, filled on first use
+    pool->generation = current_generation();
+    if (pthread_setspecific(pool_key, pool) != 0) {
+      free(pool);
+      return NULL;
+    }
+  }
+  return pool;
+}
+
+
+// Fill out with len cryptographically secure random bytes from the calling
+// thread's pool. Returns 1 on success and 0 if the operating system could
+// not provide entropy. Makes no R API calls, so it is safe on worker threads.
+int random_fill(unsigned char *out, size_t len) {
+  entropy_pool *pool = get_pool();
+  if (pool == NULL || len >= POOL_SIZE) {
+    return os_random(out, len);
+  }
+
+  // Never reuse bytes that were buffered before a fork
+  unsigned long generation = current_generation();
+  if (pool->generation != generation) {
+    secure_wipe(pool->bytes, POOL_SIZE);
+    pool->pos = POOL_SIZE;
+    pool->generation = generation;
+  }
+
+  while (len > 0) {
+    if (pool->pos == POOL_SIZE) {
+      if (!os_random(pool->bytes, POOL_SIZE)) {
+        return 0;
+      }
+      pool->pos = 0;
+    }
+    size_t take = POOL_SIZE - pool->pos;
+    if (take > len) {
+      take = len;
+    }
+    memcpy(out, pool->bytes + pool->pos, take);
+    secure_wipe(pool->bytes + pool->pos, take);
+    pool->pos += take;
+    out += take;
+    len -= take;
+  }
+  return 1;
+}
+
+// Called from R_unload_flureeCrypto: wipe the pool of the R thread
+void free_random_pool() {
+  if (!pool_key_ready) {
+    return;
+  }
+  entropy_pool *pool = (entropy_pool *) pthread_getspecific(pool_key);
+  if (pool != NULL) {
+    destroy_pool(pool);
+    pthread_setspecific(pool_key, NULL);
+  }
+  pthread_key_delete(pool_key);
+  pool_key_ready = 0;
+}
+
+
+SEXP random_bytes_R(SEXP size_r) {
+  double size = asReal(size_r);
+  if (ISNAN(size) || size < 0 || size > R_XLEN_T_MAX) {
+    error("Size must be a non-negative number.");
+  }
+
+  SEXP result = PROTECT(allocVector(RAWSXP, (R_xlen_t) size));
+  if (!random_fill(RAW(result), (size_t) size)) {
+    error("Failed to read random bytes from the operating system");
+  }
+
+  UNPROTECT(1);
+  return result;
+}
@@ -0,0 +1,217 @@
+#include <R.h>
+#include <Rinternals.h>
+#include <pthread.h>
+#include <string.h>
+#include <stdlib.h>
+#include "flureeCrypto.h"
+
+
+// An opt-in LRU cache of recovered public keys. Entries are keyed by the
+// SHA-256 of the signature and the message hash, so a hit is as trustworthy
+// as a fresh recovery. The cache is a fixed array of entries threaded on a
+// doubly linked recency list and chained into a power-of-two hash table.
+// Every access takes one mutex; the time it is held is negligible next to
+// the EC recovery a hit saves.
+
+#define CACHE_NONE -1
+
+typedef struct {
+  unsigned char key[32];
+  unsigned char pubkey[33];
+  int32_t prev;        // recency list, towards the most recently used entry
+  int32_t next;
+  int32_t chain;       // next entry in the same bucket
+} cache_entry;
+
+static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static cache_entry *entries = NULL;
+static int32_t *buckets = NULL;
+static int32_t capacity = 0;
+static int32_t bucket_mask = 0;
+static int32_t size = 0;
+static int32_t head = CACHE_NONE;   // most recently used
+static int32_t tail = CACHE_NONE;   // least recently used
+static uint64_t hits = 0;
+static uint64_t misses = 0;
+
+
+static void cache_key(const unsigned char *signature, size_t signature_len, const unsigned char *hash,
+                      unsigned char key[32]) {
+  sha256_ctx ctx;
+  unsigned char len_byte = (unsigned char) signature_len;
+  sha256_init(&ctx);
+  sha256_update(&ctx, &len_byte, 1);
+  sha256_update(&ctx, signature, signature_len);
+  sha256_update(&ctx, hash, 32);
+  sha256_final(&ctx, key);
+}
+
+static int32_t bucket_of(const unsigned char key[32]) {
+  uint32_t h;
+  memcpy(&h, key, 4);
+  return (int32_t) (h & (uint32_t) bucket_mask);
+}
+
+static void unlink_recency(int32_t i) {
+  cache_entry *e = &entries[i];
+  if (e->prev != CACHE_NONE) entries[e->prev].next = e->next; else head = e->next;
+  if (e->next != CACHE_NONE) entries[e->next].prev = e->prev; else tail = e->prev;
+}
+
+static void push_front(int32_t i) {
+  entries[i].prev = CACHE_NONE;
+  entries[i].next = head;
+  if (head != CACHE_NONE) entries[head].prev = i;
+  head = i;
+  if (tail == CACHE_NONE) tail = i;
+}
+
+static void unlink_bucket(int32_t i) {
+  int32_t *link = &buckets[bucket_of(entries[i].key)];
+  while (*link != i) {
+    link = &entries[*link].chain;
+  }
+  *link = entries[i].chain;
+}
+
+static int32_t find(const unsigned char key[32]) {
+  for (int32_t i = buckets[bucket_of(key)]; i != CACHE_NONE; i = entries[i].chain) {
+    if (memcmp(entries[i].key, key, 32) == 0) {
+      return i;
+    }
+  }
+  return CACHE_NONE;
+}
+
+// Drop every entry. The caller holds the lock.
+static void clear_entries() {
+  size = 0;
+  head = tail = CACHE_NONE;
+  if (buckets != NULL) {
+    for (int32_t b = 0; b <= bucket_mask; b++) {
+      buckets[b] = CACHE_NONE;
+    }
+  }
+}
+
+
+// recover_public_key() with the cache in front of it. Only successful
+// recoveries are stored. Safe on worker threads.
+int recover_public_key_cached(const secp256k1_context *ctx, const unsigned char *signature, size_t signature_len,
+                              const unsigned char *hash, unsigned char *pubkey_output) {
+  if (__atomic_load_n(&capacity, __ATOMIC_RELAXED) == 0) {
+    return recover_public_key(ctx, signature, signature_len, hash, pubkey_output);
+  }
+
+  unsigned char key[32];
+  cache_key(signature, signature_len, hash, key);
+
+  pthread_mutex_lock(&cache_lock);
+  if (capacity > 0) {
+    int32_t i = find(key);
+    if (i != CACHE_NONE) {
+      memcpy(pubkey_output, entries[i].pubkey, 33);
+      unlink_recency(i);
+      push_front(i);
+      hits++;
+      pthread_mutex_unlock(&cache_lock);
+      return 0;
+    }
+    misses++;
+  }
+  pthread_mutex_unlock(&cache_lock);
+
+  int status = recover_public_key(ctx, signature, signature_len, hash, pubkey_output);
+  if (status != 0) {
+    return status;
+  }
+
+  pthread_mutex_lock(&cache_lock);
+  // Another thread may have stored the same key, or the cache been resized
+  if (capacity > 0 && find(key) == CACHE_NONE) {
+    int32_t i;
+    if (size < capacity) {
+      i = size++;
+    } else {
+      i = tail;
+      unlink_recency(i);
+      unlink_bucket(i);
+    }
+    memcpy(entries[i].key, key, 32);
+    memcpy(entries[i].pubkey, pubkey_output, 33);
+    int32_t b = bucket_of(key);
+    entries[i].chain = buckets[b];
+    buckets[b] = i;
+    push_front(i);
+  }
+  pthread_mutex_unlock(&cache_lock);
+  return 0;
+}
+
+
+// Set the maximum number of cached keys, 0 to disable the cache. Resizing
+// drops all entries and resets the counters.
+SEXP recovery_cache_configure_R(SEXP capacity_r) {
+  int new_capacity = asInteger(capacity_r);
+  if (new_capacity == NA_INTEGER || new_capacity < 0) {
+    error("Capacity must be a non-negative integer.");
+  }
+
+  cache_entry *new_entries = NULL;
+  int32_t *new_buckets = NULL;
+  int32_t new_mask = 0;
+  if (new_capacity > 0) {
+    int32_t n_buckets = 1;
+    while (n_buckets < new_capacity && n_buckets < (1 << 30)) {
+      n_buckets <<= 1;
+    }
+    new_mask = n_buckets - 1;
+    new_entries = (cache_entry *) malloc((size_t) new_capacity * sizeof(cache_entry));
+    new_buckets = (int32_t *) malloc((size_t) n_buckets * sizeof(int32_t));
+    if (new_entries == NULL || new_buckets == NULL) {
+      free(new_entries);
+      free(new_buckets);
+      error("Failed to allocate a cache of %d entries", new_capacity);
+    }
+  }
+
+  pthread_mutex_lock(&cache_lock);
+  cache_entry *old_entries = entries;
+  int32_t *old_buckets = buckets;
+  entries = new_entries;
+  buckets = new_buckets;
+  bucket_mask = new_mask;
+  clear_entries();
+  hits = misses = 0;
+  __atomic_store_n(&capacity, (int32_t) new_capacity, __ATOMIC_RELAXED);
+  pthread_mutex_unlock(&cache_lock);
+
+  free(old_entries);
+  free(old_buckets);
+  return ScalarInteger(new_capacity);
+}
+
+// Drop all cached keys, keeping the capacity and the counters
+SEXP recovery_cache_flush_R() {
+  pthread_mutex_lock(&cache_lock);
+  clear_entries();
+  pthread_mutex_unlock(&cache_lock);
+  return R_NilValue;
+}
+
+SEXP recovery_cache_stats_R() {
+  pthread_mutex_lock(&cache_lock);
+  double values[4] = {(double) capacity, (double) size, (double) hits, (double) misses};
+  pthread_mutex_unlock(&cache_lock);
+
+  const char *names[4] = {"capacity", "entries", "hits", "misses"};
+  SEXP result = PROTECT(allocVector(REALSXP, 4));
+  SEXP result_names = PROTECT(allocVector(STRSXP, 4));
+  for (int i = 0; i < 4; i++) {
+    REAL(result)[i] = values[i];
+    SET_STRING_ELT(result_names, i, mkChar(names[i]));
+  }
+  setAttrib(result, R_NamesSymbol, result_names);
+  UNPROTECT(2);
+  return result;
+}
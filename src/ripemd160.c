@@ -0,0 +1,141 @@
+#include <R.h>
+#include <Rinternals.h>
+#include <string.h>
+#include <stdint.h>
+#include "flureeCrypto.h"
+
+
+// Message word selection and rotation amounts of the left and right lines
+static const unsigned char rmd_r[80] = {
+  0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+  7, 4, 13, 1, 10, 6, 15, 3, 12, 0, 9, 5, 2, 14, 11, 8,
+  3, 10, 14, 4, 9, 15, 8, 1, 2, 7, 0, 6, 13, 11, 5, 12,
+  1, 9, 11, 10, 0, 8, 12, 4, 13, 3, 7, 15, 14, 5, 6, 2,
+  4, 0, 5, 9, 7, 12, 2, 10, 14, 1, 3, 8, 11, 6, 15, 13
+};
+static const unsigned char rmd_rp[80] = {
+  5, 14, 7, 0, 9, 2, 11, 4, 13, 6, 15, 8, 1, 10, 3, 12,
+  6, 11, 3, 7, 0, 13, 5, 10, 14, 15, 8, 12, 4, 9, 1, 2,
+  15, 5, 1, 3, 7, 14, 6, 9, 11, 8, 12, 2, 10, 0, 4, 13,
+  8, 6, 4, 1, 3, 11, 15, 0, 5, 12, 2, 13, 9, 7, 10, 14,
+  12, 15, 10, 4, 1, 5, 8, 7, 6, 2, 13, 14, 0, 3, 9, 11
+};
+static const unsigned char rmd_s[80] = {
+  11, 14, 15, 12, 5, 8, 7, 9, 11, 13, 14, 15, 6, 7, 9, 8,
+  7, 6, 8, 13, 11, 9, 7, 15, 7, 12, 15, 9, 11, 7, 13, 12,
+  11, 13, 6, 7, 14, 9, 13, 15, 14, 8, 13, 6, 5, 12, 7, 5,
+  11, 12, 14, 15, 14, 15, 9, 8, 9, 14, 5, 6, 8, 6, 5, 12,
+  9, 15, 5, 11, 6, 8, 13, 12, 5, 12, 13, 14, 11, 8, 5, 6
+};
+static const unsigned char rmd_sp[80] = {
+  8, 9, 9, 11, 13, 15, 15, 5, 7, 7, 8, 11, 14, 14, 12, 6,
+  9, 13, 15, 7, 12, 8, 9, 11, 7, 7, 12, 7, 6, 15, 13, 11,
+  9, 7, 15, 11, 8, 6, 6, 14, 12, 13, 5, 14, 13, 13, 7, 5,
+  15, 5, 8, 11, 14, 14, 6, 14, 6, 9, 12, 9, 12, 5, 15, 8,
+  8, 5, 12, 9, 12, 5, 14, 6, 8, 13, 6, 5, 15, 13, 11, 11
+};
+static const uint32_t rmd_k[5] = {0x00000000, 0x5a827999, 0x6ed9eba1, 0x8f1bbcdc, 0xa953fd4e};
+static const uint32_t rmd_kp[5] = {0x50a28be6, 0x5c4dd124, 0x6d703ef3, 0x7a6d76e9, 0x00000000};
+
+#define ROTL32(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+// The five boolean functions, f(0) for the first 16 steps onwards
+static inline uint32_t rmd_f(int j, uint32_t x, uint32_t y, uint32_t z) {
+  switch (j) {
+  case 0: return x ^ y ^ z;
+  case 1: return (x & y) | (~x & z);
+  case 2: return (x | ~y) ^ z;
+  case 3: return (x & z) | (y & ~z);
+  default: return x ^ (y | ~z);
+  }
+}
+
+static inline uint32_t load_le32(const unsigned char *p) {
+  return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static void ripemd160_blocks(uint32_t h[5], const unsigned char *data, size_t nblocks) {
+  uint32_t x[16];
+  while (nblocks--) {
+    for (int i = 0; i < 16; i++) {
+      x[i] = load_le32(data + 4 * i);
+    }
+    uint32_t al = h[0], bl = h[1], cl = h[2], dl = h[3], el = h[4];
+    uint32_t ar = h[0], br = h[1], cr = h[2], dr = h[3], er = h[4];
+    for (int j = 0; j < 80; j++) {
+      int round = j / 16;
+      uint32_t t = ROTL32(al + rmd_f(round, bl, cl, dl) + x[rmd_r[j]] + rmd_k[round], rmd_s[j]) + el;
+      al = el; el = dl; dl = ROTL32(cl, 10); cl = bl; bl = t;
+      t = ROTL32(ar + rmd_f(4 - round, br, cr, dr) + x[rmd_rp[j]] + rmd_kp[round], rmd_sp[j]) + er;
+      ar = er; er = dr; dr = ROTL32(cr, 10); cr = br; br = t;
+    }
+    uint32_t t = h[1] + cl + dr;
+    h[1] = h[2] + dl + er;
+    h[2] = h[3] + el + ar;
+    h[3] = h[4] + al + br;
+    h[4] = h[0] + bl + cr;
+    h[0] = t;
+    data += 64;
+  }
+}
+
+
+void ripemd160_init(ripemd160_ctx *ctx) {
+  ctx->state[0] = 0x67452301;
+  ctx->state[1] = 0xefcdab89;
+  ctx->state[2] = 0x98badcfe;
+  ctx->state[3] = 0x10325476;
+  ctx->state[4] = 0xc3d2e1f0;
+  ctx->bytes = 0;
+  ctx->buffer_len = 0;
+}
+
+void ripemd160_update(ripemd160_ctx *ctx, const unsigned char *data, size_t len) {
+  ctx->bytes += len;
+  if (ctx->buffer_len > 0) {
+    size_t take = 64 - ctx->buffer_len;
+    if (take > len) {
+      take = len;
+    }
+    memcpy(ctx->buffer + ctx->buffer_len, data, take);
+    ctx->buffer_len += take;
+    data += take;
+    len -= take;
+    if (ctx->buffer_len < 64) {
+      return;
+    }
+    ripemd160_blocks(ctx->state, ctx->buffer, 1);
+    ctx->buffer_len = 0;
+  }
+  if (len >= 64) {
+    ripemd160_blocks(ctx->state, data, len / 64);
+    data += len & ~(size_t) 63;
+    len &= 63;
+  }
+  memcpy(ctx->buffer, data, len);
+  ctx->buffer_len = len;
+}
+
+// Same padding as SHA-256, but the length and the digest are little-endian
+void ripemd160_final(ripemd160_ctx *ctx, unsigned char out[20]) {
+  uint64_t bits = ctx->bytes * 8;
+  unsigned char pad[72] = {0x80};
+  size_t pad_len = (ctx->buffer_len < 56) ? 56 - ctx->buffer_len : 120 - ctx->buffer_len;
+  for (int i = 0; i < 8; i++) {
+    pad[pad_len + i] = (unsigned char) (bits >> (8 * i));
+  }
+  ripemd160_update(ctx, pad, pad_len + 8);
+  for (int i = 0; i < 5; i++) {
+    for (int b = 0; b < 4; b++) {
+      out[4 * i + b] = (unsigned char) (ctx->state[i] >> (8 * b));
+    }
+  }
+  secure_wipe(ctx, sizeof(*ctx));
+}
+
+void ripemd160(const unsigned char *data, size_t len, unsigned char out[20]) {
+  ripemd160_ctx ctx;
+  ripemd160_init(&ctx);
+  ripemd160_update(&ctx, data, len);
+  ripemd160_final(&ctx, out);
+}
@@ -0,0 +1,251 @@
+#include <R.h>
+#include <Rinternals.h>
+#include <string.h>
+#include <secp256k1_schnorrsig.h>
+#include "flureeCrypto.h"
+
+
+// BIP-340 Schnorr signatures over 32-byte message hashes with the
+// schnorrsig module. Signatures are a fixed 64 bytes, so batches are decoded
+// into one flat buffer without any DER parsing. Public keys are the 32-byte
+// x-only keys of BIP-340, or any compressed or uncompressed key (or key
+// handle), whose x coordinate is used.
+
+#define SCHNORR_SIG_LEN 64
+
+// Sign n concatenated 32-byte hashes with one private key (a handle, 32 raw
+// bytes or hex), each with fresh auxiliary randomness as BIP-340
+// recommends. Returns hex strings (output_hex_r TRUE) or a 64 x n raw matrix.
+SEXP schnorr_sign_R(SEXP hashes_r, SEXP priv_key_r, SEXP output_hex_r) {
+  if (TYPEOF(hashes_r) != RAWSXP || XLENGTH(hashes_r) % 32 != 0) {
+    error("Hashes must be a raw vector of concatenated 32-byte hashes.");
+  }
+  R_xlen_t n = XLENGTH(hashes_r) / 32;
+  int output_hex = asLogical(output_hex_r) == TRUE;
+  if (!output_hex && n > INT_MAX) {
+    error("Too many signatures for a raw matrix.");
+  }
+  secp256k1_context *ctx = get_context();
+
+  // A handle carries its keypair; other keys are turned into one here
+  secp256k1_keypair keypair;
+  const private_key_handle *handle = private_key_handle_from_R(priv_key_r);
+  if (handle != NULL) {
+    memcpy(&keypair, &handle->keypair, sizeof(keypair));
+  } else {
+    unsigned char decoded[32];
+    const unsigned char *priv_key = private_key_bytes_R(priv_key_r, decoded);
+    int valid = priv_key != NULL && secp256k1_keypair_create(ctx, &keypair, priv_key);
+    secure_wipe(decoded, sizeof(decoded));
+    if (!valid) {
+      secure_wipe(&keypair, sizeof(keypair));
+      error("Invalid private key");
+    }
+  }
+
+  SEXP result = PROTECT(output_hex ? allocVector(STRSXP, n) : allocMatrix(RAWSXP, SCHNORR_SIG_LEN, (int) n));
+  unsigned char aux[32], sig[SCHNORR_SIG_LEN];
+  char hex[2 * SCHNORR_SIG_LEN + 1];
+  for (R_xlen_t i = 0; i < n; i++) {
+    unsigned char *out = output_hex ? sig : RAW(result) + i * SCHNORR_SIG_LEN;
+    if (!random_fill(aux, sizeof(aux)) || !secp256k1_schnorrsig_sign32(ctx, out, RAW(hashes_r) + i * 32, &keypair, aux)) {
+      secure_wipe(&keypair, sizeof(keypair));
+      error("Failed to generate Schnorr signature for hash %lld", (long long) i + 1);
+    }
+    if (output_hex) {
+      bytes_to_hex(sig, SCHNORR_SIG_LEN, hex);
+      SET_STRING_ELT(result, i, mkCharLen(hex, 2 * SCHNORR_SIG_LEN));
+    }
+  }
+  secure_wipe(&keypair, sizeof(keypair));
+  secure_wipe(aux, sizeof(aux));
+  UNPROTECT(1);
+  return result;
+}
+
+
+// Parse a 32-byte x-only key or a 33- or 65-byte public key into its x-only
+// form, 1 on success. Safe on worker threads.
+static int parse_xonly(const secp256k1_context *ctx, const unsigned char *key, size_t len,
+                       secp256k1_xonly_pubkey *out) {
+  if (len == 32) {
+    return secp256k1_xonly_pubkey_parse(ctx, out, key);
+  }
+  secp256k1_pubkey pubkey;
+  return (len == 33 || len == 65) && secp256k1_ec_pubkey_parse(ctx, &pubkey, key, len) &&
+         secp256k1_xonly_pubkey_from_pubkey(ctx, out, NULL, &pubkey);
+}
+
+// The number of keys in hex strings, a list of raw vectors and key handles
+// or concatenated raw keys, which are 32-byte x-only keys or 33-byte
+// compressed keys depending on which one gives n or a single key
+static R_xlen_t xonly_key_count(SEXP pubkeys_R, R_xlen_t n, size_t *width) {
+  *width = 0;
+  switch (TYPEOF(pubkeys_R)) {
+  case STRSXP:
+  case VECSXP:
+    return XLENGTH(pubkeys_R);
+  case RAWSXP: {
+    R_xlen_t len = XLENGTH(pubkeys_R);
+    if (len == 32 || (n > 0 && len == 32 * n)) {
+      *width = 32;
+    } else if (len == 33 || (n > 0 && len == 33 * n)) {
+      *width = 33;
+    } else {
+      error("Raw public keys must be 32-byte x-only or 33-byte compressed keys, one per signature or one for all.");
+    }
+    return len / (R_xlen_t) *width;
+  }
+  default:
+    error("Public keys must be hexadecimal strings or raw vectors.");
+  }
+  return 0;  // not reached
+}
+
+// Point keys[i] at the bytes of the n keys counted by xonly_key_count(),
+// decoding hex into R_alloc'ed memory. status[i] is 1 for keys that are
+// missing, not hex or of a length that is not a key.
+static void decode_xonly_keys(SEXP pubkeys_R, R_xlen_t n, size_t width, const unsigned char **keys,
+                              size_t *key_lens, int *status) {
+  unsigned char *decoded = (TYPEOF(pubkeys_R) == STRSXP) ? (unsigned char *) R_alloc(n * MAX_PUBKEY_LEN + 1, 1) : NULL;
+  for (R_xlen_t i = 0; i < n; i++) {
+    key_lens[i] = 0;
+    if (TYPEOF(pubkeys_R) == RAWSXP) {
+      keys[i] = RAW(pubkeys_R) + i * width;
+      key_lens[i] = width;
+    } else if (TYPEOF(pubkeys_R) == VECSXP) {
+      SEXP el = VECTOR_ELT(pubkeys_R, i);
+      const public_key_handle *handle = public_key_handle_from_R(el);
+      if (handle != NULL) {
+        keys[i] = handle->compressed;
+        key_lens[i] = 33;
+      } else if (TYPEOF(el) == RAWSXP) {
+        keys[i] = RAW(el);
+        key_lens[i] = (size_t) XLENGTH(el);
+      }
+    } else {
+      SEXP hex_r = STRING_ELT(pubkeys_R, i);
+      size_t hex_len = (hex_r == NA_STRING) ? 0 : (size_t) LENGTH(hex_r);
+      if (hex_len <= 2 * MAX_PUBKEY_LEN && hex_decode(CHAR(hex_r), hex_len, decoded + i * MAX_PUBKEY_LEN)) {
+        keys[i] = decoded + i * MAX_PUBKEY_LEN;
+        key_lens[i] = hex_len / 2;
+      }
+    }
+    status[i] = key_lens[i] != 32 && key_lens[i] != 33 && key_lens[i] != 65;
+  }
+}
+
+typedef struct {
+  const unsigned char *signatures;  // n concatenated 64-byte signatures
+  const unsigned char *hashes;      // n concatenated 32-byte hashes
+  const unsigned char **keys;       // n keys, or NULL when one key is shared
+  const size_t *key_lens;
+  const secp256k1_xonly_pubkey *shared_key;
+  int *status;                      // in: 0 if the inputs decoded; out: 1 if valid
+} schnorr_batch;
+
+static void schnorr_verify_worker(void *data, const secp256k1_context *ctx, R_xlen_t begin, R_xlen_t end) {
+  schnorr_batch *batch = (schnorr_batch *) data;
+  for (R_xlen_t i = begin; i < end; i++) {
+    if (batch->status[i] != 0) {
+      batch->status[i] = 0;
+      continue;
+    }
+    secp256k1_xonly_pubkey parsed;
+    const secp256k1_xonly_pubkey *pubkey = batch->shared_key;
+    if (pubkey == NULL) {
+      if (!parse_xonly(ctx, batch->keys[i], batch->key_lens[i], &parsed)) {
+        continue;
+      }
+      pubkey = &parsed;
+    }
+    batch->status[i] = secp256k1_schnorrsig_verify(ctx, batch->signatures + i * SCHNORR_SIG_LEN,
+                                                   batch->hashes + i * 32, 32, pubkey);
+  }
+}
+
+// Verify many (signature, hash) pairs against public keys, one per
+// signature or a single key (possibly a key handle) for all, spread across
+// n_threads worker threads. Signatures are hex strings or concatenated
+// 64-byte raw signatures. Returns a logical vector; malformed keys or
+// signatures are FALSE.
+SEXP schnorr_verify_R(SEXP pubkeys_R, SEXP signatures_R, SEXP hashes_R, SEXP n_threads_R) {
+  R_xlen_t n;
+  if (TYPEOF(signatures_R) == STRSXP) {
+    n = XLENGTH(signatures_R);
+  } else if (TYPEOF(signatures_R) == RAWSXP && XLENGTH(signatures_R) % SCHNORR_SIG_LEN == 0) {
+    n = XLENGTH(signatures_R) / SCHNORR_SIG_LEN;
+  } else {
+    error("Signatures must be hexadecimal strings or concatenated 64-byte raw signatures.");
+  }
+  if (TYPEOF(hashes_R) != RAWSXP || XLENGTH(hashes_R) != n * 32) {
+    error("Hashes must be a raw vector of one 32-byte hash per signature.");
+  }
+  int n_threads = asInteger(n_threads_R);
+
+  const public_key_handle *handle = public_key_handle_from_R(pubkeys_R);
+  size_t width = 0;
+  R_xlen_t n_keys = handle ? 1 : xonly_key_count(pubkeys_R, n, &width);
+  if (n_keys != n && n_keys != 1) {
+    error("Provide one public key per signature or a single public key.");
+  }
+
+  // Hex signatures are decoded here, the workers must not touch R objects
+  int *status = (int *) R_alloc(n + 1, sizeof(int));
+  const unsigned char *signatures;
+  if (TYPEOF(signatures_R) == STRSXP) {
+    unsigned char *decoded = (unsigned char *) R_alloc(n * SCHNORR_SIG_LEN + 1, 1);
+    for (R_xlen_t i = 0; i < n; i++) {
+      SEXP hex_r = STRING_ELT(signatures_R, i);
+      status[i] = hex_r == NA_STRING || LENGTH(hex_r) != 2 * SCHNORR_SIG_LEN ||
+                  !hex_decode(CHAR(hex_r), 2 * SCHNORR_SIG_LEN, decoded + i * SCHNORR_SIG_LEN);
+    }
+    signatures = decoded;
+  } else {
+    memset(status, 0, (size_t) n * sizeof(int));
+    signatures = RAW(signatures_R);
+  }
+
+  const unsigned char **keys = (const unsigned char **) R_alloc(n_keys + 1, sizeof(unsigned char *));
+  size_t *key_lens = (size_t *) R_alloc(n_keys + 1, sizeof(size_t));
+  int *key_status = (int *) R_alloc(n_keys + 1, sizeof(int));
+  if (handle == NULL) {
+    decode_xonly_keys(pubkeys_R, n_keys, width, keys, key_lens, key_status);
+  }
+
+  // A key shared by all signatures is parsed once, here
+  secp256k1_xonly_pubkey shared_key;
+  schnorr_batch batch;
+  batch.keys = NULL;
+  batch.key_lens = NULL;
+  batch.shared_key = NULL;
+  if (handle != NULL || n_keys == 1) {
+    int parsed = (handle != NULL)
+      ? secp256k1_xonly_pubkey_from_pubkey(get_context(), &shared_key, NULL, &handle->pubkey)
+      : key_status[0] == 0 && parse_xonly(get_context(), keys[0], key_lens[0], &shared_key);
+    if (!parsed) {
+      for (R_xlen_t i = 0; i < n; i++) {
+        status[i] = 1;
+      }
+    }
+    batch.shared_key = &shared_key;
+  } else {
+    for (R_xlen_t i = 0; i < n; i++) {
+      status[i] |= key_status[i];
+    }
+    batch.keys = keys;
+    batch.key_lens = key_lens;
+  }
+
+  batch.signatures = signatures;
+  batch.hashes = RAW(hashes_R);
+  batch.status = status;
+  parallel_for(n, n_threads, schnorr_verify_worker, &batch, 1);
+
+  SEXP result = PROTECT(allocVector(LGLSXP, n));
+  for (R_xlen_t i = 0; i < n; i++) {
+    LOGICAL(result)[i] = status[i];
+  }
+  UNPROTECT(1);
+  return result;
+}
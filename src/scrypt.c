@@ -0,0 +1,513 @@
+#include <R.h>
+#include <Rinternals.h>
+#include <pthread.h>
+#include <string.h>
+#include <stdlib.h>
+#include "flureeCrypto.h"
+
+#if defined(__SSE2__) && !defined(SCRYPT_NO_SSE2)
+#include <emmintrin.h>
+#define SCRYPT_SSE2 1
+#endif
+
+
+// scrypt (RFC 7914). ROMix needs 128 * r * N bytes per lane, 32 MiB with the
+// package defaults, so the scratch memory comes from a pool of arenas that
+// outlive the call: a worker takes an arena, grows it if needed, and hands
+// it back wiped. The pool keeps at most SCRYPT_POOL_BYTES in all, so the
+// memory of a call with a large N, r or p is freed when the call ends.
+// Lanes (p > 1) and the items of a batch run on worker threads, each with
+// its own arena.
+
+typedef struct {
+  unsigned char *mem;
+  size_t size;
+} scrypt_arena;
+
+static pthread_mutex_t arena_lock = PTHREAD_MUTEX_INITIALIZER;
+static scrypt_arena idle_arenas[MAX_THREADS];
+static int n_idle = 0;
+static size_t idle_bytes = 0;
+
+// Eight lanes at the package defaults (N = 32768, r = 8)
+#define SCRYPT_POOL_BYTES ((size_t) 8 * 128 * 8 * 32768)
+
+// Take an idle arena of at least size bytes, 64-byte aligned. Returns 0 with
+// arena->mem NULL if the memory cannot be allocated.
+static int arena_acquire(scrypt_arena *arena, size_t size) {
+  arena->mem = NULL;
+  arena->size = 0;
+  pthread_mutex_lock(&arena_lock);
+  if (n_idle > 0) {
+    *arena = idle_arenas[--n_idle];
+    idle_bytes -= arena->size;
+  }
+  pthread_mutex_unlock(&arena_lock);
+
+  if (arena->size < size) {
+    free(arena->mem);
+    void *mem = NULL;
+    if (posix_memalign(&mem, 64, size) != 0) {
+      arena->mem = NULL;
+      arena->size = 0;
+      return 0;
+    }
+    arena->mem = (unsigned char *) mem;
+    arena->size = size;
+  }
+  return 1;
+}
+
+// Wipe the used part of an arena and return it to the pool, or free it
+// when the pool would hold more than SCRYPT_POOL_BYTES with it
+static void arena_release(scrypt_arena *arena, size_t used) {
+  if (arena->mem == NULL) {
+    return;
+  }
+  secure_wipe(arena->mem, used);
+  pthread_mutex_lock(&arena_lock);
+  if (n_idle < MAX_THREADS && arena->size <= SCRYPT_POOL_BYTES - idle_bytes) {
+    idle_arenas[n_idle++] = *arena;
+    idle_bytes += arena->size;
+    arena->mem = NULL;
+  }
+  pthread_mutex_unlock(&arena_lock);
+  free(arena->mem);
+}
+
+// Free the idle arenas, on unload or at the user's request
+void free_scrypt_arenas() {
+  pthread_mutex_lock(&arena_lock);
+  while (n_idle > 0) {
+    free(idle_arenas[--n_idle].mem);
+  }
+  idle_bytes = 0;
+  pthread_mutex_unlock(&arena_lock);
+}
+
+
+static inline uint32_t load32_le(const unsigned char *p) {
+  return (uint32_t) p[0] | ((uint32_t) p[1] << 8) | ((uint32_t) p[2] << 16) | ((uint32_t) p[3] << 24);
+}
+
+static inline void store32_le(unsigned char *p, uint32_t v) {
+  p[0] = (unsigned char) v;
+  p[1] = (unsigned char) (v >> 8);
+  p[2] = (unsigned char) (v >> 16);
+  p[3] = (unsigned char) (v >> 24);
+}
+
+#define ROTL32(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+#ifdef SCRYPT_SSE2
+// The SSE2 core keeps each 64-byte block with its words permuted so that the
+// four rows of a Salsa20 diagonal are in one register (position i holds
+// word i * 5 mod 16 of the block). Blocks are permuted on the way into
+// ROMix and back on the way out; word 0, which integerify reads, stays put.
+#define SALSA_STEP(a, b, c, n) \
+  T = _mm_add_epi32(b, c); \
+  a = _mm_xor_si128(a, _mm_slli_epi32(T, n)); \
+  a = _mm_xor_si128(a, _mm_srli_epi32(T, 32 - n));
+
+static inline void salsa20_8_sse2(__m128i *X0, __m128i *X1, __m128i *X2, __m128i *X3) {
+  __m128i A = *X0, B = *X1, C = *X2, D = *X3, T;
+  for (int i = 0; i < 8; i += 2) {
+    // Columns
+    SALSA_STEP(B, A, D, 7)
+    SALSA_STEP(C, B, A, 9)
+    SALSA_STEP(D, C, B, 13)
+    SALSA_STEP(A, D, C, 18)
+    B = _mm_shuffle_epi32(B, 0x93);
+    C = _mm_shuffle_epi32(C, 0x4E);
+    D = _mm_shuffle_epi32(D, 0x39);
+    // Rows
+    SALSA_STEP(D, A, B, 7)
+    SALSA_STEP(C, D, A, 9)
+    SALSA_STEP(B, C, D, 13)
+    SALSA_STEP(A, B, C, 18)
+    B = _mm_shuffle_epi32(B, 0x39);
+    C = _mm_shuffle_epi32(C, 0x4E);
+    D = _mm_shuffle_epi32(D, 0x93);
+  }
+  *X0 = _mm_add_epi32(*X0, A);
+  *X1 = _mm_add_epi32(*X1, B);
+  *X2 = _mm_add_epi32(*X2, C);
+  *X3 = _mm_add_epi32(*X3, D);
+}
+
+// BlockMix (RFC 7914 section 4) of Bin XOR Bxor (Bxor may be NULL) into
+// Bout, with the output blocks already in the even-then-odd order
+static void blockmix_salsa8(const uint32_t *Bin, const uint32_t *Bxor, uint32_t *Bout, size_t r) {
+  const __m128i *in = (const __m128i *) Bin;
+  const __m128i *xr = (const __m128i *) Bxor;
+  __m128i *out = (__m128i *) Bout;
+  size_t last = 8 * r - 4;
+  __m128i X0 = in[last], X1 = in[last + 1], X2 = in[last + 2], X3 = in[last + 3];
+  if (xr != NULL) {
+    X0 = _mm_xor_si128(X0, xr[last]);
+    X1 = _mm_xor_si128(X1, xr[last + 1]);
+    X2 = _mm_xor_si128(X2, xr[last + 2]);
+    X3 = _mm_xor_si128(X3, xr[last + 3]);
+  }
+  for (size_t i = 0; i < 2 * r; i++) {
+    size_t k = 4 * i;
+    X0 = _mm_xor_si128(X0, in[k]);
+    X1 = _mm_xor_si128(X1, in[k + 1]);
+    X2 = _mm_xor_si128(X2, in[k + 2]);
+    X3 = _mm_xor_si128(X3, in[k + 3]);
+    if (xr != NULL) {
+      X0 = _mm_xor_si128(X0, xr[k]);
+      X1 = _mm_xor_si128(X1, xr[k + 1]);
+      X2 = _mm_xor_si128(X2, xr[k + 2]);
+      X3 = _mm_xor_si128(X3, xr[k + 3]);
+    }
+    salsa20_8_sse2(&X0, &X1, &X2, &X3);
+    __m128i *y = out + 4 * ((i & 1) ? r + i / 2 : i / 2);
+    y[0] = X0;
+    y[1] = X1;
+    y[2] = X2;
+    y[3] = X3;
+  }
+}
+
+static inline void load_block(uint32_t *X, const unsigned char *B) {
+  for (int i = 0; i < 16; i++) {
+    X[i] = load32_le(B + 4 * (i * 5 % 16));
+  }
+}
+
+static inline void store_block(unsigned char *B, const uint32_t *X) {
+  for (int i = 0; i < 16; i++) {
+    store32_le(B + 4 * (i * 5 % 16), X[i]);
+  }
+}
+
+#else
+static void salsa20_8(uint32_t B[16]) {
+  uint32_t x[16];
+  memcpy(x, B, 64);
+  for (int i = 0; i < 8; i += 2) {
+    // Columns
+    x[4] ^= ROTL32(x[0] + x[12], 7);   x[8] ^= ROTL32(x[4] + x[0], 9);
+    x[12] ^= ROTL32(x[8] + x[4], 13);  x[0] ^= ROTL32(x[12] + x[8], 18);
+    x[9] ^= ROTL32(x[5] + x[1], 7);    x[13] ^= ROTL32(x[9] + x[5], 9);
+    x[1] ^= ROTL32(x[13] + x[9], 13);  x[5] ^= ROTL32(x[1] + x[13], 18);
+    x[14] ^= ROTL32(x[10] + x[6], 7);  x[2] ^= ROTL32(x[14] + x[10], 9);
+    x[6] ^= ROTL32(x[2] + x[14], 13);  x[10] ^= ROTL32(x[6] + x[2], 18);
+    x[3] ^= ROTL32(x[15] + x[11], 7);  x[7] ^= ROTL32(x[3] + x[15], 9);
+    x[11] ^= ROTL32(x[7] + x[3], 13);  x[15] ^= ROTL32(x[11] + x[7], 18);
+    // Rows
+    x[1] ^= ROTL32(x[0] + x[3], 7);    x[2] ^= ROTL32(x[1] + x[0], 9);
+    x[3] ^= ROTL32(x[2] + x[1], 13);   x[0] ^= ROTL32(x[3] + x[2], 18);
+    x[6] ^= ROTL32(x[5] + x[4], 7);    x[7] ^= ROTL32(x[6] + x[5], 9);
+    x[4] ^= ROTL32(x[7] + x[6], 13);   x[5] ^= ROTL32(x[4] + x[7], 18);
+    x[11] ^= ROTL32(x[10] + x[9], 7);  x[8] ^= ROTL32(x[11] + x[10], 9);
+    x[9] ^= ROTL32(x[8] + x[11], 13);  x[10] ^= ROTL32(x[9] + x[8], 18);
+    x[12] ^= ROTL32(x[15] + x[14], 7); x[13] ^= ROTL32(x[12] + x[15], 9);
+    x[14] ^= ROTL32(x[13] + x[12], 13); x[15] ^= ROTL32(x[14] + x[13], 18);
+  }
+  for (int i = 0; i < 16; i++) {
+    B[i] += x[i];
+  }
+}
+
+static void blockmix_salsa8(const uint32_t *Bin, const uint32_t *Bxor, uint32_t *Bout, size_t r) {
+  uint32_t X[16];
+  for (int w = 0; w < 16; w++) {
+    X[w] = Bin[(2 * r - 1) * 16 + w] ^ (Bxor ? Bxor[(2 * r - 1) * 16 + w] : 0);
+  }
+  for (size_t i = 0; i < 2 * r; i++) {
+    for (int w = 0; w < 16; w++) {
+      X[w] ^= Bin[i * 16 + w] ^ (Bxor ? Bxor[i * 16 + w] : 0);
+    }
+    salsa20_8(X);
+    memcpy(Bout + 16 * ((i & 1) ? r + i / 2 : i / 2), X, 64);
+  }
+}
+
+static inline void load_block(uint32_t *X, const unsigned char *B) {
+  for (int i = 0; i < 16; i++) {
+    X[i] = load32_le(B + 4 * i);
+  }
+}
+
+static inline void store_block(unsigned char *B, const uint32_t *X) {
+  for (int i = 0; i < 16; i++) {
+    store32_le(B + 4 * i, X[i]);
+  }
+}
+#endif
+
+
+// ROMix (RFC 7914 section 5) of one 128 * r byte lane in place. scratch
+// holds V (N blocks) followed by X and Y, 128 * r * (N + 2) bytes in all.
+static void romix(unsigned char *lane, size_t r, uint64_t N, uint32_t *scratch) {
+  size_t words = 32 * r;
+  uint32_t *V = scratch;
+  uint32_t *X = V + words * N;
+  uint32_t *Y = X + words;
+
+  for (size_t k = 0; k < 2 * r; k++) {
+    load_block(X + 16 * k, lane + 64 * k);
+  }
+  for (uint64_t i = 0; i < N; i += 2) {
+    memcpy(V + i * words, X, 128 * r);
+    blockmix_salsa8(X, NULL, Y, r);
+    memcpy(V + (i + 1) * words, Y, 128 * r);
+    blockmix_salsa8(Y, NULL, X, r);
+  }
+  for (uint64_t i = 0; i < N; i += 2) {
+    uint64_t j = X[(2 * r - 1) * 16] & (N - 1);
+    blockmix_salsa8(X, V + j * words, Y, r);
+    j = Y[(2 * r - 1) * 16] & (N - 1);
+    blockmix_salsa8(Y, V + j * words, X, r);
+  }
+  for (size_t k = 0; k < 2 * r; k++) {
+    store_block(lane + 64 * k, X + 16 * k);
+  }
+}
+
+static size_t scratch_size(size_t r, uint64_t N) {
+  return 128 * r * ((size_t) N + 2);
+}
+
+
+typedef struct {
+  unsigned char *lanes;   // p lanes of 128 * r bytes
+  size_t r;
+  uint64_t N;
+  int failed;
+} lane_batch;
+
+static void lane_worker(void *data, const secp256k1_context *ctx, R_xlen_t begin, R_xlen_t end) {
+  lane_batch *batch = (lane_batch *) data;
+  scrypt_arena arena;
+  size_t size = scratch_size(batch->r, batch->N);
+  if (!arena_acquire(&arena, size)) {
+    batch->failed = 1;
+    return;
+  }
+  for (R_xlen_t i = begin; i < end; i++) {
+    romix(batch->lanes + (size_t) i * 128 * batch->r, batch->r, batch->N, (uint32_t *) arena.mem);
+  }
+  arena_release(&arena, size);
+}
+
+// scrypt of one password and salt into out. The p lanes are spread across
+// n_threads threads; with n_threads 1 they share one arena on the calling
+// thread, which is also what the batch workers do. Returns 0 on success and
+// 1 if the scratch memory could not be allocated. Safe on worker threads
+// when n_threads is 1.
+static int scrypt_derive(const unsigned char *password, size_t password_len, const unsigned char *salt,
+                         size_t salt_len, uint64_t N, size_t r, size_t p, unsigned char *out, size_t out_len,
+                         int n_threads) {
+  size_t lanes_len = 128 * r * p;
+  unsigned char *lanes = (unsigned char *) malloc(lanes_len);
+  if (lanes == NULL) {
+    return 1;
+  }
+  pbkdf2_sha256(password, password_len, salt, salt_len, 1, lanes, lanes_len);
+
+  lane_batch batch;
+  batch.lanes = lanes;
+  batch.r = r;
+  batch.N = N;
+  batch.failed = 0;
+  if (n_threads > 1 && p > 1) {
+    parallel_for((R_xlen_t) p, n_threads, lane_worker, &batch, 0);
+  } else {
+    lane_worker(&batch, NULL, 0, (R_xlen_t) p);
+  }
+
+  if (!batch.failed) {
+    pbkdf2_sha256(password, password_len, lanes, lanes_len, 1, out, out_len);
+  }
+  secure_wipe(lanes, lanes_len);
+  free(lanes);
+  return batch.failed;
+}
+
+
+// Read and check N, r and p: N a power of two greater than 1, r * p below
+// 2^30 (RFC 7914) and the scratch memory of a lane addressable
+static void scrypt_params(SEXP N_r, SEXP r_r, SEXP p_r, uint64_t *N, size_t *r, size_t *p) {
+  double N_d = asReal(N_r), r_d = asReal(r_r), p_d = asReal(p_r);
+  if (!(N_d > 1 && N_d <= 4294967296.0) || N_d != (double) (uint64_t) N_d ||
+      ((uint64_t) N_d & ((uint64_t) N_d - 1)) != 0) {
+    error("N must be a power of 2 greater than 1.");
+  }
+  if (!(r_d >= 1 && p_d >= 1) || r_d != (double) (uint64_t) r_d || p_d != (double) (uint64_t) p_d ||
+      r_d * p_d >= 1073741824.0) {
+    error("r and p must be positive integers with r * p < 2^30.");
+  }
+  *N = (uint64_t) N_d;
+  *r = (size_t) r_d;
+  *p = (size_t) p_d;
+  if ((double) 128 * *r * ((double) *N + 2) > (double) SIZE_MAX / 2) {
+    error("N and r need more memory than can be addressed.");
+  }
+}
+
+static const unsigned char* string_or_raw(SEXP x, size_t *len, const char *what) {
+  if (TYPEOF(x) == RAWSXP) {
+    *len = (size_t) XLENGTH(x);
+    return RAW(x);
+  }
+  if (TYPEOF(x) == STRSXP && XLENGTH(x) == 1 && STRING_ELT(x, 0) != NA_STRING) {
+    *len = (size_t) LENGTH(STRING_ELT(x, 0));
+    return (const unsigned char *) CHAR(STRING_ELT(x, 0));
+  }
+  error("The %s must be a raw vector or a single string.", what);
+  return NULL;  // not reached
+}
+
+// Derive a dk_len-byte key from a password and salt (raw vectors or
+// strings, read in place) with scrypt
+SEXP scrypt_R(SEXP password_r, SEXP salt_r, SEXP N_r, SEXP r_r, SEXP p_r, SEXP dk_len_r, SEXP n_threads_R) {
+  uint64_t N;
+  size_t r, p, password_len, salt_len;
+  scrypt_params(N_r, r_r, p_r, &N, &r, &p);
+  const unsigned char *password = string_or_raw(password_r, &password_len, "password");
+  const unsigned char *salt = string_or_raw(salt_r, &salt_len, "salt");
+  int dk_len = asInteger(dk_len_r);
+  if (dk_len == NA_INTEGER || dk_len < 1) {
+    error("dk_len must be a positive integer.");
+  }
+
+  SEXP result = PROTECT(allocVector(RAWSXP, dk_len));
+  if (scrypt_derive(password, password_len, salt, salt_len, N, r, p, RAW(result), (size_t) dk_len,
+                    asInteger(n_threads_R))) {
+    error("Failed to allocate %.0f bytes of scrypt memory", (double) scratch_size(r, N));
+  }
+  UNPROTECT(1);
+  return result;
+}
+
+
+typedef struct {
+  const unsigned char **passwords;
+  const size_t *password_lens;
+  const unsigned char **salts;
+  const size_t *salt_lens;
+  const unsigned char **expected;
+  const size_t *expected_lens;
+  uint64_t N;
+  size_t r;
+  size_t p;
+  const char *todo;
+  int *result;
+  int failed;
+} check_batch;
+
+static void check_worker(void *data, const secp256k1_context *ctx, R_xlen_t begin, R_xlen_t end) {
+  check_batch *batch = (check_batch *) data;
+  for (R_xlen_t i = begin; i < end; i++) {
+    if (!batch->todo[i]) {
+      continue;
+    }
+    size_t len = batch->expected_lens[i];
+    unsigned char derived[64];
+    unsigned char *dk = (len <= sizeof(derived)) ? derived : (unsigned char *) malloc(len);
+    if (dk == NULL || scrypt_derive(batch->passwords[i], batch->password_lens[i], batch->salts[i],
+                                    batch->salt_lens[i], batch->N, batch->r, batch->p, dk, len, 1)) {
+      batch->failed = 1;
+      batch->result[i] = NA_LOGICAL;
+    } else {
+      batch->result[i] = constant_time_equal(dk, batch->expected[i], len);
+    }
+    if (dk != NULL) {
+      secure_wipe(dk, len);
+      if (dk != derived) {
+        free(dk);
+      }
+    }
+  }
+}
+
+// Point ptrs[i] at element i of x (recycled when x has one element), a
+// character vector or a list of raw vectors. NA or NULL elements give NULL.
+static void element_bytes(SEXP x, R_xlen_t n, const unsigned char **ptrs, size_t *lens, const char *what) {
+  R_xlen_t len = XLENGTH(x);
+  if (len != n && len != 1) {
+    error("Provide one %s per password or a single one.", what);
+  }
+  if (TYPEOF(x) != STRSXP && TYPEOF(x) != VECSXP) {
+    error("The %ss must be a character vector or a list of raw vectors.", what);
+  }
+  for (R_xlen_t i = 0; i < n; i++) {
+    R_xlen_t k = (len == 1) ? 0 : i;
+    ptrs[i] = NULL;
+    lens[i] = 0;
+    if (TYPEOF(x) == STRSXP) {
+      SEXP s = STRING_ELT(x, k);
+      if (s != NA_STRING) {
+        ptrs[i] = (const unsigned char *) CHAR(s);
+        lens[i] = (size_t) LENGTH(s);
+      }
+    } else {
+      SEXP el = VECTOR_ELT(x, k);
+      if (TYPEOF(el) == RAWSXP) {
+        ptrs[i] = RAW(el);
+        lens[i] = (size_t) XLENGTH(el);
+      } else if (el != R_NilValue) {
+        error("Element %lld of the %ss is not a raw vector.", (long long) k + 1, what);
+      }
+    }
+  }
+}
+
+// Check many passwords against their expected scrypt keys (lists of raw
+// vectors or character vectors; salts and expected keys may be a single
+// element shared by all). Each item runs on a worker thread with its own
+// arena and the keys are compared in constant time. NA inputs give NA.
+SEXP scrypt_check_batch_R(SEXP passwords_r, SEXP salts_r, SEXP expected_r, SEXP N_r, SEXP r_r, SEXP p_r,
+                          SEXP n_threads_R) {
+  uint64_t N;
+  size_t r, p;
+  scrypt_params(N_r, r_r, p_r, &N, &r, &p);
+  if (TYPEOF(passwords_r) != STRSXP && TYPEOF(passwords_r) != VECSXP) {
+    error("The passwords must be a character vector or a list of raw vectors.");
+  }
+  R_xlen_t n = XLENGTH(passwords_r);
+
+  check_batch batch;
+  batch.passwords = (const unsigned char **) R_alloc(n + 1, sizeof(unsigned char *));
+  batch.password_lens = (size_t *) R_alloc(n + 1, sizeof(size_t));
+  batch.salts = (const unsigned char **) R_alloc(n + 1, sizeof(unsigned char *));
+  batch.salt_lens = (size_t *) R_alloc(n + 1, sizeof(size_t));
+  batch.expected = (const unsigned char **) R_alloc(n + 1, sizeof(unsigned char *));
+  batch.expected_lens = (size_t *) R_alloc(n + 1, sizeof(size_t));
+  element_bytes(passwords_r, n, batch.passwords, (size_t *) batch.password_lens, "password");
+  element_bytes(salts_r, n, batch.salts, (size_t *) batch.salt_lens, "salt");
+  if (TYPEOF(expected_r) != VECSXP) {
+    error("The expected keys must be a list of raw vectors.");
+  }
+  element_bytes(expected_r, n, batch.expected, (size_t *) batch.expected_lens, "expected key");
+
+  // Missing inputs give NA and an empty expected key never matches
+  SEXP result = PROTECT(allocVector(LGLSXP, n));
+  char *todo = (char *) R_alloc(n + 1, 1);
+  for (R_xlen_t i = 0; i < n; i++) {
+    int missing = batch.passwords[i] == NULL || batch.salts[i] == NULL || batch.expected[i] == NULL;
+    LOGICAL(result)[i] = missing ? NA_LOGICAL : FALSE;
+    todo[i] = !missing && batch.expected_lens[i] > 0;
+  }
+  batch.todo = todo;
+  batch.result = LOGICAL(result);
+  batch.N = N;
+  batch.r = r;
+  batch.p = p;
+  batch.failed = 0;
+  parallel_for(n, asInteger(n_threads_R), check_worker, &batch, 0);
+
+  if (batch.failed) {
+    error("Failed to allocate %.0f bytes of scrypt memory", (double) scratch_size(r, N));
+  }
+  UNPROTECT(1);
+  return result;
+}
+
+SEXP scrypt_release_memory_R() {
+  free_scrypt_arenas();
+  return R_NilValue;
+}
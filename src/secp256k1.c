@@ -1,142 +1,255 @@
 #include <R.h>
 #include <Rinternals.h>
 #include "secp256k1.h"
+#include "flureeCrypto.h"
 #include <secp256k1_ecdh.h>     // For ECDH functionalities
 #include <secp256k1_recovery.h>
-#include <gmp.h>
 #include <string.h>
 #include<assert.h>
 
 
 // Helper functions
-unsigned char* biginteger_to_bytes(mpz_t bn, size_t *len);
-char* biginteger_to_hex(mpz_t bn);
-void hex_to_biginteger(const char* hex, mpz_t result);
-int hex_to_bytes(const char *hex, unsigned char *bytes, size_t bytes_len);
-
 char* format_public_key(const unsigned char *pubkey);
-char* get_modulus();
+int seckey_in_range(const unsigned char *seckey);
+int generate_seckey(const secp256k1_context *ctx, unsigned char *seckey);
+
+// Shared context management
+secp256k1_context* create_context();
+secp256k1_context* clone_context(const secp256k1_context *ctx);
+int randomize_context(secp256k1_context *ctx);
+void init_shared_context();
+void free_shared_context();
 
 // R-callable functions
-SEXP valid_private_R(SEXP private_key_hex);
+SEXP valid_private_R(SEXP private_keys);
 SEXP generate_seckey_R();
 SEXP format_public_key_R(SEXP pubkey_r);
 SEXP generate_keypair_R();
 SEXP generate_keypair_with_seckey_R(SEXP seckey_r);
+SEXP generate_keypairs_R(SEXP n_r, SEXP n_threads_R);
 SEXP sign_R_R(SEXP msg_hash_r, SEXP priv_key_r);
-SEXP ecrecover_R(SEXP hex_signature_R, SEXP hash_R);
+SEXP sign_message_R(SEXP msg_r, SEXP priv_key_r, SEXP output_hex_r, SEXP compact_r);
+SEXP sign_batch_R(SEXP hashes_r, SEXP keys_r, SEXP output_hex_r, SEXP compact_r);
+SEXP ecrecover_R(SEXP signature_R, SEXP hash_R);
+SEXP ecrecover_batch_R(SEXP signatures_R, SEXP hashes_R, SEXP n_threads_R);
+SEXP verify_batch_R(SEXP pubkeys_R, SEXP signatures_R, SEXP hashes_R, SEXP n_threads_R);
+SEXP context_count_R();
 
 
+// Status codes of recover_public_key(), see recover_errors
+#define RECOVER_BAD_LENGTH 1
+#define RECOVER_BAD_RECOVERY_BYTE 2
+#define RECOVER_NOT_DER 3
+#define RECOVER_LENGTH_MISMATCH 4
+#define RECOVER_R_NOT_INTEGER 5
+#define RECOVER_R_TOO_LONG 6
+#define RECOVER_S_NOT_INTEGER 7
+#define RECOVER_S_TOO_LONG 8
+#define RECOVER_BAD_COMPACT 9
+#define RECOVER_FAILED 10
+#define RECOVER_SERIALIZE_FAILED 11
+#define RECOVER_BAD_HEX 12
+#define RECOVER_BAD_COMPACT_V 13
 
-// Convert big integer to byte array (raw bytes)
-unsigned char* biginteger_to_bytes(mpz_t bn, size_t *len) {
-  // Get the number of bytes required to represent the big integer
-  *len = (mpz_sizeinbase(bn, 2) + 7) / 8; // Number of bytes required
-  unsigned char* bytes = (unsigned char*) malloc(*len);
-  
-  // Convert the big integer to binary (byte array)
-  mpz_export(bytes, len, 1, 1, 1, 0, bn);
-  
-  return bytes;
+// Number of calls served by the shared context, or by a worker context,
+// before it is re-randomized
+#define CONTEXT_RANDOMIZE_INTERVAL 4096
+
+// A single context is shared by every entry point. It is created when the
+// package is loaded and destroyed when the DLL is unloaded, so the per-call
+// cost is reduced to a pointer lookup. Worker threads must not use it
+// directly; they get their own copy through clone_context().
+static secp256k1_context *shared_ctx = NULL;
+static unsigned long shared_ctx_uses = 0;
+static unsigned long contexts_created = 0;
+static secp256k1_context *worker_ctx[MAX_THREADS] = {NULL};
+static unsigned long worker_ctx_uses[MAX_THREADS] = {0};
+
+
+// The order n of the secp256k1 curve, big-endian
+static const unsigned char secp256k1_order[32] = {
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+  0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xfe,
+  0xba, 0xae, 0xdc, 0xe6, 0xaf, 0x48, 0xa0, 0x3b,
+  0xbf, 0xd2, 0x5e, 0x8c, 0xd0, 0x36, 0x41, 0x41
+};
+
+
+// Check in constant time that a 32-byte big-endian key k satisfies
+// 0 < k < n. The loop always touches every byte and never branches on the
+// key, so the running time does not depend on its value.
+int seckey_in_range(const unsigned char *seckey) {
+  unsigned int borrow = 0;
+  unsigned int nonzero = 0;
+  for (int i = 31; i >= 0; i--) {
+    unsigned int diff = (unsigned int) seckey[i] - secp256k1_order[i] - borrow;
+    borrow = (diff >> 8) & 1;  // k - n underflows exactly when k < n
+    nonzero |= seckey[i];
+  }
+  return (int) (borrow & ((nonzero + 0xff) >> 8));
 }
 
-// Convert big integer to hexadecimal string
-char* biginteger_to_hex(mpz_t bn) {
-  // Convert the big integer to a hexadecimal string
-  char *hex_string = mpz_get_str(NULL, 16, bn);
-  
-  // If the hex string length is odd, prepend a "0" (for byte alignment)
-  size_t len = strlen(hex_string);
-  if (len % 2 != 0) {
-    char *padded_hex = (char*) malloc(len + 2);
-    padded_hex[0] = '0';
-    strcpy(padded_hex + 1, hex_string);
-    free(hex_string);
-    return padded_hex;
+
+
+
+// Create a context usable for both signing and verification. Since
+// libsecp256k1 0.2.0 the generator tables are static (precomputed when the
+// library is built, see configure), so this is only an allocation and the
+// flags are no longer needed.
+secp256k1_context* create_context() {
+  secp256k1_context *ctx = secp256k1_context_create(SECP256K1_CONTEXT_NONE);
+  if (ctx != NULL) {
+    contexts_created++;
   }
+  return ctx;
+}
 
-  return hex_string;
+// Copy a context for use by a worker thread. Must be called from the thread
+// that owns the source context, before the worker is started.
+secp256k1_context* clone_context(const secp256k1_context *ctx) {
+  secp256k1_context *copy = secp256k1_context_clone(ctx);
+  if (copy != NULL) {
+    contexts_created++;
+  }
+  return copy;
 }
 
-// Function to convert hexadecimal string to a big integer
-void hex_to_biginteger(const char* hex, mpz_t result) {
-  // Initialize the big integer
-  mpz_init(result);
+// Refresh the blinding of a context with 32 fresh random bytes
+int randomize_context(secp256k1_context *ctx) {
+  unsigned char seed[32];
+  
+  if (!random_fill(seed, sizeof(seed))) {
+    return 0;
+  }
   
-  // Convert the hexadecimal string to a big integer
-  mpz_set_str(result, hex, 16);
+  int success = secp256k1_context_randomize(ctx, seed);
+  secure_wipe(seed, sizeof(seed));
+  return success;
 }
 
-
-// Function to convert a hex string to a byte array
-int hex_to_bytes(const char *hex, unsigned char *bytes, size_t bytes_len) {
-  size_t hex_len = strlen(hex);
-  if (hex_len % 2 != 0 || bytes_len < hex_len / 2) {
-    return 0; // Invalid hex string
+// Called from R_init_flureeCrypto when the package is loaded
+void init_shared_context() {
+  if (shared_ctx != NULL) {
+    return;
   }
-  for (size_t i = 0; i < hex_len / 2; ++i) {
-    sscanf(hex + 2 * i, "%2hhx", &bytes[i]);
+  shared_ctx = create_context();
+  if (shared_ctx != NULL) {
+    randomize_context(shared_ctx);
   }
-  return 1; // Success
+  shared_ctx_uses = 0;
 }
 
+// Called from R_unload_flureeCrypto when the DLL is unloaded
+void free_shared_context() {
+  for (int slot = 0; slot < MAX_THREADS; slot++) {
+    if (worker_ctx[slot] != NULL) {
+      secp256k1_context_destroy(worker_ctx[slot]);
+      worker_ctx[slot] = NULL;
+    }
+    worker_ctx_uses[slot] = 0;
+  }
+  if (shared_ctx != NULL) {
+    secp256k1_context_destroy(shared_ctx);
+    shared_ctx = NULL;
+  }
+}
 
-
-// Function to get the modulus (n) as a character string
-char* get_modulus() {
-  // The order of the secp256k1 curve, defined in bytes
-  const unsigned char secp256k1_n[32] = {
-    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
-    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xfe,
-    0xba, 0xae, 0xdc, 0xe6, 0xaf, 0x48, 0xa0, 0x3b,
-    0xbf, 0xd2, 0x5e, 0x8c, 0xd0, 0x36, 0x41, 0x41
-  };
-  
-  // Allocate memory for the hex string (2 characters per byte + null terminator)
-  char *hex_string = (char *) malloc(2 * sizeof(secp256k1_n) + 1);
-  if (hex_string == NULL) {
-    fprintf(stderr, "Memory allocation failed\n");
-    exit(EXIT_FAILURE);
+// Return the shared context, creating it if the load-time initialisation
+// failed and re-randomizing it every CONTEXT_RANDOMIZE_INTERVAL calls
+secp256k1_context* get_context() {
+  if (shared_ctx == NULL) {
+    init_shared_context();
+    if (shared_ctx == NULL) {
+      error("Failed to create secp256k1 context");  // Raise an error to R
+    }
   }
   
-  // Convert the byte array to a hex string
-  for (size_t i = 0; i < sizeof(secp256k1_n); i++) {
-    sprintf(hex_string + (i * 2), "%02x", secp256k1_n[i]);
+  if (++shared_ctx_uses >= CONTEXT_RANDOMIZE_INTERVAL) {
+    randomize_context(shared_ctx);
+    shared_ctx_uses = 0;
   }
   
-  return hex_string;  // Return the hex string
+  return shared_ctx;
 }
 
+// Return the context owned by worker thread slot. Contexts are cloned from
+// the shared one on first use and kept until the DLL is unloaded, so
+// repeated parallel calls do not pay for setup again; like the shared one,
+// each is re-randomized every CONTEXT_RANDOMIZE_INTERVAL calls. Must be
+// called from the main thread before the workers start.
+secp256k1_context* get_worker_context(int slot) {
+  if (slot < 0 || slot >= MAX_THREADS) {
+    error("Worker thread slot out of range");
+  }
+  if (worker_ctx[slot] == NULL) {
+    worker_ctx[slot] = clone_context(get_context());
+    if (worker_ctx[slot] == NULL) {
+      error("Failed to clone secp256k1 context");
+    }
+    randomize_context(worker_ctx[slot]);
+    worker_ctx_uses[slot] = 0;
+  } else if (++worker_ctx_uses[slot] >= CONTEXT_RANDOMIZE_INTERVAL) {
+    randomize_context(worker_ctx[slot]);
+    worker_ctx_uses[slot] = 0;
+  }
+  return worker_ctx[slot];
+}
 
+// Report how many contexts have been created since the package was loaded
+SEXP context_count_R() {
+  return ScalarReal((double) contexts_created);
+}
 
 
 
-SEXP valid_private_R(SEXP private_key_hex) {
-  const char* private_key_str = CHAR(STRING_ELT(private_key_hex, 0));
-  
-  mpz_t private_key, modulus, one;
-  mpz_init(private_key);
-  mpz_init(modulus);
-  mpz_init_set_ui(one, 1); // Initialize 'one' to 1
-  
-  // Convert the private key from hex to big integer
-  hex_to_biginteger(private_key_str, private_key);
-  
-  // Get the modulus as a hex string and convert it to a big integer
-  char* modulus_hex = get_modulus();
-  hex_to_biginteger(modulus_hex, modulus);
-  free(modulus_hex); // Free the modulus hex string memory
-  
-  // Check if the private key is >= 1 and <= modulus
-  int is_valid = (mpz_cmp(private_key, one) >= 0) && (mpz_cmp(private_key, modulus) <= 0);
-  
-  // Free the allocated memory
-  mpz_clear(private_key);
-  mpz_clear(modulus);
-  mpz_clear(one);
+
+
+
+// Validate private keys given as a character vector of hex strings, a raw
+// vector of concatenated 32-byte keys (the columns of a raw matrix) or a
+// list of raw vectors. Returns a logical vector; malformed keys are FALSE
+// and NA strings give NA.
+SEXP valid_private_R(SEXP private_keys) {
+  unsigned char seckey[32];
+  R_xlen_t n;
+  SEXP result;
+  
+  switch (TYPEOF(private_keys)) {
+  case STRSXP:
+    n = XLENGTH(private_keys);
+    result = PROTECT(allocVector(LGLSXP, n));
+    for (R_xlen_t i = 0; i < n; i++) {
+      SEXP hex_r = STRING_ELT(private_keys, i);
+      if (hex_r == NA_STRING) {
+        LOGICAL(result)[i] = NA_LOGICAL;
+        continue;
+      }
+      LOGICAL(result)[i] = LENGTH(hex_r) == 64 && hex_decode(CHAR(hex_r), 64, seckey) && seckey_in_range(seckey);
+    }
+    break;
+  case RAWSXP:
+    if (XLENGTH(private_keys) % 32 != 0) {
+      error("Raw private keys must be 32 bytes each.");
+    }
+    n = XLENGTH(private_keys) / 32;
+    result = PROTECT(allocVector(LGLSXP, n));
+    for (R_xlen_t i = 0; i < n; i++) {
+      LOGICAL(result)[i] = seckey_in_range(RAW(private_keys) + i * 32);
+    }
+    break;
+  case VECSXP:
+    n = XLENGTH(private_keys);
+    result = PROTECT(allocVector(LGLSXP, n));
+    for (R_xlen_t i = 0; i < n; i++) {
+      SEXP key_r = VECTOR_ELT(private_keys, i);
+      LOGICAL(result)[i] = TYPEOF(key_r) == RAWSXP && XLENGTH(key_r) == 32 && seckey_in_range(RAW(key_r));
+    }
+    break;
+  default:
+    error("Private keys must be hexadecimal strings or raw vectors.");
+  }
   
-  // Return the result as an R integer (1 if valid, 0 otherwise)
-  SEXP result = PROTECT(ScalarInteger(is_valid));
+  secure_wipe(seckey, sizeof(seckey));
   UNPROTECT(1);
   return result;
 }
@@ -145,36 +258,31 @@ SEXP valid_private_R(SEXP private_key_hex) {
 
 
 
+// Draw random private keys from the entropy pool until one is valid.
+// Returns 0 if no entropy was available. Safe to call on worker threads.
+int generate_seckey(const secp256k1_context *ctx, unsigned char *seckey) {
+  do {
+    if (!random_fill(seckey, 32)) {
+      return 0;
+    }
+  } while (!secp256k1_ec_seckey_verify(ctx, seckey));
+  return 1;
+}
+
+
 SEXP generate_seckey_R() {
   // Allocate memory for the secret key
   unsigned char seckey[32];
   
-  // Create a context for signing
-  secp256k1_context *ctx = secp256k1_context_create(SECP256K1_CONTEXT_SIGN);
-  if (ctx == NULL) {
-    error("Failed to create secp256k1 context");  // Raise an error to R
+  // Generate a random secret key with the shared context
+  if (!generate_seckey(get_context(), seckey)) {
+    error("Failed to read random bytes from the operating system");  // Raise an error to R
   }
   
-  // Generate a random secret key and verify it
-  int success = 0;
-  do {
-    FILE *file_p = fopen("/dev/urandom", "r");
-    if (file_p == NULL) {
-      secp256k1_context_destroy(ctx);
-      error("Failed to open /dev/urandom");  // Raise an error to R
-    }
-    fread(seckey, 32, 1, file_p);
-    fclose(file_p);
-    
-    success = secp256k1_ec_seckey_verify(ctx, seckey);
-  } while (!success);
-  
-  // Clean up the context
-  secp256k1_context_destroy(ctx);
-  
   // Wrap the secret key in a raw vector
   SEXP result = PROTECT(allocVector(RAWSXP, 32));
   memcpy(RAW(result), seckey, 32);
+  secure_wipe(seckey, 32);
   
   UNPROTECT(1);
   return result;  // Return the 32-byte raw vector as the secret key
@@ -184,16 +292,11 @@ SEXP generate_seckey_R() {
 
 // This function handles the conversion of the public key to compressed form
 char* format_public_key(const unsigned char *pubkey) {
-  secp256k1_context *ctx = secp256k1_context_create(SECP256K1_CONTEXT_VERIFY);
-  if (ctx == NULL) {
-    fprintf(stderr, "Failed to create secp256k1 context\n");
-    return NULL;
-  }
+  secp256k1_context *ctx = get_context();
   
   secp256k1_pubkey pubkey_struct;
   if (!secp256k1_ec_pubkey_parse(ctx, &pubkey_struct, pubkey, 65)) {
     fprintf(stderr, "Failed to parse public key\n");
-    secp256k1_context_destroy(ctx);
     return NULL;
   }
   
@@ -204,16 +307,12 @@ char* format_public_key(const unsigned char *pubkey) {
   char *hex_string = (char *)malloc(2 * compressed_pubkey_len + 1);
   if (hex_string == NULL) {
     fprintf(stderr, "Memory allocation failed\n");
-    secp256k1_context_destroy(ctx);
     return NULL;
   }
   
-  for (size_t i = 0; i < compressed_pubkey_len; i++) {
-    sprintf(hex_string + (i * 2), "%02x", compressed_pubkey[i]);
-  }
+  bytes_to_hex(compressed_pubkey, compressed_pubkey_len, hex_string);
   hex_string[2 * compressed_pubkey_len] = '\0';
   
-  secp256k1_context_destroy(ctx);
   return hex_string;
 }
 
@@ -222,6 +321,14 @@ char* format_public_key(const unsigned char *pubkey) {
 
 // This function enables the user to format a public key directly from R
 SEXP format_public_key_R(SEXP pubkey_r) {
+  // A key handle already holds the compressed key
+  const public_key_handle *handle = public_key_handle_from_R(pubkey_r);
+  if (handle != NULL) {
+    char hex[66];
+    bytes_to_hex(handle->compressed, 33, hex);
+    return ScalarString(mkCharLen(hex, 66));
+  }
+  
   // Ensure input type and length
   if (TYPEOF(pubkey_r) != RAWSXP || LENGTH(pubkey_r) != 65) {
     error("Public key must be a 65-byte raw vector (uncompressed)");
@@ -254,28 +361,18 @@ SEXP generate_keypair_R() {
   unsigned char seckey[32];
   unsigned char pubkey[65]; // Uncompressed public key is 65 bytes
   
-  // Generate a secp256k1 context
-  secp256k1_context *ctx = secp256k1_context_create(SECP256K1_CONTEXT_SIGN);
-  if (ctx == NULL) {
-    error("Failed to create secp256k1 context");
-  }
+  // Use the shared secp256k1 context
+  secp256k1_context *ctx = get_context();
   
-  // Call the R-compatible generate_seckey function to get the secret key
-  SEXP seckey_r = PROTECT(generate_seckey_R());
-  if (LENGTH(seckey_r) != 32) {
-    secp256k1_context_destroy(ctx);
-    UNPROTECT(1);
-    error("Invalid secret key length generated");
+  // Generate the secret key straight into the C array
+  if (!generate_seckey(ctx, seckey)) {
+    error("Failed to read random bytes from the operating system");
   }
   
-  // Copy the raw vector contents from R's internal datatype to the C seckey array
-  memcpy(seckey, RAW(seckey_r), 32);
-  
   // Generate the corresponding public key
   secp256k1_pubkey pubkey_struct;
   if (!secp256k1_ec_pubkey_create(ctx, &pubkey_struct, seckey)) {
-    secp256k1_context_destroy(ctx);
-    UNPROTECT(1);
+    secure_wipe(seckey, 32);
     error("Failed to create public key");
   }
   
@@ -283,9 +380,6 @@ SEXP generate_keypair_R() {
   size_t pubkey_len = 65;
   secp256k1_ec_pubkey_serialize(ctx, pubkey, &pubkey_len, &pubkey_struct, SECP256K1_EC_COMPRESSED);
   
-  // Clean up the context
-  secp256k1_context_destroy(ctx);
-  
   // Prepare the return value as a list with 'seckey' and 'pubkey'
   SEXP result = PROTECT(allocVector(VECSXP, 2));
   SEXP seckey_out = PROTECT(allocVector(RAWSXP, 32));
@@ -293,11 +387,69 @@ SEXP generate_keypair_R() {
   
   memcpy(RAW(seckey_out), seckey, 32);
   memcpy(RAW(pubkey_out), pubkey, pubkey_len);
+  secure_wipe(seckey, 32);
   
   SET_VECTOR_ELT(result, 0, seckey_out);
   SET_VECTOR_ELT(result, 1, pubkey_out);
   
   // Unprotect all allocations
+  UNPROTECT(3);
+  return result;
+}
+
+
+// Shared state for the key generation workers
+typedef struct {
+  unsigned char *seckeys;  // n concatenated 32-byte private keys
+  unsigned char *pubkeys;  // n concatenated 33-byte compressed public keys
+  char *failed;
+} keypair_batch;
+
+static void keypair_worker(void *data, const secp256k1_context *ctx, R_xlen_t begin, R_xlen_t end) {
+  keypair_batch *batch = (keypair_batch *) data;
+  for (R_xlen_t i = begin; i < end; i++) {
+    unsigned char *seckey = batch->seckeys + i * 32;
+    secp256k1_pubkey pubkey_struct;
+    size_t pubkey_len = 33;
+    batch->failed[i] = !generate_seckey(ctx, seckey) ||
+      !secp256k1_ec_pubkey_create(ctx, &pubkey_struct, seckey) ||
+      !secp256k1_ec_pubkey_serialize(ctx, batch->pubkeys + i * 33, &pubkey_len, &pubkey_struct, SECP256K1_EC_COMPRESSED);
+  }
+}
+
+// Generate n key pairs spread across n_threads worker threads. The keys are
+// written directly into a 32 x n private key matrix and a 33 x n compressed
+// public key matrix, without allocating anything per key.
+SEXP generate_keypairs_R(SEXP n_r, SEXP n_threads_R) {
+  int n = asInteger(n_r);
+  if (n == NA_INTEGER || n < 0) {
+    error("The number of key pairs must be a non-negative integer.");
+  }
+  
+  SEXP result = PROTECT(allocVector(VECSXP, 2));
+  SEXP seckeys_out = PROTECT(allocMatrix(RAWSXP, 32, n));
+  SEXP pubkeys_out = PROTECT(allocMatrix(RAWSXP, 33, n));
+  SET_VECTOR_ELT(result, 0, seckeys_out);
+  SET_VECTOR_ELT(result, 1, pubkeys_out);
+  
+  keypair_batch batch;
+  batch.seckeys = RAW(seckeys_out);
+  batch.pubkeys = RAW(pubkeys_out);
+  batch.failed = (char *) R_alloc(n + 1, 1);
+  parallel_for(n, asInteger(n_threads_R), keypair_worker, &batch, 1);
+  
+  for (int i = 0; i < n; i++) {
+    if (batch.failed[i]) {
+      secure_wipe(batch.seckeys, (size_t) n * 32);
+      error("Failed to generate key pair %d", i + 1);
+    }
+  }
+  
+  SEXP names = PROTECT(allocVector(STRSXP, 2));
+  SET_STRING_ELT(names, 0, mkChar("privkey"));
+  SET_STRING_ELT(names, 1, mkChar("pubkey"));
+  setAttrib(result, R_NamesSymbol, names);
+  
   UNPROTECT(4);
   return result;
 }
@@ -315,31 +467,23 @@ SEXP generate_keypair_with_seckey_R(SEXP seckey_r) {
   unsigned char pubkey[65];  // Uncompressed public key is 65 bytes
   size_t pubkey_len = 65;
   
-  // Create a secp256k1 context for signing
-  secp256k1_context *ctx = secp256k1_context_create(SECP256K1_CONTEXT_SIGN);
-  if (ctx == NULL) {
-    error("Failed to create secp256k1 context");
-  }
+  // Use the shared secp256k1 context for signing
+  secp256k1_context *ctx = get_context();
   
   // Verify the provided private key
   if (!secp256k1_ec_seckey_verify(ctx, seckey)) {
-    secp256k1_context_destroy(ctx);
     error("Invalid private key");
   }
   
   // Generate the public key from the private key
   secp256k1_pubkey pubkey_struct;
   if (!secp256k1_ec_pubkey_create(ctx, &pubkey_struct, seckey)) {
-    secp256k1_context_destroy(ctx);
     error("Failed to generate public key from provided private key");
   }
   
   // Serialize the public key in uncompressed format
   secp256k1_ec_pubkey_serialize(ctx, pubkey, &pubkey_len, &pubkey_struct, SECP256K1_EC_COMPRESSED);
   
-  // Clean up the context
-  secp256k1_context_destroy(ctx);
-  
   // Prepare the R-compatible output: a raw vector for the public key
   SEXP pubkey_out = PROTECT(allocVector(RAWSXP, pubkey_len));
   memcpy(RAW(pubkey_out), pubkey, pubkey_len);
@@ -349,161 +493,648 @@ SEXP generate_keypair_with_seckey_R(SEXP seckey_r) {
 }
 
 
-SEXP sign_R_R(SEXP msg_hash_r, SEXP priv_key_r) {
-  // Validate input lengths
-  if (LENGTH(msg_hash_r) != 32 || LENGTH(priv_key_r) != 32) {
-    error("msg_hash and priv_key must each be 32 bytes.");
-  }
-  
-  // Convert R raw vectors to C unsigned char arrays
-  const unsigned char *msg_hash = RAW(msg_hash_r);
-  const unsigned char *priv_key = RAW(priv_key_r);
-  
-  // Initialize secp256k1 context
-  secp256k1_context *ctx = secp256k1_context_create(SECP256K1_CONTEXT_SIGN);
+// Sign a 32-byte hash into out (at least MAX_SIGNATURE_LEN bytes): the
+// recovery byte followed by the DER signature, or with compact the 65-byte
+// r || s || v form with the recovery byte last. Returns 0 on success, 1 if
+// signing failed and 2 if DER encoding failed.
+int sign_recoverable(const secp256k1_context *ctx, const unsigned char *msg_hash, const unsigned char *priv_key,
+                     int compact, unsigned char *out, size_t *out_len) {
   secp256k1_ecdsa_recoverable_signature recoverable_sig;
   int recovery_id;
   
   // Generate recoverable signature
   if (!secp256k1_ecdsa_sign_recoverable(ctx, &recoverable_sig, msg_hash, priv_key, NULL, NULL)) {
-    secp256k1_context_destroy(ctx);
-    error("Failed to generate recoverable signature");
+    return 1;
   }
   
   // Serialize the signature to compact form to get the recovery ID
   unsigned char sig_compact[64];
   secp256k1_ecdsa_recoverable_signature_serialize_compact(ctx, sig_compact, &recovery_id, &recoverable_sig);
   recovery_id += 27;  // Adjust as needed
+  if (compact) {
+    memcpy(out, sig_compact, 64);
+    out[64] = recovery_id;
+    *out_len = COMPACT_SIGNATURE_LEN;
+    return 0;
+  }
   
-  // Serialize the signature to DER format
-  unsigned char der_signature[72];
-  size_t der_len = sizeof(der_signature);
+  // Serialize the signature to DER format behind the recovery byte
+  size_t der_len = MAX_SIGNATURE_LEN - 1;
   secp256k1_ecdsa_signature signature;
   secp256k1_ecdsa_recoverable_signature_convert(ctx, &signature, &recoverable_sig);
-  if (!secp256k1_ecdsa_signature_serialize_der(ctx, der_signature, &der_len, &signature)) {
-    secp256k1_context_destroy(ctx);
+  if (!secp256k1_ecdsa_signature_serialize_der(ctx, out + 1, &der_len, &signature)) {
+    return 2;
+  }
+  
+  out[0] = recovery_id;
+  *out_len = der_len + 1;
+  return 0;
+}
+
+int sign_recoverable_der(const secp256k1_context *ctx, const unsigned char *msg_hash,
+                         const unsigned char *priv_key, unsigned char *out, size_t *out_len) {
+  return sign_recoverable(ctx, msg_hash, priv_key, 0, out, out_len);
+}
+
+
+SEXP sign_R_R(SEXP msg_hash_r, SEXP priv_key_r) {
+  // The private key is a raw vector or a key handle
+  const private_key_handle *handle = private_key_handle_from_R(priv_key_r);
+  
+  // Validate input lengths
+  if (TYPEOF(msg_hash_r) != RAWSXP || LENGTH(msg_hash_r) != 32 ||
+      (handle == NULL && (TYPEOF(priv_key_r) != RAWSXP || LENGTH(priv_key_r) != 32))) {
+    error("msg_hash and priv_key must each be 32 bytes.");
+  }
+  
+  // Convert R raw vectors to C unsigned char arrays
+  const unsigned char *msg_hash = RAW(msg_hash_r);
+  const unsigned char *priv_key = handle ? handle->seckey : RAW(priv_key_r);
+  
+  // Sign with the shared secp256k1 context
+  unsigned char full_signature[MAX_SIGNATURE_LEN];
+  size_t full_signature_len = 0;
+  int status = sign_recoverable_der(get_context(), msg_hash, priv_key, full_signature, &full_signature_len);
+  if (status == 1) {
+    error("Failed to generate recoverable signature");
+  } else if (status == 2) {
     error("Error encoding signature in DER format");
   }
   
   // Prepare the result with the recovery byte prepended
-  SEXP full_signature_r = PROTECT(allocVector(RAWSXP, der_len + 1));
-  unsigned char *full_signature = RAW(full_signature_r);
-  full_signature[0] = recovery_id;
-  memcpy(full_signature + 1, der_signature, der_len);
+  SEXP full_signature_r = PROTECT(allocVector(RAWSXP, full_signature_len));
+  memcpy(RAW(full_signature_r), full_signature, full_signature_len);
   
-  // Clean up and return
-  secp256k1_context_destroy(ctx);
   UNPROTECT(1);
   return full_signature_r;
 }
 
 
-SEXP ecrecover_R(SEXP hex_signature_R, SEXP hash_R) {
-  // Convert inputs from R
-  const char *hex_signature = CHAR(STRING_ELT(hex_signature_R, 0));
-  const unsigned char *hash = RAW(hash_R);
+// Hash and sign a message in one call. msg_r is a single string, hashed
+// with SHA-256 straight from its CHARSXP, or a raw 32-byte hash used as is.
+// priv_key_r is a raw 32-byte key, a 64-character hex string (decoded into a
+// stack buffer that is wiped afterwards) or a key handle. Returns the
+// recovery byte + DER signature, or the compact form with compact_r TRUE,
+// as a hex string (output_hex_r TRUE) or a raw vector.
+SEXP sign_message_R(SEXP msg_r, SEXP priv_key_r, SEXP output_hex_r, SEXP compact_r) {
+  unsigned char msg_hash[32];
+  if (TYPEOF(msg_r) == STRSXP && XLENGTH(msg_r) == 1 && STRING_ELT(msg_r, 0) != NA_STRING) {
+    SEXP msg = STRING_ELT(msg_r, 0);
+    sha256((const unsigned char *) CHAR(msg), (size_t) LENGTH(msg), msg_hash);
+  } else if (TYPEOF(msg_r) == RAWSXP && XLENGTH(msg_r) == 32) {
+    memcpy(msg_hash, RAW(msg_r), 32);
+  } else {
+    error("The message should be a single character string or a 32-byte raw hash.");
+  }
   
-  unsigned char pubkey_output[33];
-  size_t pubkey_output_len = sizeof(pubkey_output);
+  unsigned char decoded_key[32];
+  const unsigned char *priv_key = private_key_bytes_R(priv_key_r, decoded_key);
+  if (priv_key == NULL) {
+    error("The private key should be 32 bytes, as raw, hexadecimal or a key handle.");
+  }
   
-  unsigned char signature[71]; // 72 is the max size for a DER-encoded signature
-  size_t signature_len = sizeof(signature);
+  unsigned char signature[MAX_SIGNATURE_LEN];
+  size_t signature_len = 0;
+  int status = sign_recoverable(get_context(), msg_hash, priv_key, asLogical(compact_r) == TRUE, signature,
+                                &signature_len);
+  secure_wipe(decoded_key, sizeof(decoded_key));
+  if (status == 1) {
+    error("Failed to generate recoverable signature");
+  } else if (status == 2) {
+    error("Error encoding signature in DER format");
+  }
   
-  // Convert hex signature to byte array
-  hex_to_bytes(hex_signature, signature, signature_len);
+  if (asLogical(output_hex_r) == TRUE) {
+    char hex[2 * MAX_SIGNATURE_LEN];
+    bytes_to_hex(signature, signature_len, hex);
+    return ScalarString(mkCharLen(hex, 2 * signature_len));
+  }
+  SEXP result = PROTECT(allocVector(RAWSXP, signature_len));
+  memcpy(RAW(result), signature, signature_len);
+  UNPROTECT(1);
+  return result;
+}
+
+
+// Sign many hashes in a single call. hashes_r holds N concatenated 32-byte
+// hashes and keys_r either one 32-byte key, a key handle or N concatenated
+// keys. All
+// signatures (DER, or compact with compact_r TRUE) are written into one
+// preallocated buffer and then split by their offsets into a character
+// vector of hex strings (output_hex_r TRUE) or a list of raw vectors.
+SEXP sign_batch_R(SEXP hashes_r, SEXP keys_r, SEXP output_hex_r, SEXP compact_r) {
+  if (TYPEOF(hashes_r) != RAWSXP || XLENGTH(hashes_r) % 32 != 0) {
+    error("Hashes must be a raw vector of concatenated 32-byte hashes.");
+  }
+  const private_key_handle *handle = private_key_handle_from_R(keys_r);
+  if (handle == NULL && (TYPEOF(keys_r) != RAWSXP || XLENGTH(keys_r) % 32 != 0 || XLENGTH(keys_r) == 0)) {
+    error("Private keys must be a raw vector of concatenated 32-byte keys.");
+  }
   
+  R_xlen_t n = XLENGTH(hashes_r) / 32;
+  R_xlen_t n_keys = handle ? 1 : XLENGTH(keys_r) / 32;
+  if (n_keys != 1 && n_keys != n) {
+    error("Provide either one private key or one private key per hash.");
+  }
+  int output_hex = asLogical(output_hex_r);
+  int compact = asLogical(compact_r) == TRUE;
+  
+  const unsigned char *hashes = RAW(hashes_r);
+  const unsigned char *keys = handle ? handle->seckey : RAW(keys_r);
+  
+  // One buffer for all signatures plus their start offsets
+  SEXP buffer_r = PROTECT(allocVector(RAWSXP, n * MAX_SIGNATURE_LEN));
+  unsigned char *buffer = RAW(buffer_r);
+  size_t *offsets = (size_t *) R_alloc(n + 1, sizeof(size_t));
+  
+  offsets[0] = 0;
+  for (R_xlen_t i = 0; i < n; i++) {
+    const unsigned char *key = keys + (n_keys == 1 ? 0 : i * 32);
+    size_t sig_len = 0;
+    int status = sign_recoverable(get_context(), hashes + i * 32, key, compact, buffer + offsets[i], &sig_len);
+    if (status == 1) {
+      error("Failed to generate recoverable signature for hash %lld", (long long) i + 1);
+    } else if (status == 2) {
+      error("Error encoding signature %lld in DER format", (long long) i + 1);
+    }
+    offsets[i + 1] = offsets[i] + sig_len;
+  }
+  
+  SEXP result;
+  if (output_hex == TRUE) {
+    result = PROTECT(allocVector(STRSXP, n));
+    char hex[2 * MAX_SIGNATURE_LEN + 1];
+    for (R_xlen_t i = 0; i < n; i++) {
+      size_t sig_len = offsets[i + 1] - offsets[i];
+      bytes_to_hex(buffer + offsets[i], sig_len, hex);
+      SET_STRING_ELT(result, i, mkCharLen(hex, 2 * sig_len));
+    }
+  } else {
+    result = PROTECT(allocVector(VECSXP, n));
+    for (R_xlen_t i = 0; i < n; i++) {
+      size_t sig_len = offsets[i + 1] - offsets[i];
+      SEXP sig_r = allocVector(RAWSXP, sig_len);
+      SET_VECTOR_ELT(result, i, sig_r);
+      memcpy(RAW(sig_r), buffer + offsets[i], sig_len);
+    }
+  }
+  
+  UNPROTECT(2);
+  return result;
+}
+
+
+// Messages for the non-zero status codes returned by recover_public_key()
+static const char *recover_errors[] = {
+  "",
+  "Invalid DER signature length.",
+  "Recovery byte should be between 0x1B and 0x1E.",
+  "Signature must be of type DER (0x30).",
+  "Signature length mismatch.",
+  "R must be of type integer (0x02).",
+  "R length exceeds 32 bytes.",
+  "S must be of type integer (0x02).",
+  "S length exceeds 32 bytes.",
+  "Failed to parse compact signature.",
+  "Failed to recover public key.",
+  "Failed to serialize public key.",
+  "Invalid hexadecimal signature.",
+  "Compact signature recovery byte should be between 0x1B and 0x1E."
+};
+
+// Split a recovery byte + DER signature of signature_len bytes into the
+// 64-byte compact r || s form and the recovery id. The signature is read in
+// place and every length field is checked against signature_len before it
+// is followed. Returns 0 on success or an index into recover_errors.
+static int parse_der_signature(const unsigned char *signature, size_t signature_len,
+                               unsigned char r_s_compact[64], int *recovery_id) {
   // Validate signature length
   if (signature_len < 9) {
-    Rf_warning("Invalid DER signature length.");
-    return ScalarInteger(0);
+    return RECOVER_BAD_LENGTH;
   }
   
   // Extract recovery byte (first byte)
   int recovery_byte = signature[0];
   if (recovery_byte < 0x1b || recovery_byte > 0x1e) {
-    Rf_warning("Recovery byte should be between 0x1B and 0x1E.");
-    return ScalarInteger(0);
+    return RECOVER_BAD_RECOVERY_BYTE;
   }
   
-  int recovery_id = recovery_byte - 0x1b;
+  *recovery_id = recovery_byte - 0x1b;
   
   // Verify signature type
   if (signature[1] != 0x30) {
-    Rf_warning("Signature must be of type DER (0x30).");
-    return ScalarInteger(0);
+    return RECOVER_NOT_DER;
   }
   
   // Verify total length
   size_t total_length = signature[2];
   if (total_length + 3 != signature_len) {
-    Rf_warning("Signature length mismatch.");
-    return ScalarInteger(0);
+    return RECOVER_LENGTH_MISMATCH;
   }
   
   // Extract r
   if (signature[3] != 0x02) {
-    Rf_warning("R must be of type integer (0x02).");
-    return ScalarInteger(0);
+    return RECOVER_R_NOT_INTEGER;
   }
-  int r_len = signature[4];
-  if (r_len > 32) {
-    Rf_warning("R length exceeds 32 bytes.");
-    return ScalarInteger(0);
+  size_t r_len = signature[4];
+  if (r_len > 33 || 5 + r_len + 2 > signature_len) {
+    return RECOVER_R_TOO_LONG;
+  }
+  const unsigned char *r = &signature[5];
+  // Skip the sign padding byte of a 33-byte integer
+  if (r_len == 33) {
+    if (r[0] != 0x00) {
+      return RECOVER_R_TOO_LONG;
+    }
+    r++;
+    r_len--;
   }
-  unsigned char r_bytes[32] = {0};
-  memcpy(r_bytes + (32 - r_len), &signature[5], r_len);
+  memset(r_s_compact, 0, 64);
+  memcpy(r_s_compact + (32 - r_len), r, r_len);
   
   // Extract s
-  size_t s_offset = 5 + r_len;
+  size_t s_offset = 5 + signature[4];
   if (signature[s_offset] != 0x02) {
-    Rf_warning("S must be of type integer (0x02).");
-    return ScalarInteger(0);
+    return RECOVER_S_NOT_INTEGER;
   }
-  int s_len = signature[s_offset + 1];
-  if (s_len > 32) {
-    Rf_warning("S length exceeds 32 bytes.");
-    return ScalarInteger(0);
+  size_t s_len = signature[s_offset + 1];
+  if (s_len > 33 || s_offset + 2 + s_len != signature_len) {
+    return RECOVER_S_TOO_LONG;
   }
-  unsigned char s_bytes[32] = {0};
-  memcpy(s_bytes + (32 - s_len), &signature[s_offset + 2], s_len);
-  
+  const unsigned char *s = &signature[s_offset + 2];
+  if (s_len == 33) {
+    if (s[0] != 0x00) {
+      return RECOVER_S_TOO_LONG;
+    }
+    s++;
+    s_len--;
+  }
+  memcpy(r_s_compact + 32 + (32 - s_len), s, s_len);
+  return 0;
+}
+
+// As parse_der_signature, but a signature of COMPACT_SIGNATURE_LEN bytes
+// that is not DER is taken as r || s || v, v being the recovery byte (or
+// the bare recovery id). Safe on worker threads.
+static int parse_signature(const unsigned char *signature, size_t signature_len,
+                           unsigned char r_s_compact[64], int *recovery_id) {
+  int status = parse_der_signature(signature, signature_len, r_s_compact, recovery_id);
+  if (status == 0 || signature_len != COMPACT_SIGNATURE_LEN) {
+    return status;
+  }
+  int v = signature[64] >= 0x1b ? signature[64] - 0x1b : signature[64];
+  if (v > 3) {
+    return RECOVER_BAD_COMPACT_V;
+  }
+  memcpy(r_s_compact, signature, 64);
+  *recovery_id = v;
+  return 0;
+}
+
+// Recover the 33-byte compressed public key from a recovery byte + DER or
+// a compact signature of signature_len bytes. Returns 0 on success or an index into
+// recover_errors. Makes no R API calls, so it is safe on worker threads.
+int recover_public_key(const secp256k1_context *ctx, const unsigned char *signature, size_t signature_len,
+                       const unsigned char *hash, unsigned char *pubkey_output) {
+  size_t pubkey_output_len = 33;
   unsigned char r_s_compact[64];
-  memcpy(r_s_compact, r_bytes, 32);
-  memcpy(r_s_compact + 32, s_bytes, 32);
-  
-  // Initialize context
-  secp256k1_context *ctx = secp256k1_context_create(SECP256K1_CONTEXT_VERIFY);
+  int recovery_id;
+  int status = parse_signature(signature, signature_len, r_s_compact, &recovery_id);
+  if (status != 0) {
+    return status;
+  }
   
   // Create recoverable signature from r and s
   secp256k1_ecdsa_recoverable_signature sig;
   if (!secp256k1_ecdsa_recoverable_signature_parse_compact(ctx, &sig, r_s_compact, recovery_id)) {
-    secp256k1_context_destroy(ctx);
-    Rf_warning("Failed to parse compact signature.");
-    return ScalarInteger(0);
+    return RECOVER_BAD_COMPACT;
   }
   
   // Recover public key
   secp256k1_pubkey pubkey;
   if (!secp256k1_ecdsa_recover(ctx, &pubkey, &sig, hash)) {
-    secp256k1_context_destroy(ctx);
-    Rf_warning("Failed to recover public key.");
-    return ScalarInteger(0);
+    return RECOVER_FAILED;
   }
   
   // Serialize public key in compressed format
   if (!secp256k1_ec_pubkey_serialize(ctx, pubkey_output, &pubkey_output_len, &pubkey, SECP256K1_EC_COMPRESSED)) {
-    secp256k1_context_destroy(ctx);
-    Rf_warning("Failed to serialize public key.");
-    return ScalarInteger(0);
+    return RECOVER_SERIALIZE_FAILED;
+  }
+  
+  return 0;
+}
+
+// Check a recovery byte + DER or compact signature against a parsed public
+// key with secp256k1_ecdsa_verify, without recovering anything. High-S
+// signatures are normalized first, as recovery accepts them too. Returns 1
+// if valid.
+int verify_signature_direct(const secp256k1_context *ctx, const unsigned char *signature, size_t signature_len,
+                            const unsigned char *hash, const secp256k1_pubkey *pubkey) {
+  unsigned char r_s_compact[64];
+  int recovery_id;
+  if (parse_signature(signature, signature_len, r_s_compact, &recovery_id) != 0) {
+    return 0;
+  }
+  secp256k1_ecdsa_signature sig;
+  if (!secp256k1_ecdsa_signature_parse_compact(ctx, &sig, r_s_compact)) {
+    return 0;
+  }
+  secp256k1_ecdsa_signature_normalize(ctx, &sig, &sig);
+  return secp256k1_ecdsa_verify(ctx, &sig, hash, pubkey);
+}
+
+
+// Recover the public key of one signature, a hex string or a raw vector
+// that is parsed in place. Warns and returns 0 when recovery fails.
+SEXP ecrecover_R(SEXP signature_R, SEXP hash_R) {
+  if (TYPEOF(hash_R) != RAWSXP || XLENGTH(hash_R) != 32) {
+    error("The hash must be a 32-byte raw vector.");
   }
+  if (signature_count(signature_R) != 1) {
+    error("Provide a single signature.");
+  }
+  size_t signature_len;
+  int status;
+  const unsigned char **signature = decode_signatures(signature_R, 1, &signature_len, &status);
   
-  // Clean up context
-  secp256k1_context_destroy(ctx);
+  unsigned char pubkey_output[33];
+  if (status == 0) {
+    status = recover_public_key_cached(get_context(), signature[0], signature_len, RAW(hash_R), pubkey_output);
+  }
+  if (status != 0) {
+    Rf_warning("%s", recover_errors[status]);
+    return ScalarInteger(0);
+  }
   
   // Convert public key to an R raw vector
-  SEXP pubkey_output_R = PROTECT(allocVector(RAWSXP, pubkey_output_len));
-  memcpy(RAW(pubkey_output_R), pubkey_output, pubkey_output_len);
+  SEXP pubkey_output_R = PROTECT(allocVector(RAWSXP, 33));
+  memcpy(RAW(pubkey_output_R), pubkey_output, 33);
   
   UNPROTECT(1);
   return pubkey_output_R; // Return public key as raw vector
 }
+
+
+// The number of signatures in a character vector of hex strings, a list of
+// raw vectors, a raw matrix with one signature per column or a single raw
+// vector
+R_xlen_t signature_count(SEXP signatures_R) {
+  switch (TYPEOF(signatures_R)) {
+  case STRSXP:
+  case VECSXP:
+    return XLENGTH(signatures_R);
+  case RAWSXP: {
+    SEXP dim = getAttrib(signatures_R, R_DimSymbol);
+    return (TYPEOF(dim) == INTSXP && LENGTH(dim) == 2) ? INTEGER(dim)[1] : 1;
+  }
+  default:
+    error("Signatures must be hexadecimal strings or raw vectors.");
+  }
+  return 0;  // not reached
+}
+
+// Point signatures[i] at the bytes of the n signatures counted by
+// signature_count(), so worker threads can read them. Raw signatures are
+// used in place and only hex strings are decoded, into R_alloc'ed slots of
+// MAX_SIGNATURE_LEN bytes. status[i] is 0 for a signature and
+// RECOVER_BAD_HEX for NA strings, strings that are not hex or too long, and
+// list elements that are not raw; lengths are left to parse_signature().
+const unsigned char** decode_signatures(SEXP signatures_R, R_xlen_t n, size_t *signature_lens, int *status) {
+  const unsigned char **signatures = (const unsigned char **) R_alloc(n + 1, sizeof(unsigned char *));
+  unsigned char *decoded = (TYPEOF(signatures_R) == STRSXP) ? (unsigned char *) R_alloc(n * MAX_SIGNATURE_LEN + 1, 1) : NULL;
+  size_t column_len = (TYPEOF(signatures_R) == RAWSXP && n > 0) ? (size_t) (XLENGTH(signatures_R) / n) : 0;
+  for (R_xlen_t i = 0; i < n; i++) {
+    signatures[i] = NULL;
+    signature_lens[i] = 0;
+    if (TYPEOF(signatures_R) == RAWSXP) {
+      signatures[i] = RAW(signatures_R) + i * column_len;
+      signature_lens[i] = column_len;
+    } else if (TYPEOF(signatures_R) == VECSXP) {
+      SEXP el = VECTOR_ELT(signatures_R, i);
+      if (TYPEOF(el) == RAWSXP) {
+        signatures[i] = RAW(el);
+        signature_lens[i] = (size_t) XLENGTH(el);
+      }
+    } else {
+      SEXP hex_r = STRING_ELT(signatures_R, i);
+      size_t hex_len = (hex_r == NA_STRING) ? 0 : (size_t) LENGTH(hex_r);
+      if (hex_r != NA_STRING && hex_len <= 2 * MAX_SIGNATURE_LEN &&
+          hex_decode(CHAR(hex_r), hex_len, decoded + i * MAX_SIGNATURE_LEN)) {
+        signatures[i] = decoded + i * MAX_SIGNATURE_LEN;
+        signature_lens[i] = hex_len / 2;
+      }
+    }
+    status[i] = (signatures[i] == NULL) ? RECOVER_BAD_HEX : 0;
+  }
+  return signatures;
+}
+
+// The number of public keys in hex strings, a raw vector of concatenated
+// 33-byte compressed keys (the columns of a raw matrix) or a list of raw
+// vectors and key handles
+R_xlen_t public_key_count(SEXP pubkeys_R) {
+  switch (TYPEOF(pubkeys_R)) {
+  case STRSXP:
+  case VECSXP:
+    return XLENGTH(pubkeys_R);
+  case RAWSXP:
+    if (XLENGTH(pubkeys_R) % 33 != 0) {
+      error("Raw public keys must be 33 bytes each.");
+    }
+    return XLENGTH(pubkeys_R) / 33;
+  default:
+    error("Public keys must be hexadecimal strings or raw vectors.");
+  }
+  return 0;  // not reached
+}
+
+// Point pubkeys[i] at the bytes of the n keys counted by public_key_count(),
+// decoding hex into R_alloc'ed memory, so worker threads can read them.
+// status[i] is 0 for a key of 33 or 65 bytes and 1 for keys that are NA,
+// NULL, not hex or of another length.
+void decode_public_keys(SEXP pubkeys_R, R_xlen_t n, const unsigned char **pubkeys, size_t *pubkey_lens, int *status) {
+  unsigned char *decoded = (TYPEOF(pubkeys_R) == STRSXP) ? (unsigned char *) R_alloc(n * MAX_PUBKEY_LEN + 1, 1) : NULL;
+  for (R_xlen_t i = 0; i < n; i++) {
+    status[i] = 1;
+    pubkey_lens[i] = 0;
+    if (TYPEOF(pubkeys_R) == RAWSXP) {
+      pubkeys[i] = RAW(pubkeys_R) + i * 33;
+      pubkey_lens[i] = 33;
+    } else if (TYPEOF(pubkeys_R) == VECSXP) {
+      SEXP el = VECTOR_ELT(pubkeys_R, i);
+      const public_key_handle *handle = public_key_handle_from_R(el);
+      if (handle != NULL) {
+        pubkeys[i] = handle->compressed;
+        pubkey_lens[i] = 33;
+      } else if (TYPEOF(el) == RAWSXP) {
+        pubkeys[i] = RAW(el);
+        pubkey_lens[i] = (size_t) XLENGTH(el);
+      } else {
+        continue;
+      }
+    } else {
+      SEXP hex_r = STRING_ELT(pubkeys_R, i);
+      size_t hex_len = (hex_r == NA_STRING) ? 0 : (size_t) LENGTH(hex_r);
+      if (hex_len > 2 * MAX_PUBKEY_LEN || !hex_decode(CHAR(hex_r), hex_len, decoded + i * MAX_PUBKEY_LEN)) {
+        continue;
+      }
+      pubkeys[i] = decoded + i * MAX_PUBKEY_LEN;
+      pubkey_lens[i] = hex_len / 2;
+    }
+    status[i] = (pubkey_lens[i] != 33 && pubkey_lens[i] != 65);
+  }
+}
+
+typedef struct {
+  const unsigned char **signatures; // n signatures of signature_lens bytes
+  const size_t *signature_lens;
+  const unsigned char *hashes;      // n concatenated 32-byte hashes
+  unsigned char *pubkeys;           // n concatenated 33-byte outputs
+  int *status;
+} recover_batch;
+
+static void recover_worker(void *data, const secp256k1_context *ctx, R_xlen_t begin, R_xlen_t end) {
+  recover_batch *batch = (recover_batch *) data;
+  for (R_xlen_t i = begin; i < end; i++) {
+    if (batch->status[i] != 0) {
+      continue;
+    }
+    batch->status[i] = recover_public_key_cached(ctx, batch->signatures[i], batch->signature_lens[i],
+                                                 batch->hashes + i * 32, batch->pubkeys + i * 33);
+  }
+}
+
+// Recover the public keys of many (signature, hash) pairs, spread across
+// n_threads worker threads. Returns a character vector of compressed public
+// keys in hex, with NA where the signature could not be recovered.
+SEXP ecrecover_batch_R(SEXP signatures_R, SEXP hashes_R, SEXP n_threads_R) {
+  R_xlen_t n = signature_count(signatures_R);
+  if (TYPEOF(hashes_R) != RAWSXP || XLENGTH(hashes_R) != n * 32) {
+    error("Hashes must be a raw vector of one 32-byte hash per signature.");
+  }
+  int n_threads = asInteger(n_threads_R);
+  
+  recover_batch batch;
+  size_t *signature_lens = (size_t *) R_alloc(n + 1, sizeof(size_t));
+  unsigned char *pubkeys = (unsigned char *) R_alloc(n * 33 + 1, 1);
+  int *status = (int *) R_alloc(n + 1, sizeof(int));
+  
+  // Decode the signatures here, the workers must not touch R objects
+  const unsigned char **signatures = decode_signatures(signatures_R, n, signature_lens, status);
+  
+  batch.signatures = signatures;
+  batch.signature_lens = signature_lens;
+  batch.hashes = RAW(hashes_R);
+  batch.pubkeys = pubkeys;
+  batch.status = status;
+  parallel_for(n, n_threads, recover_worker, &batch, 1);
+  
+  SEXP result = PROTECT(allocVector(STRSXP, n));
+  char hex[67];
+  for (R_xlen_t i = 0; i < n; i++) {
+    if (status[i] != 0) {
+      SET_STRING_ELT(result, i, NA_STRING);
+    } else {
+      bytes_to_hex(pubkeys + i * 33, 33, hex);
+      SET_STRING_ELT(result, i, mkCharLen(hex, 66));
+    }
+  }
+  
+  UNPROTECT(1);
+  return result;
+}
+
+
+typedef struct {
+  const unsigned char **signatures; // n signatures of signature_lens bytes
+  const size_t *signature_lens;
+  const unsigned char *hashes;      // n concatenated 32-byte hashes
+  const unsigned char **keys;       // n keys, or NULL when one key is shared
+  const size_t *key_lens;
+  const secp256k1_pubkey *shared_key;
+  int *status;                      // in: 0 if the inputs decoded; out: 1 if valid
+} verify_batch;
+
+static void verify_worker(void *data, const secp256k1_context *ctx, R_xlen_t begin, R_xlen_t end) {
+  verify_batch *batch = (verify_batch *) data;
+  for (R_xlen_t i = begin; i < end; i++) {
+    if (batch->status[i] != 0) {
+      batch->status[i] = 0;
+      continue;
+    }
+    secp256k1_pubkey parsed;
+    const secp256k1_pubkey *pubkey = batch->shared_key;
+    if (pubkey == NULL) {
+      if (!secp256k1_ec_pubkey_parse(ctx, &parsed, batch->keys[i], batch->key_lens[i])) {
+        continue;
+      }
+      pubkey = &parsed;
+    }
+    batch->status[i] = verify_signature_direct(ctx, batch->signatures[i], batch->signature_lens[i],
+                                               batch->hashes + i * 32, pubkey);
+  }
+}
+
+// Verify many (signature, hash) pairs against known public keys, one per
+// signature or a single key (possibly a key handle) for all, with
+// secp256k1_ecdsa_verify. Returns a logical vector; malformed keys or
+// signatures are FALSE.
+SEXP verify_batch_R(SEXP pubkeys_R, SEXP signatures_R, SEXP hashes_R, SEXP n_threads_R) {
+  R_xlen_t n = signature_count(signatures_R);
+  if (TYPEOF(hashes_R) != RAWSXP || XLENGTH(hashes_R) != n * 32) {
+    error("Hashes must be a raw vector of one 32-byte hash per signature.");
+  }
+  const public_key_handle *handle = public_key_handle_from_R(pubkeys_R);
+  R_xlen_t n_keys = handle ? 1 : public_key_count(pubkeys_R);
+  if (n_keys != n && n_keys != 1) {
+    error("Provide one public key per signature or a single public key.");
+  }
+  int n_threads = asInteger(n_threads_R);
+  
+  const unsigned char **keys = (const unsigned char **) R_alloc(n_keys + 1, sizeof(unsigned char *));
+  size_t *key_lens = (size_t *) R_alloc(n_keys + 1, sizeof(size_t));
+  int *key_status = (int *) R_alloc(n_keys + 1, sizeof(int));
+  if (handle == NULL) {
+    decode_public_keys(pubkeys_R, n_keys, keys, key_lens, key_status);
+  }
+  
+  size_t *signature_lens = (size_t *) R_alloc(n + 1, sizeof(size_t));
+  int *status = (int *) R_alloc(n + 1, sizeof(int));
+  const unsigned char **signatures = decode_signatures(signatures_R, n, signature_lens, status);
+  
+  // A key shared by all signatures is parsed once, here
+  secp256k1_pubkey shared_key;
+  verify_batch batch;
+  batch.keys = NULL;
+  batch.key_lens = NULL;
+  batch.shared_key = NULL;
+  if (handle != NULL) {
+    batch.shared_key = &handle->pubkey;
+  } else if (n_keys == 1 && n > 1) {
+    if (key_status[0] != 0 || !secp256k1_ec_pubkey_parse(get_context(), &shared_key, keys[0], key_lens[0])) {
+      for (R_xlen_t i = 0; i < n; i++) {
+        status[i] = 1;
+      }
+    }
+    batch.shared_key = &shared_key;
+  } else {
+    for (R_xlen_t i = 0; i < n; i++) {
+      status[i] |= key_status[i];
+    }
+    batch.keys = keys;
+    batch.key_lens = key_lens;
+  }
+  
+  batch.signatures = signatures;
+  batch.signature_lens = signature_lens;
+  batch.hashes = RAW(hashes_R);
+  batch.status = status;
+  parallel_for(n, n_threads, verify_worker, &batch, 1);
+  
+  SEXP result = PROTECT(allocVector(LGLSXP, n));
+  for (R_xlen_t i = 0; i < n; i++) {
+    LOGICAL(result)[i] = status[i];
+  }
+  UNPROTECT(1);
+  return result;
+}
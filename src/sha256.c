@@ -0,0 +1,523 @@
+#include <R.h>
+#include <Rinternals.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "flureeCrypto.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#include <cpuid.h>
+#define SHA256_X86 1
+#elif defined(__aarch64__) && (defined(__ARM_FEATURE_SHA2) || defined(__ARM_FEATURE_CRYPTO))
+#include <arm_neon.h>
+#define SHA256_ARM 1
+#endif
+
+
+static const uint32_t sha256_k[64] = {
+  0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+  0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+  0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+  0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+  0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+  0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+  0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+  0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static const uint32_t sha256_iv[8] = {
+  0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+// Compress nblocks consecutive 64-byte blocks into state
+typedef void (*sha256_blocks_fn)(uint32_t state[8], const unsigned char *data, size_t nblocks);
+
+
+static inline uint32_t load_be32(const unsigned char *p) {
+  return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | (uint32_t) p[3];
+}
+
+static inline void store_be32(unsigned char *p, uint32_t x) {
+  p[0] = (unsigned char) (x >> 24);
+  p[1] = (unsigned char) (x >> 16);
+  p[2] = (unsigned char) (x >> 8);
+  p[3] = (unsigned char) x;
+}
+
+#define ROTR32(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+// Portable compression function
+static void sha256_blocks_generic(uint32_t state[8], const unsigned char *data, size_t nblocks) {
+  uint32_t w[16];
+  while (nblocks--) {
+    uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+    uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+    for (int t = 0; t < 64; t++) {
+      if (t < 16) {
+        w[t] = load_be32(data + 4 * t);
+      } else {
+        uint32_t w15 = w[(t - 15) & 15], w2 = w[(t - 2) & 15];
+        uint32_t s0 = ROTR32(w15, 7) ^ ROTR32(w15, 18) ^ (w15 >> 3);
+        uint32_t s1 = ROTR32(w2, 17) ^ ROTR32(w2, 19) ^ (w2 >> 10);
+        w[t & 15] += s0 + w[(t - 7) & 15] + s1;
+      }
+      uint32_t t1 = h + (ROTR32(e, 6) ^ ROTR32(e, 11) ^ ROTR32(e, 25)) + ((e & f) ^ (~e & g)) + sha256_k[t] + w[t & 15];
+      uint32_t t2 = (ROTR32(a, 2) ^ ROTR32(a, 13) ^ ROTR32(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+      h = g; g = f; f = e; e = d + t1;
+      d = c; c = b; b = a; a = t1 + t2;
+    }
+    state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+    state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+    data += 64;
+  }
+}
+
+
+#ifdef SHA256_X86
+// SHA-NI compression. The state is kept as the ABEF / CDGH register pair
+// the sha256rnds2 instruction works on.
+__attribute__((target("sha,sse4.1,ssse3")))
+static void sha256_blocks_shani(uint32_t state[8], const unsigned char *data, size_t nblocks) {
+  const __m128i shuffle = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+  __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *) &state[0]), 0xb1);  // CDAB
+  __m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *) &state[4]), 0x1b);  // EFGH
+  __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);  // ABEF
+  state1 = _mm_blend_epi16(state1, tmp, 0xf0);  // CDGH
+
+  while (nblocks--) {
+    __m128i abef = state0, cdgh = state1;
+    __m128i msg[4];
+#pragma GCC unroll 16
+    for (int g = 0; g < 16; g++) {
+      if (g < 4) {
+        msg[g] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (data + 16 * g)), shuffle);
+      } else {
+        __m128i w7 = _mm_alignr_epi8(msg[(g + 3) & 3], msg[(g + 2) & 3], 4);
+        msg[g & 3] = _mm_sha256msg2_epu32(_mm_add_epi32(_mm_sha256msg1_epu32(msg[g & 3], msg[(g + 1) & 3]), w7),
+                                          msg[(g + 3) & 3]);
+      }
+      __m128i wk = _mm_add_epi32(msg[g & 3], _mm_loadu_si128((const __m128i *) &sha256_k[4 * g]));
+      state1 = _mm_sha256rnds2_epu32(state1, state0, wk);
+      state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(wk, 0x0e));
+    }
+    state0 = _mm_add_epi32(state0, abef);
+    state1 = _mm_add_epi32(state1, cdgh);
+    data += 64;
+  }
+
+  tmp = _mm_shuffle_epi32(state0, 0x1b);  // FEBA
+  state1 = _mm_shuffle_epi32(state1, 0xb1);  // DCHG
+  _mm_storeu_si128((__m128i *) &state[0], _mm_blend_epi16(tmp, state1, 0xf0));  // DCBA
+  _mm_storeu_si128((__m128i *) &state[4], _mm_alignr_epi8(state1, tmp, 8));  // HGFE
+}
+
+static int cpu_has_shani() {
+  unsigned int eax, ebx, ecx, edx;
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_SSE4_1) || !(ecx & bit_SSSE3)) {
+    return 0;
+  }
+  if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+    return 0;
+  }
+  return (ebx >> 29) & 1;
+}
+
+
+// AVX2 multi-buffer compression: one block of each of eight independent
+// messages per call. st holds the eight states transposed, st[word][lane].
+#define MB_ROTR(x, n) _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - (n)))
+
+__attribute__((target("avx2")))
+static void sha256_block_x8_avx2(uint32_t st[8][8], const unsigned char *const blocks[8]) {
+  __m256i w[16];
+  __m256i a = _mm256_loadu_si256((const __m256i *) st[0]), b = _mm256_loadu_si256((const __m256i *) st[1]);
+  __m256i c = _mm256_loadu_si256((const __m256i *) st[2]), d = _mm256_loadu_si256((const __m256i *) st[3]);
+  __m256i e = _mm256_loadu_si256((const __m256i *) st[4]), f = _mm256_loadu_si256((const __m256i *) st[5]);
+  __m256i g = _mm256_loadu_si256((const __m256i *) st[6]), h = _mm256_loadu_si256((const __m256i *) st[7]);
+
+  for (int t = 0; t < 64; t++) {
+    if (t < 16) {
+      w[t] = _mm256_setr_epi32((int) load_be32(blocks[0] + 4 * t), (int) load_be32(blocks[1] + 4 * t),
+                               (int) load_be32(blocks[2] + 4 * t), (int) load_be32(blocks[3] + 4 * t),
+                               (int) load_be32(blocks[4] + 4 * t), (int) load_be32(blocks[5] + 4 * t),
+                               (int) load_be32(blocks[6] + 4 * t), (int) load_be32(blocks[7] + 4 * t));
+    } else {
+      __m256i w15 = w[(t - 15) & 15], w2 = w[(t - 2) & 15];
+      __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(MB_ROTR(w15, 7), MB_ROTR(w15, 18)), _mm256_srli_epi32(w15, 3));
+      __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(MB_ROTR(w2, 17), MB_ROTR(w2, 19)), _mm256_srli_epi32(w2, 10));
+      w[t & 15] = _mm256_add_epi32(_mm256_add_epi32(w[t & 15], s0), _mm256_add_epi32(w[(t - 7) & 15], s1));
+    }
+    __m256i sum1 = _mm256_xor_si256(_mm256_xor_si256(MB_ROTR(e, 6), MB_ROTR(e, 11)), MB_ROTR(e, 25));
+    __m256i ch = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+    __m256i t1 = _mm256_add_epi32(_mm256_add_epi32(h, sum1),
+                                  _mm256_add_epi32(ch, _mm256_add_epi32(_mm256_set1_epi32((int) sha256_k[t]), w[t & 15])));
+    __m256i sum0 = _mm256_xor_si256(_mm256_xor_si256(MB_ROTR(a, 2), MB_ROTR(a, 13)), MB_ROTR(a, 22));
+    __m256i maj = _mm256_or_si256(_mm256_and_si256(a, b), _mm256_and_si256(c, _mm256_or_si256(a, b)));
+    __m256i t2 = _mm256_add_epi32(sum0, maj);
+    h = g; g = f; f = e; e = _mm256_add_epi32(d, t1);
+    d = c; c = b; b = a; a = _mm256_add_epi32(t1, t2);
+  }
+
+  _mm256_storeu_si256((__m256i *) st[0], _mm256_add_epi32(a, _mm256_loadu_si256((const __m256i *) st[0])));
+  _mm256_storeu_si256((__m256i *) st[1], _mm256_add_epi32(b, _mm256_loadu_si256((const __m256i *) st[1])));
+  _mm256_storeu_si256((__m256i *) st[2], _mm256_add_epi32(c, _mm256_loadu_si256((const __m256i *) st[2])));
+  _mm256_storeu_si256((__m256i *) st[3], _mm256_add_epi32(d, _mm256_loadu_si256((const __m256i *) st[3])));
+  _mm256_storeu_si256((__m256i *) st[4], _mm256_add_epi32(e, _mm256_loadu_si256((const __m256i *) st[4])));
+  _mm256_storeu_si256((__m256i *) st[5], _mm256_add_epi32(f, _mm256_loadu_si256((const __m256i *) st[5])));
+  _mm256_storeu_si256((__m256i *) st[6], _mm256_add_epi32(g, _mm256_loadu_si256((const __m256i *) st[6])));
+  _mm256_storeu_si256((__m256i *) st[7], _mm256_add_epi32(h, _mm256_loadu_si256((const __m256i *) st[7])));
+}
+#endif
+
+
+#ifdef SHA256_ARM
+// ARMv8 SHA2 extension compression
+static void sha256_blocks_arm(uint32_t state[8], const unsigned char *data, size_t nblocks) {
+  uint32x4_t state0 = vld1q_u32(&state[0]);
+  uint32x4_t state1 = vld1q_u32(&state[4]);
+
+  while (nblocks--) {
+    uint32x4_t abcd = state0, efgh = state1;
+    uint32x4_t msg[4];
+    for (int i = 0; i < 4; i++) {
+      msg[i] = vreinterpretq_u32_u8(vrev32q_u8(vld1q_u8(data + 16 * i)));
+    }
+    for (int g = 0; g < 16; g++) {
+      uint32x4_t wk = vaddq_u32(msg[g & 3], vld1q_u32(&sha256_k[4 * g]));
+      uint32x4_t prev = state0;
+      state0 = vsha256hq_u32(state0, state1, wk);
+      state1 = vsha256h2q_u32(state1, prev, wk);
+      if (g < 12) {
+        msg[g & 3] = vsha256su1q_u32(vsha256su0q_u32(msg[g & 3], msg[(g + 1) & 3]), msg[(g + 2) & 3], msg[(g + 3) & 3]);
+      }
+    }
+    state0 = vaddq_u32(state0, abcd);
+    state1 = vaddq_u32(state1, efgh);
+    data += 64;
+  }
+
+  vst1q_u32(&state[0], state0);
+  vst1q_u32(&state[4], state1);
+}
+#endif
+
+
+// Pick the compression function once, on first use
+static sha256_blocks_fn sha256_blocks = sha256_blocks_generic;
+static const char *sha256_backend = "generic";
+static int sha256_use_avx2 = 0;
+static pthread_once_t sha256_once = PTHREAD_ONCE_INIT;
+
+static void sha256_select() {
+#if defined(SHA256_X86)
+  sha256_use_avx2 = __builtin_cpu_supports("avx2");
+  if (cpu_has_shani()) {
+    sha256_blocks = sha256_blocks_shani;
+    sha256_backend = sha256_use_avx2 ? "sha-ni+avx2" : "sha-ni";
+  } else if (sha256_use_avx2) {
+    sha256_backend = "avx2";
+  }
+#elif defined(SHA256_ARM)
+  sha256_blocks = sha256_blocks_arm;
+  sha256_backend = "armv8";
+#endif
+}
+
+static inline void sha256_dispatch() {
+  pthread_once(&sha256_once, sha256_select);
+}
+
+
+void sha256_init(sha256_ctx *ctx) {
+  sha256_dispatch();
+  memcpy(ctx->state, sha256_iv, sizeof(sha256_iv));
+  ctx->bytes = 0;
+  ctx->buffer_len = 0;
+}
+
+void sha256_update(sha256_ctx *ctx, const unsigned char *data, size_t len) {
+  ctx->bytes += len;
+  if (ctx->buffer_len > 0) {
+    size_t take = 64 - ctx->buffer_len;
+    if (take > len) {
+      take = len;
+    }
+    memcpy(ctx->buffer + ctx->buffer_len, data, take);
+    ctx->buffer_len += take;
+    data += take;
+    len -= take;
+    if (ctx->buffer_len < 64) {
+      return;
+    }
+    sha256_blocks(ctx->state, ctx->buffer, 1);
+    ctx->buffer_len = 0;
+  }
+  if (len >= 64) {
+    sha256_blocks(ctx->state, data, len / 64);
+    data += len & ~(size_t) 63;
+    len &= 63;
+  }
+  memcpy(ctx->buffer, data, len);
+  ctx->buffer_len = len;
+}
+
+void sha256_final(sha256_ctx *ctx, unsigned char out[32]) {
+  uint64_t bits = ctx->bytes * 8;
+  unsigned char pad[72] = {0x80};
+  size_t pad_len = (ctx->buffer_len < 56) ? 56 - ctx->buffer_len : 120 - ctx->buffer_len;
+  for (int i = 0; i < 8; i++) {
+    pad[pad_len + i] = (unsigned char) (bits >> (56 - 8 * i));
+  }
+  sha256_update(ctx, pad, pad_len + 8);
+  for (int i = 0; i < 8; i++) {
+    store_be32(out + 4 * i, ctx->state[i]);
+  }
+  secure_wipe(ctx, sizeof(*ctx));
+}
+
+// Hash len bytes of data in one call. Whole blocks are compressed straight
+// from the input; only the padded tail is copied.
+void sha256(const unsigned char *data, size_t len, unsigned char out[32]) {
+  uint32_t state[8];
+  unsigned char tail[128] = {0};
+  size_t rem = len & 63;
+  size_t tail_blocks = (rem < 56) ? 1 : 2;
+  uint64_t bits = (uint64_t) len * 8;
+
+  sha256_dispatch();
+  memcpy(state, sha256_iv, sizeof(sha256_iv));
+  if (len >= 64) {
+    sha256_blocks(state, data, len / 64);
+  }
+  memcpy(tail, data + (len - rem), rem);
+  tail[rem] = 0x80;
+  for (int i = 0; i < 8; i++) {
+    tail[64 * tail_blocks - 8 + i] = (unsigned char) (bits >> (56 - 8 * i));
+  }
+  sha256_blocks(state, tail, tail_blocks);
+  for (int i = 0; i < 8; i++) {
+    store_be32(out + 4 * i, state[i]);
+  }
+  secure_wipe(tail, sizeof(tail));
+}
+
+
+#ifdef SHA256_X86
+// Hash n messages eight at a time with the AVX2 multi-buffer kernel. Each
+// lane walks through the whole blocks of its message and then through a
+// padded copy of the tail; when a lane finishes it takes the next message.
+// Once the queue is empty and only a couple of lanes are still busy, they
+// are finished one at a time with the scalar code.
+static void sha256_many_avx2(const unsigned char *const *data, const size_t *lens, size_t n, unsigned char *out) {
+  static const unsigned char idle_block[64] = {0};
+  uint32_t st[8][8];
+  const unsigned char *blocks[8];
+  unsigned char tails[8][128];
+  struct {
+    size_t msg;          // message index, or (size_t) -1 when the lane is idle
+    size_t full_blocks;  // whole blocks of the message itself
+    size_t total_blocks; // whole blocks plus the one or two padded tail blocks
+    size_t pos;          // next block to compress
+  } lane[8];
+  size_t queued = 0;
+  int active = 0;
+
+  for (int l = 0; l < 8; l++) {
+    lane[l].msg = (size_t) -1;
+  }
+
+  for (;;) {
+    // Refill idle lanes from the queue
+    for (int l = 0; l < 8 && queued < n; l++) {
+      if (lane[l].msg != (size_t) -1) {
+        continue;
+      }
+      size_t len = lens[queued];
+      size_t rem = len & 63;
+      size_t tail_blocks = (rem < 56) ? 1 : 2;
+      uint64_t bits = (uint64_t) len * 8;
+      lane[l].msg = queued;
+      lane[l].full_blocks = len / 64;
+      lane[l].total_blocks = len / 64 + tail_blocks;
+      lane[l].pos = 0;
+      memset(tails[l], 0, sizeof(tails[l]));
+      memcpy(tails[l], data[queued] + (len - rem), rem);
+      tails[l][rem] = 0x80;
+      for (int i = 0; i < 8; i++) {
+        tails[l][64 * tail_blocks - 8 + i] = (unsigned char) (bits >> (56 - 8 * i));
+      }
+      for (int i = 0; i < 8; i++) {
+        st[i][l] = sha256_iv[i];
+      }
+      queued++;
+      active++;
+    }
+
+    if (active == 0) {
+      break;
+    }
+    if (queued == n && active <= 2) {
+      // Not worth running eight lanes for one or two messages
+      for (int l = 0; l < 8; l++) {
+        if (lane[l].msg == (size_t) -1) {
+          continue;
+        }
+        uint32_t state[8];
+        for (int i = 0; i < 8; i++) {
+          state[i] = st[i][l];
+        }
+        size_t pos = lane[l].pos;
+        if (pos < lane[l].full_blocks) {
+          sha256_blocks_generic(state, data[lane[l].msg] + 64 * pos, lane[l].full_blocks - pos);
+          pos = lane[l].full_blocks;
+        }
+        sha256_blocks_generic(state, tails[l] + 64 * (pos - lane[l].full_blocks), lane[l].total_blocks - pos);
+        for (int i = 0; i < 8; i++) {
+          store_be32(out + 32 * lane[l].msg + 4 * i, state[i]);
+        }
+      }
+      break;
+    }
+
+    for (int l = 0; l < 8; l++) {
+      size_t pos = lane[l].pos;
+      if (lane[l].msg == (size_t) -1) {
+        blocks[l] = idle_block;
+      } else if (pos < lane[l].full_blocks) {
+        blocks[l] = data[lane[l].msg] + 64 * pos;
+      } else {
+        blocks[l] = tails[l] + 64 * (pos - lane[l].full_blocks);
+      }
+    }
+    sha256_block_x8_avx2(st, blocks);
+
+    for (int l = 0; l < 8; l++) {
+      if (lane[l].msg == (size_t) -1 || ++lane[l].pos < lane[l].total_blocks) {
+        continue;
+      }
+      for (int i = 0; i < 8; i++) {
+        store_be32(out + 32 * lane[l].msg + 4 * i, st[i][l]);
+      }
+      lane[l].msg = (size_t) -1;
+      active--;
+    }
+  }
+
+  secure_wipe(tails, sizeof(tails));
+}
+#endif
+
+// Hash n messages; digest i is written to out + 32 * i. Batches go through
+// the AVX2 multi-buffer kernel where available. SHA-NI compresses a single
+// block faster than one lane of the AVX2 kernel, but for messages of one or
+// two blocks the per-message overhead dominates and eight lanes still win,
+// so with SHA-NI only batches of short messages use the AVX2 kernel.
+void sha256_many(const unsigned char *const *data, const size_t *lens, size_t n, unsigned char *out) {
+  sha256_dispatch();
+#ifdef SHA256_X86
+  if (sha256_use_avx2 && n >= 4) {
+    size_t total = 0;
+    for (size_t i = 0; i < n; i++) {
+      total += lens[i];
+    }
+    if (sha256_blocks == sha256_blocks_generic || total / n < 120) {
+      sha256_many_avx2(data, lens, n, out);
+      return;
+    }
+  }
+#endif
+  for (size_t i = 0; i < n; i++) {
+    sha256(data[i], lens[i], out + 32 * i);
+  }
+}
+
+const char* sha256_implementation() {
+  sha256_dispatch();
+  return sha256_backend;
+}
+
+
+// Hash a raw vector, every string of a character vector or every raw vector
+// of a list. A raw vector gives one 32-byte digest; the other inputs give a
+// 32 x n raw matrix, or with output_hex a character vector in which NA
+// strings and NULL elements stay NA.
+SEXP sha256_R(SEXP x, SEXP output_hex_r) {
+  int output_hex = asLogical(output_hex_r) == TRUE;
+
+  if (TYPEOF(x) == RAWSXP) {
+    unsigned char digest[32];
+    sha256(RAW(x), (size_t) XLENGTH(x), digest);
+    if (output_hex) {
+      char hex[64];
+      hex_encode(digest, 32, hex);
+      return ScalarString(mkCharLen(hex, 64));
+    }
+    SEXP result = PROTECT(allocVector(RAWSXP, 32));
+    memcpy(RAW(result), digest, 32);
+    UNPROTECT(1);
+    return result;
+  }
+  if (TYPEOF(x) != STRSXP && TYPEOF(x) != VECSXP) {
+    error("Input must be a raw vector, a character vector or a list of raw vectors.");
+  }
+
+  // Collect the messages that are present, then hash them in one batch
+  R_xlen_t n = XLENGTH(x);
+  const unsigned char **data = (const unsigned char **) R_alloc(n > 0 ? n : 1, sizeof(unsigned char *));
+  size_t *lens = (size_t *) R_alloc(n > 0 ? n : 1, sizeof(size_t));
+  R_xlen_t *index = (R_xlen_t *) R_alloc(n > 0 ? n : 1, sizeof(R_xlen_t));
+  R_xlen_t present = 0;
+  for (R_xlen_t i = 0; i < n; i++) {
+    if (TYPEOF(x) == STRSXP) {
+      SEXP s = STRING_ELT(x, i);
+      if (s == NA_STRING) {
+        continue;
+      }
+      data[present] = (const unsigned char *) CHAR(s);
+      lens[present] = (size_t) LENGTH(s);
+    } else {
+      SEXP el = VECTOR_ELT(x, i);
+      if (el == R_NilValue) {
+        continue;
+      }
+      if (TYPEOF(el) != RAWSXP) {
+        error("Element %lld is not a raw vector.", (long long) i + 1);
+      }
+      data[present] = RAW(el);
+      lens[present] = (size_t) XLENGTH(el);
+    }
+    index[present++] = i;
+  }
+  if (!output_hex && present < n) {
+    error("Cannot hash missing values into a raw matrix.");
+  }
+
+  if (output_hex) {
+    unsigned char *digests = (unsigned char *) R_alloc(present > 0 ? present : 1, 32);
+    sha256_many(data, lens, (size_t) present, digests);
+    SEXP result = PROTECT(allocVector(STRSXP, n));
+    char hex[64];
+    for (R_xlen_t i = 0; i < n; i++) {
+      SET_STRING_ELT(result, i, NA_STRING);
+    }
+    for (R_xlen_t j = 0; j < present; j++) {
+      hex_encode(digests + 32 * j, 32, hex);
+      SET_STRING_ELT(result, index[j], mkCharLen(hex, 64));
+    }
+    UNPROTECT(1);
+    return result;
+  }
+
+  if (n > INT_MAX) {
+    error("Too many messages for a raw matrix.");
+  }
+  SEXP result = PROTECT(allocMatrix(RAWSXP, 32, (int) n));
+  sha256_many(data, lens, (size_t) n, RAW(result));
+  UNPROTECT(1);
+  return result;
+}
+
+SEXP sha256_implementation_R() {
+  return mkString(sha256_implementation());
+}
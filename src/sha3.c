@@ -0,0 +1,441 @@
+#include <R.h>
+#include <Rinternals.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "flureeCrypto.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define SHA3_X86 1
+#endif
+
+
+static const uint64_t keccak_rc[24] = {
+  0x0000000000000001ULL, 0x0000000000008082ULL, 0x800000000000808aULL, 0x8000000080008000ULL,
+  0x000000000000808bULL, 0x0000000080000001ULL, 0x8000000080008081ULL, 0x8000000000008009ULL,
+  0x000000000000008aULL, 0x0000000000000088ULL, 0x0000000080008009ULL, 0x000000008000000aULL,
+  0x000000008000808bULL, 0x800000000000008bULL, 0x8000000000008089ULL, 0x8000000000008003ULL,
+  0x8000000000008002ULL, 0x8000000000000080ULL, 0x000000000000800aULL, 0x800000008000000aULL,
+  0x8000000080008081ULL, 0x8000000000008080ULL, 0x0000000080000001ULL, 0x8000000080008008ULL
+};
+
+// Rotation offsets and lane order of the combined rho and pi steps
+static const int keccak_rotc[24] = {
+  1, 3, 6, 10, 15, 21, 28, 36, 45, 55, 2, 14, 27, 41, 56, 8, 25, 43, 62, 18, 39, 61, 20, 44
+};
+static const int keccak_piln[24] = {
+  10, 7, 11, 17, 18, 3, 5, 16, 8, 21, 24, 4, 15, 23, 19, 13, 12, 2, 20, 14, 22, 9, 6, 1
+};
+
+#define ROTL64(x, n) (((x) << (n)) | ((x) >> (64 - (n))))
+
+static void keccak_f1600(uint64_t st[25]) {
+  uint64_t bc[5], t;
+  for (int round = 0; round < 24; round++) {
+    // Theta
+    for (int i = 0; i < 5; i++) {
+      bc[i] = st[i] ^ st[i + 5] ^ st[i + 10] ^ st[i + 15] ^ st[i + 20];
+    }
+    for (int i = 0; i < 5; i++) {
+      t = bc[(i + 4) % 5] ^ ROTL64(bc[(i + 1) % 5], 1);
+      for (int j = 0; j < 25; j += 5) {
+        st[j + i] ^= t;
+      }
+    }
+    // Rho and pi
+    t = st[1];
+    for (int i = 0; i < 24; i++) {
+      int j = keccak_piln[i];
+      bc[0] = st[j];
+      st[j] = ROTL64(t, keccak_rotc[i]);
+      t = bc[0];
+    }
+    // Chi
+    for (int j = 0; j < 25; j += 5) {
+      for (int i = 0; i < 5; i++) {
+        bc[i] = st[j + i];
+      }
+      for (int i = 0; i < 5; i++) {
+        st[j + i] ^= (~bc[(i + 1) % 5]) & bc[(i + 2) % 5];
+      }
+    }
+    // Iota
+    st[0] ^= keccak_rc[round];
+  }
+}
+
+#ifdef SHA3_X86
+// Four-way AVX2 Keccak-f[1600]: four independent states, st[lane word][state].
+// AVX2 has no 64-bit rotate, so rotations are two shifts and an or.
+#define X4_ROTL(x, n) _mm256_or_si256(_mm256_sll_epi64(x, _mm_cvtsi32_si128(n)), \
+                                      _mm256_srl_epi64(x, _mm_cvtsi32_si128(64 - (n))))
+
+__attribute__((target("avx2")))
+static void keccak_f1600_x4_avx2(uint64_t st[25][4]) {
+  __m256i s[25], bc[5], t;
+  for (int i = 0; i < 25; i++) {
+    s[i] = _mm256_loadu_si256((const __m256i *) st[i]);
+  }
+  for (int round = 0; round < 24; round++) {
+    // Theta
+    for (int i = 0; i < 5; i++) {
+      bc[i] = _mm256_xor_si256(_mm256_xor_si256(_mm256_xor_si256(s[i], s[i + 5]), _mm256_xor_si256(s[i + 10], s[i + 15])),
+                               s[i + 20]);
+    }
+    for (int i = 0; i < 5; i++) {
+      t = _mm256_xor_si256(bc[(i + 4) % 5], X4_ROTL(bc[(i + 1) % 5], 1));
+      for (int j = 0; j < 25; j += 5) {
+        s[j + i] = _mm256_xor_si256(s[j + i], t);
+      }
+    }
+    // Rho and pi
+    t = s[1];
+    for (int i = 0; i < 24; i++) {
+      int j = keccak_piln[i];
+      bc[0] = s[j];
+      s[j] = X4_ROTL(t, keccak_rotc[i]);
+      t = bc[0];
+    }
+    // Chi
+    for (int j = 0; j < 25; j += 5) {
+      for (int i = 0; i < 5; i++) {
+        bc[i] = s[j + i];
+      }
+      for (int i = 0; i < 5; i++) {
+        s[j + i] = _mm256_xor_si256(bc[i], _mm256_andnot_si256(bc[(i + 1) % 5], bc[(i + 2) % 5]));
+      }
+    }
+    // Iota
+    s[0] = _mm256_xor_si256(s[0], _mm256_set1_epi64x((long long) keccak_rc[round]));
+  }
+  for (int i = 0; i < 25; i++) {
+    _mm256_storeu_si256((__m256i *) st[i], s[i]);
+  }
+}
+#endif
+
+
+static inline uint64_t load_le64(const unsigned char *p) {
+  uint64_t x = 0;
+  for (int i = 7; i >= 0; i--) {
+    x = (x << 8) | p[i];
+  }
+  return x;
+}
+
+
+// SHA3 with an out_len-byte digest (32 for SHA3-256, 64 for SHA3-512)
+void sha3_init(sha3_ctx *ctx, size_t out_len) {
+  memset(ctx->state, 0, sizeof(ctx->state));
+  ctx->out_len = out_len;
+  ctx->rate = 200 - 2 * out_len;
+  ctx->pos = 0;
+  ctx->pad = 0x06;
+}
+
+// The original Keccak padding, as used by Ethereum's Keccak-256
+void keccak_init(sha3_ctx *ctx, size_t out_len) {
+  sha3_init(ctx, out_len);
+  ctx->pad = 0x01;
+}
+
+// Absorb bytes one at a time until the position is word aligned, then whole
+// little-endian words
+void sha3_update(sha3_ctx *ctx, const unsigned char *data, size_t len) {
+  size_t pos = ctx->pos;
+  while (len > 0) {
+    if (pos % 8 == 0 && len >= 8) {
+      while (len >= 8 && pos < ctx->rate) {
+        ctx->state[pos / 8] ^= load_le64(data);
+        pos += 8;
+        data += 8;
+        len -= 8;
+      }
+    } else {
+      ctx->state[pos / 8] ^= (uint64_t) *data++ << (8 * (pos % 8));
+      pos++;
+      len--;
+    }
+    if (pos == ctx->rate) {
+      keccak_f1600(ctx->state);
+      pos = 0;
+    }
+  }
+  ctx->pos = pos;
+}
+
+void sha3_final(sha3_ctx *ctx, unsigned char *out) {
+  ctx->state[ctx->pos / 8] ^= (uint64_t) ctx->pad << (8 * (ctx->pos % 8));
+  ctx->state[(ctx->rate - 1) / 8] ^= (uint64_t) 0x80 << (8 * ((ctx->rate - 1) % 8));
+  keccak_f1600(ctx->state);
+  for (size_t i = 0; i < ctx->out_len; i++) {
+    out[i] = (unsigned char) (ctx->state[i / 8] >> (8 * (i % 8)));
+  }
+  secure_wipe(ctx, sizeof(*ctx));
+}
+
+void sha3(const unsigned char *data, size_t len, size_t out_len, unsigned char *out) {
+  sha3_ctx ctx;
+  sha3_init(&ctx, out_len);
+  sha3_update(&ctx, data, len);
+  sha3_final(&ctx, out);
+}
+
+
+// Use the four-way kernel for batches when the CPU has AVX2, decided once
+static const char *sha3_backend = "generic";
+static int sha3_use_avx2 = 0;
+static pthread_once_t sha3_once = PTHREAD_ONCE_INIT;
+
+static void sha3_select() {
+#ifdef SHA3_X86
+  sha3_use_avx2 = __builtin_cpu_supports("avx2");
+  if (sha3_use_avx2) {
+    sha3_backend = "avx2";
+  }
+#endif
+}
+
+static inline void sha3_dispatch() {
+  pthread_once(&sha3_once, sha3_select);
+}
+
+
+#ifdef SHA3_X86
+// Hash n messages four at a time with the AVX2 kernel, the way
+// sha256_many_avx2() does: each lane absorbs the whole rate-sized blocks of
+// its message and then its padded tail block, and takes the next message
+// when it is done. The last message still in flight is finished alone.
+static void sha3_many_avx2(const unsigned char *const *data, const size_t *lens, size_t n, size_t out_len,
+                           unsigned char *out) {
+  const size_t rate = 200 - 2 * out_len;
+  uint64_t st[25][4];
+  unsigned char tails[4][200];
+  struct {
+    size_t msg;          // message index, or (size_t) -1 when the lane is idle
+    size_t full_blocks;  // whole blocks of the message itself; the tail block follows
+    size_t pos;          // next block to absorb
+  } lane[4];
+  size_t queued = 0;
+  int active = 0;
+
+  for (int l = 0; l < 4; l++) {
+    lane[l].msg = (size_t) -1;
+  }
+  memset(st, 0, sizeof(st));
+
+  for (;;) {
+    // Refill idle lanes from the queue
+    for (int l = 0; l < 4 && queued < n; l++) {
+      if (lane[l].msg != (size_t) -1) {
+        continue;
+      }
+      size_t len = lens[queued];
+      size_t rem = len % rate;
+      lane[l].msg = queued;
+      lane[l].full_blocks = len / rate;
+      lane[l].pos = 0;
+      memset(tails[l], 0, rate);
+      memcpy(tails[l], data[queued] + (len - rem), rem);
+      tails[l][rem] ^= 0x06;
+      tails[l][rate - 1] ^= 0x80;
+      for (int i = 0; i < 25; i++) {
+        st[i][l] = 0;
+      }
+      queued++;
+      active++;
+    }
+
+    if (active == 0) {
+      break;
+    }
+    if (queued == n && active == 1) {
+      // Not worth running four lanes for one message
+      for (int l = 0; l < 4; l++) {
+        if (lane[l].msg == (size_t) -1) {
+          continue;
+        }
+        uint64_t state[25];
+        for (int i = 0; i < 25; i++) {
+          state[i] = st[i][l];
+        }
+        for (size_t pos = lane[l].pos; pos <= lane[l].full_blocks; pos++) {
+          const unsigned char *block = (pos < lane[l].full_blocks) ? data[lane[l].msg] + rate * pos : tails[l];
+          for (size_t i = 0; i < rate / 8; i++) {
+            state[i] ^= load_le64(block + 8 * i);
+          }
+          keccak_f1600(state);
+        }
+        for (size_t i = 0; i < out_len; i++) {
+          out[out_len * lane[l].msg + i] = (unsigned char) (state[i / 8] >> (8 * (i % 8)));
+        }
+        secure_wipe(state, sizeof(state));
+      }
+      break;
+    }
+
+    for (int l = 0; l < 4; l++) {
+      if (lane[l].msg == (size_t) -1) {
+        continue;
+      }
+      size_t pos = lane[l].pos;
+      const unsigned char *block = (pos < lane[l].full_blocks) ? data[lane[l].msg] + rate * pos : tails[l];
+      for (size_t i = 0; i < rate / 8; i++) {
+        st[i][l] ^= load_le64(block + 8 * i);
+      }
+    }
+    keccak_f1600_x4_avx2(st);
+
+    for (int l = 0; l < 4; l++) {
+      if (lane[l].msg == (size_t) -1 || lane[l].pos++ < lane[l].full_blocks) {
+        continue;
+      }
+      for (size_t i = 0; i < out_len; i++) {
+        out[out_len * lane[l].msg + i] = (unsigned char) (st[i / 8][l] >> (8 * (i % 8)));
+      }
+      lane[l].msg = (size_t) -1;
+      active--;
+    }
+  }
+
+  secure_wipe(st, sizeof(st));
+  secure_wipe(tails, sizeof(tails));
+}
+#endif
+
+// SHA3 of n messages with out_len-byte digests; digest i is written to
+// out + out_len * i. Batches go through the four-way AVX2 kernel where
+// available.
+void sha3_many(const unsigned char *const *data, const size_t *lens, size_t n, size_t out_len, unsigned char *out) {
+  sha3_dispatch();
+#ifdef SHA3_X86
+  if (sha3_use_avx2 && n >= 2) {
+    sha3_many_avx2(data, lens, n, out_len, out);
+    return;
+  }
+#endif
+  for (size_t i = 0; i < n; i++) {
+    sha3(data[i], lens[i], out_len, out + out_len * i);
+  }
+}
+
+const char* sha3_implementation() {
+  sha3_dispatch();
+  return sha3_backend;
+}
+
+
+// SHA3 with out_len_r-byte digests (32 or 64) of a raw vector, every string
+// of a character vector or every raw vector of a list, with the same
+// results as sha256_R()
+SEXP sha3_R(SEXP x, SEXP out_len_r, SEXP output_hex_r) {
+  int out_len = asInteger(out_len_r);
+  if (out_len != 32 && out_len != 64) {
+    error("SHA3 digests are 32 or 64 bytes.");
+  }
+  int output_hex = asLogical(output_hex_r) == TRUE;
+  char hex[128];
+
+  if (TYPEOF(x) == RAWSXP) {
+    unsigned char digest[64];
+    sha3(RAW(x), (size_t) XLENGTH(x), (size_t) out_len, digest);
+    if (output_hex) {
+      hex_encode(digest, (size_t) out_len, hex);
+      return ScalarString(mkCharLen(hex, 2 * out_len));
+    }
+    SEXP result = PROTECT(allocVector(RAWSXP, out_len));
+    memcpy(RAW(result), digest, (size_t) out_len);
+    UNPROTECT(1);
+    return result;
+  }
+  if (TYPEOF(x) != STRSXP && TYPEOF(x) != VECSXP) {
+    error("Input must be a raw vector, a character vector or a list of raw vectors.");
+  }
+
+  // Collect the messages that are present, then hash them in one batch
+  R_xlen_t n = XLENGTH(x);
+  const unsigned char **data = (const unsigned char **) R_alloc(n > 0 ? n : 1, sizeof(unsigned char *));
+  size_t *lens = (size_t *) R_alloc(n > 0 ? n : 1, sizeof(size_t));
+  R_xlen_t *index = (R_xlen_t *) R_alloc(n > 0 ? n : 1, sizeof(R_xlen_t));
+  R_xlen_t present = 0;
+  for (R_xlen_t i = 0; i < n; i++) {
+    if (TYPEOF(x) == STRSXP) {
+      SEXP s = STRING_ELT(x, i);
+      if (s == NA_STRING) {
+        continue;
+      }
+      data[present] = (const unsigned char *) CHAR(s);
+      lens[present] = (size_t) LENGTH(s);
+    } else {
+      SEXP el = VECTOR_ELT(x, i);
+      if (el == R_NilValue) {
+        continue;
+      }
+      if (TYPEOF(el) != RAWSXP) {
+        error("Element %lld is not a raw vector.", (long long) i + 1);
+      }
+      data[present] = RAW(el);
+      lens[present] = (size_t) XLENGTH(el);
+    }
+    index[present++] = i;
+  }
+  if (!output_hex && present < n) {
+    error("Cannot hash missing values into a raw matrix.");
+  }
+
+  if (output_hex) {
+    unsigned char *digests = (unsigned char *) R_alloc(present > 0 ? present : 1, (size_t) out_len);
+    sha3_many(data, lens, (size_t) present, (size_t) out_len, digests);
+    SEXP result = PROTECT(allocVector(STRSXP, n));
+    for (R_xlen_t i = 0; i < n; i++) {
+      SET_STRING_ELT(result, i, NA_STRING);
+    }
+    for (R_xlen_t j = 0; j < present; j++) {
+      hex_encode(digests + out_len * j, (size_t) out_len, hex);
+      SET_STRING_ELT(result, index[j], mkCharLen(hex, 2 * out_len));
+    }
+    UNPROTECT(1);
+    return result;
+  }
+
+  if (n > INT_MAX) {
+    error("Too many messages for a raw matrix.");
+  }
+  SEXP result = PROTECT(allocMatrix(RAWSXP, out_len, (int) n));
+  sha3_many(data, lens, (size_t) n, (size_t) out_len, RAW(result));
+  UNPROTECT(1);
+  return result;
+}
+
+SEXP sha3_implementation_R() {
+  return mkString(sha3_implementation());
+}
+
+// The first n bytes of the SHA3-512 of a string or a raw vector, as a raw
+// vector: the key derivation of hash_string_key()
+SEXP hash_string_key_R(SEXP key_r, SEXP n_r) {
+  int n = asInteger(n_r);
+  if (n == NA_INTEGER || n < 1 || n > 64) {
+    error("The key length must be between 1 and 64 bytes.");
+  }
+  const unsigned char *data;
+  size_t len;
+  if (TYPEOF(key_r) == RAWSXP) {
+    data = RAW(key_r);
+    len = (size_t) XLENGTH(key_r);
+  } else if (TYPEOF(key_r) == STRSXP && XLENGTH(key_r) == 1 && STRING_ELT(key_r, 0) != NA_STRING) {
+    data = (const unsigned char *) CHAR(STRING_ELT(key_r, 0));
+    len = (size_t) LENGTH(STRING_ELT(key_r, 0));
+  } else {
+    error("Key should be a character string or raw vector.");
+  }
+
+  unsigned char digest[64];
+  sha3(data, len, 64, digest);
+  SEXP result = PROTECT(allocVector(RAWSXP, n));
+  memcpy(RAW(result), digest, (size_t) n);
+  secure_wipe(digest, sizeof(digest));
+  UNPROTECT(1);
+  return result;
+}
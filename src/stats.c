@@ -0,0 +1,201 @@
+#include <R.h>
+#include <Rinternals.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+#include "flureeCrypto.h"
+
+
+// Opt-in instrumentation of the .Call entry points. init.c wraps every
+// timed entry point so that it only tests stats_enabled when the counters
+// are off. When they are on, each call is counted with the bytes of its raw
+// and character arguments before it runs, and adds its latency to a
+// histogram of power-of-two nanosecond buckets when it returns; a call that
+// raises an error longjmps past that, so it shows up as counted but not
+// completed. Entry points only run on the R thread, which is the single
+// writer of the counters, so they need neither locks nor atomics; worker
+// threads never touch them.
+
+// Bucket b holds latencies in [2^b, 2^(b + 1)) nanoseconds
+#define STATS_BUCKETS 48
+
+typedef struct {
+  uint64_t calls;
+  uint64_t completed;  // calls that returned, and so have a latency
+  uint64_t bytes;
+  uint64_t total_ns;
+  uint64_t max_ns;
+  uint64_t buckets[STATS_BUCKETS];
+} op_stats;
+
+int stats_enabled = 0;
+static const char *const *op_names = NULL;
+static op_stats *ops = NULL;
+static int n_ops = 0;
+
+void stats_register(const char *const *names, int n) {
+  ops = (op_stats *) calloc((size_t) n, sizeof(op_stats));
+  if (ops != NULL) {
+    op_names = names;
+    n_ops = n;
+  }
+}
+
+void free_stats() {
+  free(ops);
+  ops = NULL;
+  n_ops = 0;
+  stats_enabled = 0;
+}
+
+uint64_t stats_clock() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t) ts.tv_sec * 1000000000u + (uint64_t) ts.tv_nsec;
+}
+
+// Bytes of a .Call argument: raw vectors, strings and lists of them
+static uint64_t argument_bytes(SEXP x) {
+  switch (TYPEOF(x)) {
+  case RAWSXP:
+    return (uint64_t) XLENGTH(x);
+  case STRSXP: {
+    uint64_t bytes = 0;
+    for (R_xlen_t i = 0; i < XLENGTH(x); i++) {
+      SEXP s = STRING_ELT(x, i);
+      if (s != NA_STRING) {
+        bytes += (uint64_t) LENGTH(s);
+      }
+    }
+    return bytes;
+  }
+  case VECSXP: {
+    uint64_t bytes = 0;
+    for (R_xlen_t i = 0; i < XLENGTH(x); i++) {
+      SEXP el = VECTOR_ELT(x, i);
+      if (TYPEOF(el) == RAWSXP) {
+        bytes += (uint64_t) XLENGTH(el);
+      } else if (TYPEOF(el) == STRSXP && XLENGTH(el) == 1 && STRING_ELT(el, 0) != NA_STRING) {
+        bytes += (uint64_t) LENGTH(STRING_ELT(el, 0));
+      }
+    }
+    return bytes;
+  }
+  default:
+    return 0;
+  }
+}
+
+// Count a call of operation op and its argument bytes, before it runs
+void stats_count(int op, const SEXP *args, int n_args) {
+  if (op < 0 || op >= n_ops) {
+    return;
+  }
+  op_stats *s = &ops[op];
+  s->calls++;
+  for (int i = 0; i < n_args; i++) {
+    s->bytes += argument_bytes(args[i]);
+  }
+}
+
+// Record the latency of a call of operation op that started at start
+// (stats_clock()) and returned
+void stats_record(int op, uint64_t start) {
+  uint64_t ns = stats_clock() - start;
+  if (op < 0 || op >= n_ops) {
+    return;
+  }
+  op_stats *s = &ops[op];
+  s->completed++;
+  s->total_ns += ns;
+  if (ns > s->max_ns) {
+    s->max_ns = ns;
+  }
+  int bucket = (ns == 0) ? 0 : 63 - __builtin_clzll(ns);
+  s->buckets[bucket < STATS_BUCKETS ? bucket : STATS_BUCKETS - 1]++;
+}
+
+// Latency below which a fraction q of the completed calls fall, as the
+// upper bound of its bucket (so within a factor of two), capped at the
+// slowest call; NA without completed calls
+static double stats_quantile(const op_stats *s, double q) {
+  if (s->completed == 0) {
+    return NA_REAL;
+  }
+  uint64_t target = (uint64_t) (q * (double) s->completed);
+  if ((double) target < q * (double) s->completed || target == 0) {
+    target++;
+  }
+  uint64_t seen = 0;
+  for (int b = 0; b < STATS_BUCKETS; b++) {
+    seen += s->buckets[b];
+    if (seen >= target) {
+      double upper = (double) ((uint64_t) 1 << (b + 1));
+      return upper < (double) s->max_ns ? upper : (double) s->max_ns;
+    }
+  }
+  return (double) s->max_ns;
+}
+
+
+SEXP crypto_stats_enable_R(SEXP enabled_r) {
+  int previous = stats_enabled;
+  int enabled = asLogical(enabled_r);
+  if (enabled == NA_LOGICAL) {
+    error("enabled must be TRUE or FALSE.");
+  }
+  if (enabled && ops == NULL) {
+    error("Failed to allocate the instrumentation counters");
+  }
+  stats_enabled = enabled;
+  return ScalarLogical(previous);
+}
+
+SEXP crypto_stats_reset_R() {
+  if (ops != NULL) {
+    memset(ops, 0, (size_t) n_ops * sizeof(op_stats));
+  }
+  return R_NilValue;
+}
+
+// The counters of every operation called since the last reset, as a list
+// of columns
+SEXP crypto_stats_R() {
+  int n = 0;
+  for (int i = 0; i < n_ops; i++) {
+    n += ops[i].calls > 0;
+  }
+
+  const char *names[] = {"operation", "calls", "errors", "bytes", "total_ms", "mean_us", "p50_us", "p99_us",
+                         "max_us"};
+  SEXP result = PROTECT(allocVector(VECSXP, 9));
+  SEXP result_names = PROTECT(allocVector(STRSXP, 9));
+  SET_VECTOR_ELT(result, 0, allocVector(STRSXP, n));
+  for (int c = 1; c < 9; c++) {
+    SET_VECTOR_ELT(result, c, allocVector(REALSXP, n));
+  }
+  for (int c = 0; c < 9; c++) {
+    SET_STRING_ELT(result_names, c, mkChar(names[c]));
+  }
+
+  int row = 0;
+  for (int i = 0; i < n_ops; i++) {
+    const op_stats *s = &ops[i];
+    if (s->calls == 0) {
+      continue;
+    }
+    SET_STRING_ELT(VECTOR_ELT(result, 0), row, mkChar(op_names[i]));
+    REAL(VECTOR_ELT(result, 1))[row] = (double) s->calls;
+    REAL(VECTOR_ELT(result, 2))[row] = (double) (s->calls - s->completed);
+    REAL(VECTOR_ELT(result, 3))[row] = (double) s->bytes;
+    REAL(VECTOR_ELT(result, 4))[row] = (double) s->total_ns / 1e6;
+    REAL(VECTOR_ELT(result, 5))[row] = s->completed ? (double) s->total_ns / (double) s->completed / 1e3 : NA_REAL;
+    REAL(VECTOR_ELT(result, 6))[row] = stats_quantile(s, 0.5) / 1e3;
+    REAL(VECTOR_ELT(result, 7))[row] = stats_quantile(s, 0.99) / 1e3;
+    REAL(VECTOR_ELT(result, 8))[row] = s->completed ? (double) s->max_ns / 1e3 : NA_REAL;
+    row++;
+  }
+  setAttrib(result, R_NamesSymbol, result_names);
+  UNPROTECT(2);
+  return result;
+}
@@ -0,0 +1,53 @@
+#!/bin/sh
+# Vendor the libsecp256k1 release named in tools/secp256k1-version into
+# src/secp256k1, keeping only what the package build needs (the public
+# headers, the library sources and the licence). Run from the package root
+# when upgrading the library, then commit src/secp256k1.
+#
+# The downloaded archive must match the SHA-256 in tools/secp256k1.sha256,
+# taken from the release itself, not from a download of it. The vendored
+# files are listed with their checksums in src/secp256k1/SHA256SUMS, which
+# configure checks before building them.
+set -e
+
+if [ ! -f tools/secp256k1.sha256 ]; then
+  echo "tools/secp256k1.sha256 is missing; record the SHA-256 of the release archive there first" >&2
+  exit 1
+fi
+PINNED=`cat tools/secp256k1.sha256`
+
+VERSION=`cat tools/secp256k1-version`
+URL="https://github.com/bitcoin-core/secp256k1/archive/refs/tags/v${VERSION}.tar.gz"
+DEST=src/secp256k1
+WORK=`mktemp -d`
+trap 'rm -rf "$WORK"' EXIT
+
+echo "Downloading libsecp256k1 ${VERSION}"
+if command -v curl >/dev/null 2>&1; then
+  curl -fsSL "$URL" -o "$WORK/secp256k1.tar.gz"
+else
+  wget -q "$URL" -O "$WORK/secp256k1.tar.gz"
+fi
+
+if command -v sha256sum >/dev/null 2>&1; then
+  SHA256="sha256sum"
+else
+  SHA256="shasum -a 256"
+fi
+SUM=`$SHA256 "$WORK/secp256k1.tar.gz" | cut -d' ' -f1`
+if [ "$SUM" != "$PINNED" ]; then
+  echo "Checksum mismatch for libsecp256k1 ${VERSION}: got ${SUM}, expected ${PINNED}" >&2
+  exit 1
+fi
+
+tar -xzf "$WORK/secp256k1.tar.gz" -C "$WORK"
+SRC="$WORK/secp256k1-${VERSION}"
+rm -rf "$DEST"
+mkdir -p "$DEST"
+cp -R "$SRC/include" "$SRC/src" "$SRC/COPYING" "$DEST/"
+# Tests, benchmarks and the ctime/valgrind checks are not built here
+rm -rf "$DEST/src/wycheproof" "$DEST/src/ctime_tests.c" "$DEST/src/tests.c" "$DEST/src/tests_exhaustive.c" \
+  "$DEST/src/bench.c" "$DEST/src/bench_ecmult.c" "$DEST/src/bench_internal.c"
+(cd "$DEST" && find include src COPYING -type f | LC_ALL=C sort | xargs $SHA256 > "$WORK/SHA256SUMS")
+(echo "# libsecp256k1 ${VERSION} ${SUM}"; cat "$WORK/SHA256SUMS") > "$DEST/SHA256SUMS"
+echo "libsecp256k1 ${VERSION} is in ${DEST}"